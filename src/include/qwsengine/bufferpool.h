@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QtGlobal>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+/**
+ * @brief Per-thread pool of size-classed byte buffers used for inbound decoding and outbound encoding.
+ *
+ * Buffers up to 64 KB are borrowed from and returned to a pool of the current thread. Larger buffers are allocated
+ * on demand. The retained memory of each thread pool is bounded by maxRetainedBytes().
+ */
+class QWSENGINE_EXPORT BufferPool {
+ public:
+    struct Statistics {
+        /// Number of buffers served from a pool
+        quint64 hits;
+        /// Number of buffers which had to be allocated
+        quint64 misses;
+        /// Memory currently retained by the pools of all threads
+        qint64 retainedBytes;
+
+        double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    };
+
+    /**
+     * @brief Aggregated statistics of all thread pools. Thread-safe.
+     */
+    static Statistics statistics();
+
+    /**
+     * @brief Reset the hit and miss counters. Thread-safe.
+     */
+    static void resetStatistics();
+
+    /**
+     * @brief Set the maximum memory retained by the pool of a single thread. Thread-safe.
+     *
+     * Returned buffers exceeding the bound are freed. Defaults to 1 MB, 0 disables pooling.
+     */
+    static void   setMaxRetainedBytes(qint64 bytes);
+    static qint64 maxRetainedBytes();
+};
+
+}  // namespace QWsEngine
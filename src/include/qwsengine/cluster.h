@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class Connection;
+class ClusterPrivate;
+
+/**
+ * @brief Message bus between multiple server processes on the same host.
+ *
+ * All processes joining a cluster with the same name are connected over a local socket (Unix domain socket on Linux).
+ * The first process acquiring the cluster lock file becomes the hub: it listens on the local socket and forwards the
+ * messages between the other processes. If the hub exits, the remaining processes elect a new hub.
+ *
+ * A message is serialized once per process and delivered to the local connections of each process, instead of once
+ * per client. Messages are only delivered to authenticated connections. Messages sent while a process is not
+ * connected to the hub, e.g. during a hub election, are not delivered to the other processes.
+ *
+ * The connections of a server are registered with Server::setCluster(). Cluster connection ids combine the node id of
+ * the process with the process-local connection id, see connectionId().
+ *
+ * @code
+ * QWsEngine::Cluster cluster("my-service");
+ * server.setCluster(&cluster);
+ * cluster.start();
+ * ...
+ * cluster.broadcastTextMessage("{\"type\": \"event\", \"msg\": \"config_changed\"}");
+ * @endcode
+ */
+class QWSENGINE_EXPORT Cluster : public QObject {
+    Q_OBJECT
+
+ public:
+    /**
+     * @brief Constructs a cluster node. The name is used for the local socket and the lock file of the hub election.
+     */
+    explicit Cluster(const QString &name, QObject *parent = nullptr);
+    virtual ~Cluster();
+
+    QString name() const;
+
+    /**
+     * @brief Set the node id of this process. Defaults to the process id.
+     *
+     * Must be unique within the cluster and set before start(), e.g. to run multiple nodes in one test process.
+     */
+    void    setNodeId(quint32 nodeId);
+    quint32 nodeId() const;
+
+    /**
+     * @brief Set the maximum number of bytes buffered for writing to the hub or a node. Defaults to 16 MB.
+     *
+     * Local socket writes are buffered in memory while the other process doesn't read, e.g. while its event loop is
+     * blocked. A socket exceeding the limit is disconnected: the node rejoins and the messages in between are lost.
+     */
+    void   setMaxWriteBufferSize(qint64 bytes);
+    qint64 maxWriteBufferSize() const;
+
+    /**
+     * @brief Join the cluster, either as hub or by connecting to the hub.
+     *
+     * The connection to the hub is established asynchronously, see joined().
+     */
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    /**
+     * @brief Returns true if this process is the hub of the cluster.
+     */
+    bool isHub() const;
+
+    /**
+     * @brief Returns the cluster-wide connection id of a local connection.
+     *
+     * The node id is stored in the upper 24 bits, the process-local Connection::id() in the lower 40 bits.
+     */
+    quint64 connectionId(const QSharedPointer<Connection> &connection) const;
+
+    /**
+     * @brief Returns the node id of a cluster connection id.
+     */
+    static quint32 nodeOf(quint64 clusterConnectionId);
+
+    /**
+     * @brief Send a message to all authenticated connections of all processes. Thread-safe.
+     */
+    void broadcastTextMessage(const QString &message);
+    void broadcastBinaryMessage(const QByteArray &data);
+
+    /**
+     * @brief Send a message to a single connection of any process, identified by its cluster connection id.
+     * Thread-safe.
+     *
+     * Returns false if the connection is local and doesn't exist, or the process isn't connected to the cluster.
+     */
+    bool sendTextMessage(quint64 clusterConnectionId, const QString &message);
+    bool sendBinaryMessage(quint64 clusterConnectionId, const QByteArray &data);
+
+    /**
+     * @brief Returns the number of connections of this process.
+     */
+    int localConnectionCount() const;
+
+    /**
+     * @brief Returns the number of connections of all processes.
+     *
+     * The connection counts of the other processes are updated by the hub with a short delay.
+     */
+    int connectionCount() const;
+
+    /**
+     * @brief Returns the connection count of each node.
+     */
+    QHash<quint32, int> nodeConnectionCounts() const;
+
+ Q_SIGNALS:  // NOLINT
+    /**
+     * @brief Emitted when this process became the hub or joined a hub.
+     */
+    void joined(bool hub);
+
+    /**
+     * @brief Emitted when the connection to the hub was lost. The cluster automatically rejoins.
+     */
+    void disconnected();
+
+    void connectionCountChanged(int count);
+
+ private:
+    ClusterPrivate *const d;
+    friend class ClusterPrivate;
+};
+
+}  // namespace QWsEngine
@@ -5,10 +5,15 @@
 
 #include <QByteArray>
 #include <QEnableSharedFromThis>
+#include <QEvent>
+#include <QHash>
+#include <QHostAddress>
+#include <QIODevice>
 #include <QJsonObject>
 #include <QList>
 #include <QObject>
 #include <QScopedPointer>
+#include <QSharedPointer>
 #include <QString>
 #include <QtWebSockets/QWebSocket>
 
@@ -17,6 +22,8 @@
 namespace QWsEngine {
 
 class Handler;
+class JsonWriter;
+class MappedFile;
 class Middleware;
 class ConnectionPrivate;
 
@@ -41,15 +48,174 @@ class QWSENGINE_EXPORT Connection : public QObject, public QEnableSharedFromThis
 
     QWebSocket *webSocket() const;
 
+    /**
+     * @brief Process-wide unique connection id.
+     */
+    quint64 id() const;
+
     bool isAuthenticated() const;
     void setAuthenticated(bool authenticated);
 
+    /**
+     * @brief Returns the address and port of the client.
+     *
+     * Behind a load balancer with the PROXY protocol enabled, this is the client address of the PROXY header, see
+     * Server::setProxyProtocol(). Otherwise it's the peer address of the socket.
+     */
+    QHostAddress clientAddress() const;
+    quint16      clientPort() const;
+
+    /**
+     * @brief Returns the path route pattern which created the connection, e.g. for metrics.
+     *
+     * Returns a null string if the connection wasn't created by a path route, see ConnectionHandler::addRoute().
+     */
+    QString routeId() const;
+
+    /**
+     * @brief Returns the value of a `{name}` parameter captured from the request path by the matched route.
+     */
+    QString                 pathParameter(const QString &name) const;
+    QHash<QString, QString> pathParameters() const;
+
     virtual void sendErrorResponse(int statusCode, const QString &errorMsg = QString());
     virtual void sendAuthRequired();
 
+    /**
+     * @brief Send a text message to the client.
+     *
+     * If called from a thread other than the one owning the connection, the message is queued with
+     * postTextMessage() and 0 is returned.
+     */
     qint64 sendTextMessage(const QString &message);
+
+    /**
+     * @brief Send a text message from UTF-8 encoded data.
+     *
+     * Avoids the additional UTF-8 / UTF-16 round trips of sendTextMessage() when the payload is already UTF-8 encoded.
+     * If called from a thread other than the one owning the connection, the message is queued and 0 is returned.
+     */
+    qint64 sendUtf8(const QByteArray &utf8);
+
+    /**
+     * @brief Send the JSON document of the writer as text message.
+     *
+     * @see sendUtf8()
+     */
+    qint64 sendJson(const JsonWriter &json);
+
+    /**
+     * @brief Send a JSON object in compact format as text message.
+     *
+     * @see sendUtf8()
+     */
+    qint64 sendJson(const QJsonObject &json);
+
+    /**
+     * @brief Send a binary message to the client.
+     *
+     * If called from a thread other than the one owning the connection, the message is queued with
+     * postBinaryMessage() and 0 is returned.
+     */
     qint64 sendBinaryMessage(const QByteArray &data);
 
+    /**
+     * @brief Queue a text message for sending. Thread-safe.
+     *
+     * The message is pushed into a lock-free outbound queue and sent from the thread owning the connection.
+     * Queued messages are sent in batches with a single wakeup of the owning thread. Messages posted from the same
+     * thread keep their order.
+     */
+    void postTextMessage(const QString &message);
+
+    /**
+     * @brief Queue a binary message for sending. Thread-safe.
+     *
+     * @see postTextMessage()
+     */
+    void postBinaryMessage(const QByteArray &data);
+
+    /**
+     * @brief Send a text message with "latest value wins" semantics, e.g. for state updates.
+     *
+     * If the socket's write buffer exceeds the write buffer watermark, the message is held back. A held back message
+     * with the same key is replaced by the new message, keeping the position of the first pending message of the key.
+     * Pending messages are sent as soon as the write buffer drained below the watermark, so the last value of each key
+     * is always delivered, but a slow client only receives the most recent one.
+     *
+     * Pending messages are delivered after messages sent in the meantime with sendTextMessage().
+     * Returns the number of bytes sent, or 0 if the message is pending. Thread-safe: from other threads the message is
+     * queued with the messages of postTextMessage(), keeping their order, and 0 is returned.
+     */
+    qint64 sendConflated(const QString &key, const QString &message);
+
+    /**
+     * @brief Send a low priority text message, e.g. a large list payload.
+     *
+     * Bulk messages are held back while the socket's write buffer exceeds the write buffer watermark and are sent in
+     * order after pending conflated messages. Messages sent with the regular send methods, including error responses
+     * and authentication messages, are written immediately and therefore overtake held back bulk messages. A client
+     * downloading a large amount of bulk data only delays urgent replies by the watermark and the message being
+     * written.
+     *
+     * Returns the number of bytes sent, or 0 if the message is pending. Thread-safe: from other threads the message is
+     * queued with the messages of postTextMessage(), keeping their order, and 0 is returned.
+     */
+    qint64 sendBulkTextMessage(const QString &message);
+
+    /**
+     * @brief Send a low priority binary message.
+     *
+     * @see sendBulkTextMessage()
+     */
+    qint64 sendBulkBinaryMessage(const QByteArray &data);
+
+    /**
+     * @brief Send the data of a device as consecutive binary messages of at most chunkSize bytes.
+     *
+     * The next chunk is read when the socket's write buffer drained below the write buffer watermark, so only about
+     * one chunk and the watermark are held in memory, independent of the size of the data. Streams are sent one after
+     * another with the priority of bulk messages. A sequential device is streamed until it emits
+     * QIODevice::readChannelFinished().
+     *
+     * The connection takes ownership of the device, which must not have a parent. Returns the stream id passed to
+     * streamFinished(), or 0 if the device isn't readable.
+     *
+     * Thread-safe: the device must live in the calling thread or the thread owning the connection, it is moved to the
+     * latter. Called from other threads, the stream is queued with the messages of postTextMessage(), keeping their
+     * order.
+     *
+     * Requires Qt 5.12 for the pacing, with older versions the whole stream is written at once.
+     */
+    quint64 sendBinaryStream(QIODevice *device, int chunkSize = 64 * 1024);
+
+    /**
+     * @brief Send a memory-mapped file as consecutive binary messages of at most chunkSize bytes.
+     *
+     * Connections downloading the same file share the mapping, the chunks are written from the mapping without copying
+     * them. Thread-safe: called from other threads, the stream is queued with the messages of postTextMessage().
+     *
+     * @see sendBinaryStream(QIODevice *, int), MappedFile::open()
+     */
+    quint64 sendBinaryStream(const QSharedPointer<MappedFile> &file, int chunkSize = 64 * 1024);
+
+    /**
+     * @brief Set the write buffer size in bytes above which conflated and bulk messages are held back. Defaults to
+     * 64 KB.
+     *
+     * Requires Qt 5.12, with older versions all messages are sent immediately.
+     */
+    void setWriteBufferWatermark(int bytes);
+    int  writeBufferWatermark() const;
+
+ Q_SIGNALS:  // NOLINT
+    /**
+     * @brief Emitted when all chunks of a stream have been handed to the socket, or when reading the device failed.
+     *
+     * A stream is discarded without this signal if the connection is closed before.
+     */
+    void streamFinished(quint64 streamId, bool success);
+
  public Q_SLOTS:  // NOLINT
     void processTextMessage(const QString &message);
     void processBinaryMessage(const QByteArray &message);
@@ -57,6 +223,9 @@ class QWSENGINE_EXPORT Connection : public QObject, public QEnableSharedFromThis
     void close(QWebSocketProtocol::CloseCode closeCode = QWebSocketProtocol::CloseCodeNormal,
                const QString &               reason = QString());
 
+ protected:
+    bool event(QEvent *event) override;
+
  private:
     QScopedPointer<ConnectionPrivate> const d;
     friend class ConnectionPrivate;
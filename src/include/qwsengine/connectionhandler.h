@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <QList>
 #include <QObject>
+#include <QPair>
 #include <QRegExp>
 #include <QSharedPointer>
 #include <QtWebSockets/QWebSocket>
@@ -16,6 +18,37 @@ class Connection;
 class ConnectionMiddleware;
 class ConnectionHandlerPrivate;
 class Handler;
+class SessionManager;
+
+/**
+ * @brief Routing configuration of a ConnectionHandler: connection middleware, path routes and sub handlers.
+ *
+ * Path routes are compiled into a trie when the configuration is published. A route pattern consists of exact
+ * segments, `{name}` parameter segments matching a single path segment, and an optional trailing `*` segment
+ * matching any path below the prefix, e.g. `/devices/{id}/events` or `/static/*`. Exact segments take precedence
+ * over parameters, parameters over prefixes. The captured parameters and the matched pattern are available with
+ * Connection::pathParameter() and Connection::routeId().
+ *
+ * Published atomically with ConnectionHandler::setRouting(), see HandlerRouting.
+ */
+class QWSENGINE_EXPORT ConnectionRouting {
+ public:
+    ConnectionRouting &addMiddleware(ConnectionMiddleware *middleware);
+    ConnectionRouting &removeMiddleware(ConnectionMiddleware *middleware);
+    ConnectionRouting &addSubHandler(const QRegExp &pattern, ConnectionHandler *handler);
+    ConnectionRouting &removeSubHandler(ConnectionHandler *handler);
+    ConnectionRouting &addRoute(const QString &pathPattern, ConnectionHandler *handler);
+    ConnectionRouting &removeRoute(const QString &pathPattern);
+
+    const QList<ConnectionMiddleware *> &              middleware() const { return m_middleware; }
+    const QList<QPair<QRegExp, ConnectionHandler *>> & subHandlers() const { return m_subHandlers; }
+    const QList<QPair<QString, ConnectionHandler *>> & routes() const { return m_routes; }
+
+ private:
+    QList<ConnectionMiddleware *>              m_middleware;
+    QList<QPair<QRegExp, ConnectionHandler *>> m_subHandlers;
+    QList<QPair<QString, ConnectionHandler *>> m_routes;
+};
 
 /**
  * @brief Base class for WebSocket connection handlers
@@ -43,6 +76,8 @@ class QWSENGINE_EXPORT ConnectionHandler : public QObject {
 
     /**
      * @brief Add connection middleware to the handler
+     *
+     * Publishes a new routing configuration, see setRouting().
      */
     void addMiddleware(ConnectionMiddleware *middleware);
 
@@ -53,9 +88,31 @@ class QWSENGINE_EXPORT ConnectionHandler : public QObject {
      * used when the route() method is invoked, after the connection middleware has been processed.
      * If the sub handler returns a Connection, further processing is stopped and the connection returned to the caller.
      * The order of the list is preserved.
+     * Publishes a new routing configuration, see setRouting().
      */
     void addSubHandler(const QRegExp &pattern, ConnectionHandler *handler);
 
+    /**
+     * @brief Add a handler for a path route pattern
+     *
+     * Path routes are matched with a compiled trie before the regular expression sub handlers are evaluated, see
+     * ConnectionRouting for the pattern syntax. The parameters captured from the path are stored in the created
+     * Connection. Publishes a new routing configuration, see setRouting().
+     */
+    void addRoute(const QString &pathPattern, ConnectionHandler *handler);
+
+    /**
+     * @brief Returns a copy of the current routing configuration.
+     */
+    ConnectionRouting routing() const;
+
+    /**
+     * @brief Atomically replace the routing configuration. Thread-safe.
+     *
+     * Connections being routed continue with the previous configuration, which is released after they finished.
+     */
+    void setRouting(const ConnectionRouting &routing);
+
     /**
      * @brief Route an incoming connection
      */
@@ -67,6 +124,20 @@ class QWSENGINE_EXPORT ConnectionHandler : public QObject {
     void     setMessageHandler(Handler *handler);
     Handler *messageHandler();
 
+    /**
+     * @brief Enable resumable sessions for the connections of this handler.
+     *
+     * Authenticated connections receive a resume token. A client reconnecting within the grace period with the
+     * `resume_token` and `last_seq` query parameters skips the authentication and receives the missed messages. The
+     * middleware is still run for a resumed connection.
+     *
+     * A session is only resumed by the connection handler which created it, other handlers route the connection as
+     * usual. The resumed connection gets the message handler, route id and path parameters of the original
+     * connection.
+     */
+    void            setSessionManager(SessionManager *manager);
+    SessionManager *sessionManager() const;
+
  protected:
     /**
      * @brief Process a new connection
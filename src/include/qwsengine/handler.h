@@ -4,7 +4,10 @@
 #pragma once
 
 #include <QByteArray>
+#include <QList>
 #include <QObject>
+#include <QPair>
+#include <QRegExp>
 #include <QSharedPointer>
 #include <QString>
 #include <QVariant>
@@ -16,8 +19,37 @@ namespace QWsEngine {
 
 class Connection;
 class Middleware;
+class Handler;
 class HandlerPrivate;
 
+/**
+ * @brief Routing configuration of a Handler: message middleware and sub handlers.
+ *
+ * A routing configuration is built independently of the message dispatching and published atomically with
+ * Handler::setRouting(). This allows to add or remove features at runtime, also from other threads, without pausing
+ * the dispatching.
+ *
+ * @code
+ * QWsEngine::HandlerRouting routing = handler.routing();
+ * routing.removeSubHandler(oldPlugin).addSubHandler(QRegExp("^plugin_"), newPlugin);
+ * handler.setRouting(routing);
+ * @endcode
+ */
+class QWSENGINE_EXPORT HandlerRouting {
+ public:
+    HandlerRouting &addMiddleware(Middleware *middleware);
+    HandlerRouting &removeMiddleware(Middleware *middleware);
+    HandlerRouting &addSubHandler(const QRegExp &msgNamePattern, Handler *handler);
+    HandlerRouting &removeSubHandler(Handler *handler);
+
+    const QList<Middleware *> &              middleware() const { return m_middleware; }
+    const QList<QPair<QRegExp, Handler *>> & subHandlers() const { return m_subHandlers; }
+
+ private:
+    QList<Middleware *>              m_middleware;
+    QList<QPair<QRegExp, Handler *>> m_subHandlers;
+};
+
 /**
  * @brief Base class for WebSocket message handlers
  *
@@ -25,11 +57,36 @@ class HandlerPrivate;
  * invokes the route() method of the root handler which is used to determine
  * what happens to the message. All WebSocket handlers derive from this class
  * should override the protected process() method in order to process the message.
+ *
+ * Binary messages are routed with the message name `binary` unless a binary framing is set on the root handler:
+ *
+ * @code
+ * handler.setBinaryFraming(QWsEngine::Handler::VarintIdFraming);
+ * handler.registerBinaryMessage(1, "sensor_sample");  // routed like a text message named sensor_sample
+ * @endcode
+ *
+ * The message passed to the middleware and handlers is then the payload after the prefix, a QByteArray view on the
+ * received frame without copying it. The view is only valid while the message is being routed, a handler keeping the
+ * payload must copy it, e.g. with `QByteArray(payload.constData(), payload.size())`. QObjectHandler takes care of
+ * this for thread pool and asynchronous messages.
  */
 class QWSENGINE_EXPORT Handler : public QObject {
     Q_OBJECT
 
  public:
+    /**
+     * @brief Prefix of binary messages identifying the message
+     */
+    enum BinaryFraming {
+        /// No prefix, all binary messages are routed with the message name `binary`
+        NoBinaryFraming,
+        /// Message id as unsigned LEB128 varint, mapped to the message name with registerBinaryMessage()
+        VarintIdFraming,
+        /// One byte name length followed by the UTF-8 message name
+        NamePrefixFraming
+    };
+    Q_ENUM(BinaryFraming)
+
     /**
      * @brief Base constructor for a message handler
      */
@@ -39,6 +96,8 @@ class QWSENGINE_EXPORT Handler : public QObject {
 
     /**
      * @brief Add mesasge middleware to the handler
+     *
+     * Publishes a new routing configuration, see setRouting().
      */
     void addMiddleware(Middleware *middleware);
 
@@ -48,9 +107,23 @@ class QWSENGINE_EXPORT Handler : public QObject {
      * The pattern and handler will be added to an internal list that will be
      * used when the route() method is invoked to determine whether the
      * request matches any patterns. The order of the list is preserved.
+     * Publishes a new routing configuration, see setRouting().
      */
     void addSubHandler(const QRegExp &msgNamePattern, Handler *handler);
 
+    /**
+     * @brief Returns a copy of the current routing configuration.
+     */
+    HandlerRouting routing() const;
+
+    /**
+     * @brief Atomically replace the routing configuration. Thread-safe.
+     *
+     * Messages being routed continue with the previous configuration, which is released after they finished.
+     * Removed middleware and sub handlers must therefore not be deleted right away, e.g. use QObject::deleteLater().
+     */
+    void setRouting(const HandlerRouting &routing);
+
     // Message templates are stored in the handler to avoid duplicating them in each connection.
     // Otherwise they would have to be a const string without customization option or through an ugly singleton.
 
@@ -59,6 +132,22 @@ class QWSENGINE_EXPORT Handler : public QObject {
     void    setAuthRequiredMsgTemplate(const QString &messageTemplate);
     QString authRequiredMsgTemplate() const;
 
+    /**
+     * @brief Set the framing of binary messages routed by this handler. Defaults to NoBinaryFraming.
+     *
+     * Publishes a new routing configuration, see setRouting().
+     */
+    void          setBinaryFraming(BinaryFraming framing);
+    BinaryFraming binaryFraming() const;
+
+    /**
+     * @brief Map a binary message id of VarintIdFraming to a message name. Thread-safe.
+     *
+     * Binary messages with an unregistered id are rejected with error code 404. With NamePrefixFraming, registering
+     * the names saves the conversion of the prefix to a QString for each message.
+     */
+    void registerBinaryMessage(quint64 id, const QString &msgName);
+
     virtual void routeTextMessage(QSharedPointer<Connection> connection, const QString &message);
     virtual void routeBinaryMessage(QSharedPointer<Connection> connection, const QByteArray &message);
 
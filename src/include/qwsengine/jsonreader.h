@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QString>
+#include <QVarLengthArray>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+/**
+ * @brief Pull parser reading JSON directly from a UTF-8 buffer.
+ *
+ * Counterpart of JsonWriter for parsers which know the expected structure, e.g. generated message parsers. Values are
+ * read straight into the target variables without building a QJsonDocument. Keys and strings without escape
+ * sequences are returned as views into the buffer, which must outlive the reader.
+ *
+ * @code
+ * QWsEngine::JsonReader reader(utf8);
+ * QLatin1String key;
+ * reader.beginObject();
+ * while (reader.nextKey(&key)) {
+ *     if (key == QLatin1String("req_id")) {
+ *         reader.readInt(&id);
+ *     } else {
+ *         reader.skipValue();
+ *     }
+ * }
+ * if (reader.hasError()) ...
+ * @endcode
+ *
+ * After an error all read methods return false.
+ */
+class QWSENGINE_EXPORT JsonReader {
+ public:
+    enum Type { Invalid, Null, Bool, Number, String, Array, Object };
+
+    JsonReader(const char *data, int size);
+    explicit JsonReader(const QByteArray &utf8);
+
+    bool hasError() const { return m_error; }
+
+    /**
+     * @brief Byte offset of the current read position, e.g. to report the error position.
+     */
+    int offset() const { return static_cast<int>(m_pos - m_begin); }
+
+    /**
+     * @brief Returns the type of the next value without consuming it.
+     */
+    Type peek();
+
+    bool beginObject();
+
+    /**
+     * @brief Read the next key of the current object. Returns false at the end of the object.
+     *
+     * The key view is valid until the next read call. Non-ASCII keys are returned UTF-8 encoded.
+     */
+    bool nextKey(QLatin1String *key);
+
+    bool beginArray();
+
+    /**
+     * @brief Advance to the next element of the current array. Returns false at the end of the array.
+     */
+    bool nextElement();
+
+    bool readString(QString *value);
+    bool readUtf8(QByteArray *value);
+
+    /**
+     * @brief Read a string as view into the buffer, valid until the next read call. Non-ASCII strings are returned
+     * UTF-8 encoded.
+     */
+    bool readStringView(QLatin1String *value);
+
+    bool readBool(bool *value);
+    bool readDouble(double *value);
+
+    /**
+     * @brief Read an integral number. Fails for numbers with a fraction or exponent.
+     */
+    bool readInt(qint64 *value);
+    bool readNull();
+
+    /**
+     * @brief Copy the next value as it is, e.g. to keep a nested object as raw JSON.
+     */
+    bool readRawValue(QByteArray *json);
+
+    bool skipValue();
+
+    /**
+     * @brief Mark the input as invalid, e.g. after a type mismatch detected by the caller.
+     */
+    void setError() { m_error = true; }
+
+ private:
+    bool skipWhitespace();
+    bool expect(char c);
+    bool separator(char end, bool *atEnd);
+    bool scanString(const char **begin, int *size, bool *escaped);
+    bool unescape(const char *begin, int size);
+    bool scanNumber(const char **begin, int *size, bool *integral);
+    bool fail();
+
+    const char *m_begin;
+    const char *m_pos;
+    const char *m_end;
+    bool        m_error;
+    // per nesting level: true until the first element has been read
+    QVarLengthArray<bool, 16> m_first;
+    // decoded string with escape sequences
+    QByteArray m_scratch;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QString>
+#include <QVarLengthArray>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+/**
+ * @brief Streaming JSON writer appending directly into a reusable UTF-8 buffer.
+ *
+ * Avoids building a QJsonObject and the UTF-8 / UTF-16 transcoding of QJsonDocument::toJson() for outbound messages.
+ * Commas and colons are inserted automatically. The writer doesn't validate the structure: keys must only be written
+ * inside objects and every begin call must be matched by an end call.
+ *
+ * @code
+ * QWsEngine::JsonWriter json;
+ * json.beginObject()
+ *     .field("type", "result")
+ *     .field("req_id", id)
+ *     .key("msg_data").beginObject().field("volume", volume).endObject()
+ *     .endObject();
+ * connection->sendJson(json);
+ * json.clear();  // reuse the allocated buffer for the next message
+ * @endcode
+ */
+class QWSENGINE_EXPORT JsonWriter {
+ public:
+    explicit JsonWriter(int reserve = 256);
+
+    /**
+     * @brief Reset the writer while keeping the allocated buffer.
+     */
+    void clear();
+
+    /**
+     * @brief The written UTF-8 encoded JSON document.
+     */
+    const QByteArray &data() const { return m_buffer; }
+
+    JsonWriter &beginObject();
+    JsonWriter &endObject();
+    JsonWriter &beginArray();
+    JsonWriter &endArray();
+
+    JsonWriter &key(const char *key);
+    JsonWriter &key(QLatin1String key);
+    JsonWriter &key(const QString &key);
+
+    /**
+     * @brief Write a UTF-8 encoded string value.
+     */
+    JsonWriter &value(const char *value);
+    JsonWriter &value(QLatin1String value);
+    JsonWriter &value(const QString &value);
+    JsonWriter &value(bool value);
+    JsonWriter &value(int value);
+    JsonWriter &value(qint64 value);
+    JsonWriter &value(double value);
+    JsonWriter &nullValue();
+
+    /**
+     * @brief Write an already serialized JSON value, e.g. a cached payload.
+     */
+    JsonWriter &rawValue(const QByteArray &json);
+
+    template <typename T>
+    JsonWriter &field(const char *name, const T &fieldValue) {
+        return key(name).value(fieldValue);
+    }
+
+ private:
+    void separator();
+    void appendString(const char *utf8, int size);
+    void appendString(const QChar *unicode, int size);
+    void appendString(QLatin1String latin1);
+
+    QByteArray               m_buffer;
+    QVarLengthArray<bool, 8> m_firstElement;
+    bool                     m_afterKey;
+};
+
+}  // namespace QWsEngine
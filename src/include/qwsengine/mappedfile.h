@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QDateTime>
+#include <QFile>
+#include <QSharedPointer>
+#include <QString>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+/**
+ * @brief Read-only memory mapping of a file, shared by all users of the same file.
+ *
+ * Used to stream large files like firmware images to many clients with Connection::sendBinaryStream(): the pages are
+ * shared with the page cache and each client only holds the chunk being written.
+ *
+ * @code
+ * auto firmware = QWsEngine::MappedFile::open("/var/lib/app/firmware.bin");
+ * if (firmware) {
+ *     connection->sendBinaryStream(firmware);
+ * }
+ * @endcode
+ *
+ * Files should be replaced instead of modified while they are mapped. A changed file is mapped again by the next
+ * open(), and a stream of a file truncated below the mapped size fails instead of reading beyond the end of the file.
+ */
+class QWSENGINE_EXPORT MappedFile {
+ public:
+    /**
+     * @brief Map a file, or return the existing mapping of the same file. Thread-safe.
+     *
+     * The mapping is released with the last reference. Returns a null pointer if the file can't be mapped.
+     */
+    static QSharedPointer<MappedFile> open(const QString &fileName);
+
+    ~MappedFile();
+
+    QString     fileName() const { return m_file.fileName(); }
+    qint64      size() const { return m_size; }
+    const char *data() const { return reinterpret_cast<const char *>(m_data); }
+
+    /**
+     * @brief Returns true if the file was truncated below the mapped size.
+     *
+     * Reading the mapped pages beyond the end of the file crashes the process with SIGBUS.
+     */
+    bool isTruncated() const;
+
+ private:
+    Q_DISABLE_COPY(MappedFile)
+    explicit MappedFile(const QString &fileName);
+
+    QFile     m_file;
+    uchar *   m_data;
+    qint64    m_size;
+    QDateTime m_modified;
+    quint64   m_inode;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QObject>
+#include <QVector>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class MemoryBudgetPrivate;
+
+/**
+ * @brief Server-wide bound for the memory held by connections, with graduated load shedding.
+ *
+ * Every connection of a server using the budget accounts its inbound bytes, i.e. partial binary messages received so
+ * far and the message being routed, and its outbound bytes, i.e. the socket write buffer and held back bulk or
+ * conflated messages. Fragmented text messages are accounted once complete, their size is bounded by
+ * Server::setMaxAllowedIncomingMessageSize(). The sum of all connections is checked against the budget:
+ *
+ * - above the pause threshold the heaviest connections are paused: their messages are rejected with a 503 error
+ *   response without being parsed, until the usage dropped below the resume threshold.
+ * - above the reject threshold new connections are refused.
+ * - above the budget the heaviest connections are closed until the usage is projected below the reject threshold.
+ *
+ * @code
+ * QWsEngine::MemoryBudget budget(256 * 1024 * 1024);
+ * server.setMemoryBudget(&budget);
+ * @endcode
+ *
+ * A budget can be shared by multiple servers and their listener threads.
+ */
+class QWSENGINE_EXPORT MemoryBudget : public QObject {
+    Q_OBJECT
+
+ public:
+    enum Level {
+        /// Below the pause threshold
+        Normal,
+        /// Messages of the heaviest connections are rejected
+        Pausing,
+        /// New connections are refused
+        Rejecting,
+        /// The heaviest connections are closed
+        Closing
+    };
+    Q_ENUM(Level)
+
+    struct ConnectionUsage {
+        quint64 connectionId;
+        qint64  inboundBytes;
+        qint64  outboundBytes;
+        bool    paused;
+
+        qint64 totalBytes() const { return inboundBytes + outboundBytes; }
+    };
+
+    explicit MemoryBudget(qint64 maxBytes, QObject *parent = nullptr);
+    virtual ~MemoryBudget();
+
+    void   setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const;
+
+    /**
+     * @brief Set the thresholds as fraction of maxBytes(). Defaults: pause 0.8, reject 0.9, resume 0.7.
+     */
+    void   setPauseThreshold(double fraction);
+    double pauseThreshold() const;
+    void   setRejectThreshold(double fraction);
+    double rejectThreshold() const;
+    void   setResumeThreshold(double fraction);
+    double resumeThreshold() const;
+
+    /**
+     * @brief Set the interval of the periodic budget check in milliseconds. Defaults to 100 ms.
+     *
+     * Exceeding the budget triggers an immediate check.
+     */
+    void setCheckInterval(int ms);
+    int  checkInterval() const;
+
+    /**
+     * @brief Memory currently accounted for all connections in bytes. Thread-safe.
+     */
+    qint64 usedBytes() const;
+
+    Level level() const;
+
+    /**
+     * @brief Returns false while new connections are refused. Thread-safe.
+     */
+    bool isAcceptingConnections() const;
+
+    /**
+     * @brief The connections with the highest memory usage, heaviest first. Thread-safe.
+     */
+    QVector<ConnectionUsage> heaviestConnections(int count = 10) const;
+
+ Q_SIGNALS:  // NOLINT
+    void levelChanged(QWsEngine::MemoryBudget::Level level);
+
+ private:
+    MemoryBudgetPrivate *const d;
+    friend class MemoryBudgetPrivate;
+};
+
+}  // namespace QWsEngine
@@ -24,6 +24,11 @@
 
 #include <qwsengine/handler.h>
 
+#include <QFuture>
+#include <QThreadPool>
+
+#include <functional>
+
 #include "qwsengine_export.h"
 
 namespace QWsEngine {
@@ -70,16 +75,95 @@ class QObjectHandlerPrivate;
  *     connection->close();
  * });
  * @endcode
+ *
+ * Slots are invoked on the thread owning the connection by default. Long running slots can be moved to a thread pool
+ * with setExecutionPolicy(). Messages of the same connection are still processed in order.
+ *
+ * Handlers waiting for I/O can return a future instead of blocking the loop, see registerAsyncMessage().
+ *
+ * Messages can be registered and unregistered at runtime from any thread. The registrations are published as an
+ * immutable snapshot, the dispatching never waits for a registration.
  */
 class QWSENGINE_EXPORT QObjectHandler : public Handler {
     Q_OBJECT
 
  public:
+    /**
+     * @brief Defines where a registered slot is invoked
+     */
+    enum ExecutionPolicy {
+        /// The slot is invoked on the thread owning the connection.
+        DirectExecution,
+        /// The slot is invoked on a thread pool. Messages of the same connection are executed serially.
+        ThreadPoolExecution
+    };
+    Q_ENUM(ExecutionPolicy)
+
     /**
      * @brief Create a new QObject handler
      */
     explicit QObjectHandler(QObject *parent = 0);
 
+    /**
+     * @brief Set the execution policy of a registered message.
+     *
+     * With ThreadPoolExecution the slot is invoked on a pool thread and must therefore be thread-safe. Replies sent
+     * with Connection::sendTextMessage() or Connection::sendBinaryMessage() are automatically queued to the thread
+     * owning the connection. The connection reference passed to the slot is released on the owning thread.
+     * Must be called after registerMessage(). Defaults to DirectExecution.
+     *
+     * The receiver is not tracked on the pool threads: it must outlive the handler and the messages still queued for
+     * it, e.g. wait with QThreadPool::waitForDone() before deleting it. Messages of the same connection are executed
+     * in order per thread pool.
+     */
+    void            setExecutionPolicy(const QString &name, ExecutionPolicy policy);
+    ExecutionPolicy executionPolicy(const QString &name) const;
+
+    /**
+     * @brief Set the thread pool for messages with ThreadPoolExecution policy.
+     *
+     * Defaults to QThreadPool::globalInstance(). The thread pool is not owned by the handler.
+     */
+    void         setThreadPool(QThreadPool *pool);
+    QThreadPool *threadPool() const;
+
+    /**
+     * @brief Set the maximum number of queued and running thread pool messages per connection and thread pool.
+     *
+     * If the limit is reached, further messages are rejected with error code 429. A value of 0 disables the limit.
+     * Defaults to 16.
+     */
+    void setMaxInFlightMessages(int max);
+    int  maxInFlightMessages() const;
+
+    /**
+     * @brief Set the request id field which is copied into the replies of asynchronous messages. Defaults to `req_id`.
+     */
+    void    setReqIdFieldName(const QString &fieldName);
+    QString reqIdFieldName() const;
+
+    /**
+     * @brief Asynchronous message function returning the JSON encoded `msg_data` of the reply.
+     */
+    typedef std::function<QFuture<QByteArray>(const QSharedPointer<Connection> &connection, const QVariant &message)>
+        AsyncFunction;
+
+    /**
+     * @brief Register an asynchronous method
+     *
+     * The function is invoked on the thread owning the connection and must return quickly, e.g. with the future of
+     * QtConcurrent::run() or of a network request. When the future finishes, the reply is sent on the owning thread:
+     * `{"type": "result", "req_id": 1, "success": true, "msg_data": ...}` with the result of the future as msg_data.
+     * A canceled future or a future without result is answered with
+     * `{"type": "result", "req_id": 1, "success": false, "error": {"code": 500, "message": "..."}}`.
+     *
+     * The `req_id` field is only included if the request contains a numeric request id. The number of pending replies
+     * per connection is bounded by setMaxInFlightMessages(), further requests are answered with error code 429.
+     * Pending futures are canceled when the connection is destroyed. The asynchronous work must therefore not keep a
+     * reference to the connection, the handler takes care of the reply.
+     */
+    void registerAsyncMessage(const QString &name, const AsyncFunction &function);
+
     /**
      * @brief Register a method
      *
@@ -87,6 +171,14 @@ class QWSENGINE_EXPORT QObjectHandler : public Handler {
      */
     void registerMessage(const QString &name, QObject *receiver, const char *method);
 
+    /**
+     * @brief Unregister a method. Thread-safe.
+     *
+     * Messages already being dispatched to the method are still processed. The slot object of a functor is destroyed
+     * after they finished.
+     */
+    void unregisterMessage(const QString &name);
+
 #ifdef DOXYGEN
     /**
      * @brief Register a method
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/middleware.h>
+
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QStringList>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class Connection;
+class SchemaValidationMiddlewarePrivate;
+
+/**
+ * @brief %Middleware validating JSON messages against a JSON schema per message name.
+ *
+ * The schemas, e.g. the message payload schemas of an AsyncAPI document, are compiled once when added. Invalid
+ * messages are rejected with a 400 error response before they reach the handler:
+ * `{"type": "result", "success": false, "req_id": 1, "error": {"code": 400, "message": "...", "path": "/msg_data/id",
+ * "keyword": "type"}}`
+ *
+ * The `req_id` field is only included if the request contains a numeric request id. `path` is the JSON pointer to
+ * the invalid value and `keyword` the failed schema keyword.
+ *
+ * All schemas should be added before the server starts processing messages.
+ */
+class QWSENGINE_EXPORT SchemaValidationMiddleware : public Middleware {
+    Q_OBJECT
+
+ public:
+    explicit SchemaValidationMiddleware(QObject *parent = nullptr);
+    virtual ~SchemaValidationMiddleware();
+
+    /**
+     * @brief Name of the middleware for logging purposes
+     */
+    QString name() const override;
+
+    /**
+     * @brief Compile and add the schema for messages with the given name, replacing an existing schema.
+     *
+     * Returns false if the schema is invalid or uses an unsupported keyword, the reason is returned in errorString.
+     */
+    bool addSchema(const QString &msgName, const QJsonObject &schema, QString *errorString = nullptr);
+
+    /**
+     * @brief Add the schemas of all `*.json` files in the directory. The file name without extension is the message
+     * name.
+     */
+    bool loadSchemas(const QString &directory, QString *errorString = nullptr);
+
+    void        removeSchema(const QString &msgName);
+    bool        hasSchema(const QString &msgName) const;
+    QStringList msgNames() const;
+
+    /**
+     * @brief Sets if messages without a schema are rejected. Defaults to false: they are passed on.
+     */
+    void setRejectUnknownMessages(bool reject);
+    bool isRejectUnknownMessages() const;
+
+    /**
+     * @brief Set the request id field name which is copied into the error response. Defaults to `req_id`.
+     */
+    void    setReqIdFieldName(const QString &fieldName);
+    QString reqIdFieldName() const;
+
+    bool process(QSharedPointer<Connection> connection, const QString &msgName, const QVariant &message) override;
+
+ private:
+    SchemaValidationMiddlewarePrivate *const d;
+    friend class SchemaValidationMiddlewarePrivate;
+};
+
+}  // namespace QWsEngine
@@ -3,14 +3,21 @@
 
 #pragma once
 
+#include <QHostAddress>
 #include <QtWebSockets/QWebSocketServer>
 
 #include "qwsengine_export.h"
 
+class QTcpServer;
+
 namespace QWsEngine {
 
+class Cluster;
+class MemoryBudget;
 class ConnectionHandler;
 class ServerPrivate;
+class StallWatchdog;
+class TrafficCapture;
 
 /**
  * @brief WebSocket server extending Qt's QWebSocketServer for convenient JSON payload handling in text messages.
@@ -23,6 +30,21 @@ class QWSENGINE_EXPORT Server : public QWebSocketServer {
     Q_OBJECT
 
  public:
+    /**
+     * @brief Accepted PROXY protocol versions.
+     */
+    enum ProxyProtocolVersion {
+        /// No PROXY protocol header is expected.
+        NoProxyProtocol = 0x0,
+        /// Text header of PROXY protocol version 1.
+        ProxyProtocolV1 = 0x1,
+        /// Binary header of PROXY protocol version 2.
+        ProxyProtocolV2 = 0x2,
+        /// Either version 1 or 2.
+        ProxyProtocolV1V2 = ProxyProtocolV1 | ProxyProtocolV2
+    };
+    Q_ENUM(ProxyProtocolVersion)
+
     /**
      * @brief Constructs a new WebSocket server.
      *
@@ -53,6 +75,128 @@ class QWSENGINE_EXPORT Server : public QWebSocketServer {
      */
     void setMaxAllowedIncomingMessageSize(quint64 maxAllowedIncomingMessageSize);
 
+    /**
+     * @brief Record the inbound traffic of new connections with the given capture, or nullptr to disable.
+     *
+     * The capture is not owned by the server and must outlive it. Must be set before listenReusePort().
+     */
+    void            setTrafficCapture(TrafficCapture *capture);
+    TrafficCapture *trafficCapture() const;
+
+    /**
+     * @brief Register the connections of this server in the given cluster, or nullptr to disable.
+     *
+     * The cluster is not owned by the server and must outlive it. Must be set before listenReusePort().
+     */
+    void     setCluster(Cluster *cluster);
+    Cluster *cluster() const;
+
+    /**
+     * @brief Watch the event loop of this server and of the listeners created by listenReusePort() for stalls.
+     *
+     * The watchdog is not owned by the server and must outlive it. Must be set before listenReusePort().
+     */
+    void           setStallWatchdog(StallWatchdog *watchdog);
+    StallWatchdog *stallWatchdog() const;
+
+    /**
+     * @brief Account the memory of new connections in the given budget, or nullptr to disable.
+     *
+     * New connections are refused while the budget is above its reject threshold. The budget is not owned by the
+     * server and must outlive it. Must be set before listenReusePort().
+     */
+    void          setMemoryBudget(MemoryBudget *budget);
+    MemoryBudget *memoryBudget() const;
+
+    /**
+     * @brief Expect a PROXY protocol header on accepted sockets, e.g. behind a TLS-terminating HAProxy or stunnel.
+     *
+     * The header is parsed before the WebSocket handshake. Sockets without a valid header, or without a complete
+     * header within 5 seconds, are closed. The client address of the header is available with
+     * Connection::clientAddress() and Connection::clientPort(), and for connection middleware as the `clientAddress`
+     * and `clientPort` properties of the QWebSocket.
+     *
+     * Requires Qt 5.9. Must be set before listening. The server must then be started with listenProxyProtocol() or
+     * listenReusePort() instead of QWebSocketServer::listen(). Defaults to NoProxyProtocol.
+     */
+    void                 setProxyProtocol(ProxyProtocolVersion versions);
+    ProxyProtocolVersion proxyProtocol() const;
+
+    /**
+     * @brief Set the maximum accepted size of a PROXY protocol header in bytes. Defaults to 1024.
+     *
+     * Limits the TLVs of a version 2 header, sockets with a larger header are closed. The value is bounded to the 107
+     * bytes of a version 1 header and the protocol maximum of 65551 bytes. Must be set before listening.
+     */
+    void setProxyProtocolMaxHeaderSize(int bytes);
+    int  proxyProtocolMaxHeaderSize() const;
+
+    /**
+     * @brief Listen for incoming connections with the PROXY protocol handling enabled with setProxyProtocol().
+     *
+     * The PROXY protocol header is parsed by a separate TCP server, see proxyListener(), which hands the sockets over
+     * to this server. QWebSocketServer::listen() must not be used then, since it accepts sockets without parsing the
+     * header. Calls QWebSocketServer::listen() if no PROXY protocol is enabled.
+     */
+    bool listenProxyProtocol(const QHostAddress &address = QHostAddress::Any, quint16 port = 0);
+
+    /**
+     * @brief Returns the TCP server accepting sockets with a PROXY protocol header, or nullptr if not used.
+     *
+     * QWebSocketServer::isListening(), serverPort() and close() only refer to the WebSocket server itself: with a PROXY
+     * protocol enabled, use the methods of this listener instead.
+     */
+    QTcpServer *proxyListener() const;
+
+    /**
+     * @brief Listen with multiple listener threads bound to the same port with SO_REUSEPORT.
+     *
+     * The server itself accepts connections on the calling thread, count - 1 additional listeners are created, each
+     * in its own thread with its own accept and handshake loop. The kernel distributes new connections across the
+     * listeners. All listeners share the connection handler tree, which therefore must not be modified after this
+     * call. Connections are owned and processed by the thread of the listener which accepted them.
+     *
+     * Falls back to a single listener if SO_REUSEPORT is not supported on the platform. Returns false if the socket
+     * can't be bound, e.g. if the port is already in use. An additional listener failing to listen is dropped, see
+     * listenerCount().
+     * Must be called after setHandler() and the other server settings, since they are copied to the listeners.
+     */
+    bool listenReusePort(const QHostAddress &address, quint16 port, int count);
+
+    /**
+     * @brief Returns the number of listeners accepting connections, including this server.
+     */
+    int listenerCount() const;
+
+    /**
+     * @brief Gracefully drain all client connections, e.g. for a shutdown or redeploy.
+     *
+     * The server stops listening for new connections and closes the established connections in batches of batchSize
+     * every intervalMs milliseconds. Connections with messages still being processed on a thread pool are closed
+     * after their processing finished. After deadlineMs all remaining connections are closed immediately.
+     *
+     * The close reason contains a reconnect hint with a random delay between 0 and reconnectJitterMs, in the form
+     * `retry-after-ms=<delay>`, to spread the reconnects of the clients.
+     * The drained() signal is emitted as soon as all connections of all listeners are closed.
+     */
+    void drain(int batchSize = 100, int intervalMs = 100, int deadlineMs = 30000, int reconnectJitterMs = 5000);
+
+    /**
+     * @brief Returns true if the server is draining its connections.
+     */
+    bool isDraining() const;
+
+    /**
+     * @brief Returns the number of established client connections of all listeners.
+     */
+    int connectionCount() const;
+
+ Q_SIGNALS:  // NOLINT
+    /**
+     * @brief Emitted after all connections have been closed by drain().
+     */
+    void drained();
+
  private:
     ServerPrivate *const d;
     friend class ServerPrivate;
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class Connection;
+class SessionManagerPrivate;
+
+/**
+ * @brief Resumable sessions with replay of missed messages after a reconnect.
+ *
+ * A session is created as soon as a connection of a connection handler with a session manager is authenticated, see
+ * ConnectionHandler::setSessionManager(). The client receives the resume token in a session message:
+ * `{"type": "session", "resume_token": "<token>"}`
+ *
+ * Every following outbound message gets a sequence number, starting with 1, and the most recent messages are kept in
+ * a bounded replay buffer. Session messages themselves are not counted, the client therefore only needs to count the
+ * other received messages.
+ *
+ * After a disconnect the session is kept for the grace period. A client reconnecting within the grace period with the
+ * `resume_token` and `last_seq` (number of the last received message) query parameters skips the authentication. It
+ * receives `{"type": "session_resumed", "resume_token": "<token>", "replayed": <count>}` followed by the missed
+ * messages. The resume token is replaced on every resume, the client must use the new token of the session_resumed
+ * message for the next reconnect. If the session expired or the missed messages aren't available anymore, the
+ * connection is processed as a new connection.
+ *
+ * The session manager may be shared by multiple connection handlers and SO_REUSEPORT listeners.
+ */
+class QWSENGINE_EXPORT SessionManager : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit SessionManager(QObject *parent = nullptr);
+    virtual ~SessionManager();
+
+    /**
+     * @brief Set how long a session is kept after a disconnect, in milliseconds. Defaults to 30 seconds.
+     */
+    void setGracePeriod(int ms);
+    int  gracePeriod() const;
+
+    /**
+     * @brief Set the number of recent outbound messages kept per session for a replay. Defaults to 128.
+     *
+     * Only affects sessions created after this call.
+     */
+    void setReplayBufferSize(int messages);
+    int  replayBufferSize() const;
+
+    /**
+     * @brief Returns the number of attached and detached sessions.
+     */
+    int sessionCount() const;
+
+ Q_SIGNALS:  // NOLINT
+    /**
+     * @brief Emitted on the thread of the new connection after it resumed a session.
+     *
+     * Connection specific state, e.g. subscriptions, can be transferred to the new connection. The session is
+     * identified by the new token from now on, previousToken is no longer valid.
+     */
+    void sessionResumed(QSharedPointer<QWsEngine::Connection> connection, const QString &token,
+                        const QString &previousToken);
+
+    /**
+     * @brief Emitted after a detached session expired.
+     */
+    void sessionExpired(const QString &token);
+
+ private:
+    SessionManagerPrivate *const d;
+    friend class SessionManagerPrivate;
+};
+
+}  // namespace QWsEngine
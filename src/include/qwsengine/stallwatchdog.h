@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include "qwsengine_export.h"
+
+class QThread;
+
+namespace QWsEngine {
+
+class StallWatchdogPrivate;
+
+/**
+ * @brief Detects blocked event loops and blames the message being processed.
+ *
+ * A heartbeat timer runs in every watched thread. A separate monitor thread reports a stall when a heartbeat is
+ * overdue by more than the threshold, together with the message name, handler and connection id which
+ * Handler::route() is currently processing in that thread. While the watchdog is running, the processing time of every
+ * routed message is accumulated per message name, which shows the handlers hurting the tail latency even if they stay
+ * below the stall threshold.
+ *
+ * @code
+ * QWsEngine::StallWatchdog watchdog;
+ * watchdog.setThreshold(100);
+ * server.setStallWatchdog(&watchdog);  // watches the server and its listener threads
+ * watchdog.start();
+ * ...
+ * for (const auto &stats : watchdog.messageStats()) {
+ *     qDebug() << stats.msgName << stats.count << stats.maxNs << stats.stalls;
+ * }
+ * @endcode
+ *
+ * The message statistics are process wide, only one watchdog can be running at a time.
+ */
+class QWSENGINE_EXPORT StallWatchdog : public QObject {
+    Q_OBJECT
+
+ public:
+    struct Stall {
+        /// Start of the stall in milliseconds since the epoch
+        qint64 timestamp;
+        /// Duration in milliseconds. While the stall is ongoing, the duration at detection time.
+        qint64 durationMs;
+        bool   ongoing;
+        /// Object name of the blocked thread
+        QString thread;
+        /// Message being processed, empty if the loop was blocked outside of message routing
+        QString msgName;
+        /// Class name of the handler or slot receiver processing the message
+        QString handler;
+        quint64 connectionId;
+    };
+
+    struct MessageStats {
+        QString msgName;
+        quint64 count;
+        /// Accumulated processing time in Handler::route()
+        quint64 totalNs;
+        quint64 maxNs;
+        /// Number of stalls blamed on this message
+        quint64 stalls;
+
+        double averageNs() const { return count ? static_cast<double>(totalNs) / count : 0.0; }
+    };
+
+    explicit StallWatchdog(QObject *parent = nullptr);
+    virtual ~StallWatchdog();
+
+    /**
+     * @brief Set the heartbeat delay in milliseconds reported as stall. Defaults to 100 ms.
+     *
+     * Must be set before start().
+     */
+    void setThreshold(int ms);
+    int  threshold() const;
+
+    /**
+     * @brief Watch the event loop of a thread. Thread-safe.
+     *
+     * The thread is unwatched automatically when it finishes.
+     */
+    void watch(QThread *thread);
+    void unwatch(QThread *thread);
+
+    /**
+     * @brief Start the monitor thread and the message statistics. Fails if another watchdog is running.
+     */
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    /**
+     * @brief The most recent stalls, oldest first. Thread-safe.
+     */
+    QVector<Stall> stalls() const;
+
+    /**
+     * @brief Processing time per message name, sorted by the accumulated time. Thread-safe.
+     *
+     * Message names are supplied by the clients: at most 1000 names are tracked, the messages of further names are
+     * accumulated as `<other>`.
+     */
+    QVector<MessageStats> messageStats() const;
+
+    /**
+     * @brief Discard the recorded stalls and message statistics. Thread-safe.
+     */
+    void resetStatistics();
+
+ Q_SIGNALS:  // NOLINT
+    /**
+     * @brief Emitted from the monitor thread when a stall is detected.
+     */
+    void stallDetected(const QWsEngine::StallWatchdog::Stall &stall);
+
+ private:
+    StallWatchdogPrivate *const d;
+    friend class StallWatchdogPrivate;
+};
+
+}  // namespace QWsEngine
+
+Q_DECLARE_METATYPE(QWsEngine::StallWatchdog::Stall)
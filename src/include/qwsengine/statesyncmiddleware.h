@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/middleware.h>
+
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class Connection;
+class StateSyncMiddlewarePrivate;
+
+/**
+ * @brief %Middleware sending repeated state documents as JSON merge patches (RFC 7386).
+ *
+ * publish() keeps the last document acknowledged by the client per connection and key. An update is sent as merge
+ * patch against that document if the patch is smaller than the document, otherwise in full:
+ *
+ * - full: `{"type": "state", "key": "entities", "seq": 7, "msg_data": {...}}`
+ * - patch: `{"type": "state_patch", "key": "entities", "seq": 8, "base_seq": 7, "msg_data": {...}}`
+ *
+ * The client keeps the documents it received until it has seen a later `base_seq`, applies a patch to the document
+ * of `base_seq` and acknowledges applied updates with `{"type": "state_ack", "key": "entities", "seq": 8}`. If the
+ * document of `base_seq` is missing, the client requests the full document with
+ * `{"type": "state_resync", "key": "entities"}`. Both client messages are consumed by the middleware.
+ *
+ * Updates are sent with Connection::sendConflated(): a slow client only receives the latest update of each key, which
+ * is always applicable since every patch refers to an acknowledged document.
+ *
+ * Arrays are replaced as a whole by a merge patch, documents like entity lists should therefore be objects keyed by
+ * id. Documents with null values are always sent in full, since null removes a member in a merge patch.
+ */
+class QWSENGINE_EXPORT StateSyncMiddleware : public Middleware {
+    Q_OBJECT
+
+ public:
+    explicit StateSyncMiddleware(QObject *parent = nullptr);
+    virtual ~StateSyncMiddleware();
+
+    /**
+     * @brief Name of the middleware for logging purposes
+     */
+    QString name() const override;
+
+    /**
+     * @brief Send a state document to the client, as merge patch if smaller. Thread-safe.
+     *
+     * Returns the sequence number of the update.
+     */
+    quint64 publish(const QSharedPointer<Connection> &connection, const QString &key, const QJsonObject &state);
+
+    /**
+     * @brief Set the number of sent documents per key kept until they are acknowledged. Defaults to 16.
+     *
+     * An acknowledgement of an older document is ignored.
+     */
+    void setMaxPendingAcks(int max);
+    int  maxPendingAcks() const;
+
+    bool process(QSharedPointer<Connection> connection, const QString &msgName, const QVariant &message) override;
+
+ private:
+    StateSyncMiddlewarePrivate *const d;
+    friend class StateSyncMiddlewarePrivate;
+};
+
+}  // namespace QWsEngine
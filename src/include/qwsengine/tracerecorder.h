@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QIODevice>
+#include <QtGlobal>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+/**
+ * @brief Low-overhead binary trace recorder for the connection and message pipeline.
+ *
+ * When enabled, fixed-size binary events with a nanosecond timestamp and the connection id are recorded in a
+ * lock-free ring buffer per thread. Older events are overwritten when a buffer is full. The buffers can be written to
+ * a compact binary file or converted to the Chrome trace event JSON format, which can be loaded in Perfetto or
+ * chrome://tracing.
+ *
+ * The recorder is disabled by default. A disabled recorder costs a single relaxed atomic load per trace point.
+ *
+ * @code
+ * QWsEngine::TraceRecorder::setSampleRate(10);  // trace every 10th message
+ * QWsEngine::TraceRecorder::setEnabled(true);
+ * ...
+ * QFile file("trace.json");
+ * file.open(QIODevice::WriteOnly);
+ * QWsEngine::TraceRecorder::writeChromeTrace(&file);
+ * @endcode
+ */
+class QWSENGINE_EXPORT TraceRecorder {
+ public:
+    enum EventType : quint8 {
+        /// Connection accepted by the connection handler tree. Argument: 0
+        Accept,
+        /// WebSocket handshake completed. Argument: 0
+        Handshake,
+        /// Start of message parsing. Argument: message size
+        ParseStart,
+        /// End of message parsing. Argument: 1 if successful, 0 otherwise
+        ParseEnd,
+        /// Middleware processed a message. Argument: 1 if processing continues, 0 otherwise
+        MiddlewareVerdict,
+        /// Message dispatched to a slot. Argument: hash of the message name
+        Dispatch,
+        /// Message sent to the client. Argument: message size
+        Send,
+        /// Connection closed. Argument: close code
+        Close
+    };
+
+    /**
+     * @brief Enable or disable recording. Thread-safe.
+     */
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    /**
+     * @brief Record only every n-th inbound message and its events. Thread-safe.
+     *
+     * Connection events are always recorded. Defaults to 1, recording all messages.
+     */
+    static void setSampleRate(int n);
+    static int  sampleRate();
+
+    /**
+     * @brief Set the number of events per thread buffer, rounded up to a power of two.
+     *
+     * Only affects buffers of threads which haven't recorded an event yet. Defaults to 65536 events (2 MB).
+     */
+    static void setBufferSize(int events);
+
+    /**
+     * @brief Discard all recorded events.
+     *
+     * Must not be called while events are being recorded.
+     */
+    static void clear();
+
+    /**
+     * @brief Write the recorded events of all threads in binary format.
+     *
+     * The binary format can be converted with convertToChromeTrace(), for example with the qwsengine-tracedump tool.
+     */
+    static bool writeBinary(QIODevice *device);
+
+    /**
+     * @brief Write the recorded events of all threads in Chrome trace event JSON format.
+     */
+    static bool writeChromeTrace(QIODevice *device);
+
+    /**
+     * @brief Convert a binary trace written with writeBinary() into Chrome trace event JSON format.
+     */
+    static bool convertToChromeTrace(QIODevice *binary, QIODevice *json);
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QNetworkRequest>
+#include <QObject>
+#include <QString>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class TrafficCapturePrivate;
+
+/**
+ * @brief Records inbound WebSocket traffic for a deterministic replay with TrafficReplay.
+ *
+ * Connection setups (id, path, request headers, authentication state), inbound text and binary messages and
+ * disconnects are appended with a nanosecond timestamp to memory-mapped log segments in the capture directory. A
+ * segment file is preallocated with the configured segment size and truncated to the used size when it is full or the
+ * capture is stopped. Segments are named `capture-<sequence>.qwscap`.
+ *
+ * The capture is opt-in and attached to a server with Server::setTrafficCapture(). Recording is thread-safe, the
+ * listeners of Server::listenReusePort() share the capture.
+ *
+ * Credential headers are redacted by default, see setRedactedHeaders(). Message payloads are captured verbatim,
+ * including authentication messages and any personal data they contain. Restrict access to the capture directory
+ * accordingly.
+ *
+ * @code
+ * QWsEngine::TrafficCapture capture("/tmp/capture");
+ * capture.start();
+ * server.setTrafficCapture(&capture);
+ * @endcode
+ */
+class QWSENGINE_EXPORT TrafficCapture : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit TrafficCapture(const QString &directory, QObject *parent = nullptr);
+    virtual ~TrafficCapture();
+
+    /**
+     * @brief Set the size of a log segment in bytes. Defaults to 64 MB.
+     *
+     * Only affects segments created after this call.
+     */
+    void   setSegmentSize(qint64 bytes);
+    qint64 segmentSize() const;
+
+    /**
+     * @brief Set the request headers whose values are replaced with an empty value. Names are case-insensitive.
+     *
+     * Defaults to Authorization, Proxy-Authorization and Cookie. Add custom token headers, e.g. the header of a
+     * HeaderAuthConnectionHandler. An empty list captures all header values, e.g. to replay header authentication.
+     */
+    void              setRedactedHeaders(const QList<QByteArray> &names);
+    QList<QByteArray> redactedHeaders() const;
+
+    /**
+     * @brief Start a new capture. Existing segment files in the capture directory are removed.
+     */
+    bool start();
+
+    /**
+     * @brief Stop the capture and finalize the current segment.
+     */
+    void stop();
+
+    bool isActive() const;
+
+    /**
+     * @brief Returns the number of recorded events, or the number of events dropped because they exceed a segment.
+     */
+    quint64 recordedCount() const;
+    quint64 droppedCount() const;
+
+    void recordConnection(quint64 connectionId, const QString &path, const QNetworkRequest &request,
+                          bool authenticated);
+    void recordTextMessage(quint64 connectionId, const QString &message);
+    void recordBinaryMessage(quint64 connectionId, const QByteArray &message);
+    void recordClose(quint64 connectionId);
+
+ private:
+    TrafficCapturePrivate *const d;
+    friend class TrafficCapturePrivate;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QNetworkRequest>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class Connection;
+class ConnectionHandler;
+class Handler;
+class TrafficReplayPrivate;
+
+/**
+ * @brief Replays a capture recorded with TrafficCapture in-process through a handler tree.
+ *
+ * Every captured connection is recreated with an unconnected QWebSocket and routed through the connection handler
+ * tree with its original path, the captured messages are then processed by the resulting connection. Responses are
+ * discarded by the unconnected socket, so the replay measures the server side processing only.
+ *
+ * A recreated connection gets the captured authentication state, also if the connection handler created it
+ * unauthenticated. The captured request headers can't be attached to a QWebSocket, therefore connection handlers
+ * relying on headers, e.g. HeaderAuthConnectionHandler, reject replayed connections. Use setMessageHandler() to bypass
+ * the connection handler tree for such captures: connections are then created directly with the message handler. The
+ * captured headers are provided with connectionReplayed(), e.g. to restore connection properties an application
+ * derives from them. Credential headers are redacted unless the capture was configured to keep them, see
+ * TrafficCapture::setRedactedHeaders().
+ *
+ * @code
+ * QWsEngine::TrafficReplay replay(&connectionHandler);
+ * replay.load("/tmp/capture");
+ * replay.start(QWsEngine::TrafficReplay::AsFastAsPossible);
+ * @endcode
+ */
+class QWSENGINE_EXPORT TrafficReplay : public QObject {
+    Q_OBJECT
+
+ public:
+    enum Timing {
+        /// Replay the events with their captured inter-arrival times.
+        OriginalTiming,
+        /// Replay all events back to back.
+        AsFastAsPossible
+    };
+    Q_ENUM(Timing)
+
+    explicit TrafficReplay(ConnectionHandler *handler, QObject *parent = nullptr);
+    virtual ~TrafficReplay();
+
+    /**
+     * @brief Create replayed connections directly with the given message handler instead of routing them.
+     */
+    void setMessageHandler(Handler *handler);
+
+    /**
+     * @brief Load all segments of a capture directory. Returns false if no valid segment was found.
+     */
+    bool load(const QString &directory);
+
+    /**
+     * @brief Start the replay. Returns immediately, finished() is emitted when all events have been replayed.
+     */
+    void start(Timing timing = AsFastAsPossible);
+
+    bool isRunning() const;
+
+    /**
+     * @brief Returns the number of loaded events.
+     */
+    int eventCount() const;
+
+    /**
+     * @brief Returns the number of replayed messages and connections, and the connections rejected by the handler.
+     */
+    int replayedMessages() const;
+    int replayedConnections() const;
+    int rejectedConnections() const;
+
+    /**
+     * @brief Returns the wall clock duration of the replay in nanoseconds.
+     */
+    qint64 elapsedNs() const;
+
+ Q_SIGNALS:  // NOLINT
+    /**
+     * @brief Emitted when a captured connection has been recreated, before its first message is replayed.
+     *
+     * The request contains the captured path and headers.
+     */
+    void connectionReplayed(const QSharedPointer<QWsEngine::Connection> &connection, const QNetworkRequest &request);
+
+    void finished();
+
+ private:
+    TrafficReplayPrivate *const d;
+    friend class TrafficReplayPrivate;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/handler.h>
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QSharedPointer>
+
+#include "qwsengine_export.h"
+
+namespace QWsEngine {
+
+class Connection;
+class JsonReader;
+
+/**
+ * @brief %Handler dispatching messages through a static table of typed parsers, e.g. generated from an AsyncAPI
+ * document with qwsengine-asyncapi-gen.
+ *
+ * The message name is read from the UTF-8 encoded message without building a QJsonDocument, the table is searched
+ * with a binary search, and the route's dispatcher parses the message straight into its message struct.
+ *
+ * Only messages of authenticated connections with a route in the table take the typed path. The middleware of this
+ * handler is run on the typed path as well: it receives the message as QJsonObject, which is only built if middleware
+ * is installed, the fast path therefore works best without middleware. All other messages, e.g. an authentication
+ * message, are routed by Handler::routeTextMessage() including middleware and sub-handlers.
+ */
+class QWSENGINE_EXPORT TypedHandler : public Handler {
+    Q_OBJECT
+
+ public:
+    /**
+     * @brief Parse the message and invoke the typed method. Returns false if the message is invalid.
+     */
+    typedef bool (*Dispatcher)(TypedHandler *handler, const QSharedPointer<Connection> &connection,
+                               JsonReader *reader);
+
+    struct Route {
+        const char *msgName;
+        Dispatcher  dispatch;
+    };
+
+    /**
+     * @brief Create a handler for the given route table.
+     *
+     * The table must be sorted by the UTF-8 encoded message name and outlive the handler, usually it's a static array.
+     */
+    TypedHandler(const Route *routes, int routeCount, QObject *parent = nullptr);
+    virtual ~TypedHandler();
+
+    /**
+     * @brief Set the top level field containing the message name. Defaults to `type`.
+     */
+    void       setMsgNameField(const QByteArray &fieldName);
+    QByteArray msgNameField() const;
+
+    void routeTextMessage(QSharedPointer<Connection> connection, const QString &message) override;
+
+    /**
+     * @brief Dispatch a UTF-8 encoded text message through the route table.
+     *
+     * Returns false if the message has no route or the connection isn't authenticated, the message has then not been
+     * processed. Invalid messages with a route are rejected with a 400 error response.
+     */
+    bool routeUtf8Message(const QSharedPointer<Connection> &connection, const QByteArray &utf8);
+
+ protected:
+    const Route *findRoute(QLatin1String msgName) const;
+
+ private:
+    const Route *const m_routes;
+    const int          m_routeCount;
+    QByteArray         m_msgNameField;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <QAtomicInteger>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+#include "bufferpool_p.h"
+
+namespace QWsEngine {
+
+namespace {
+
+const int kSizeClasses[] = {256, 1024, 4096, 16384, 65536};
+const int kSizeClassCount = sizeof(kSizeClasses) / sizeof(kSizeClasses[0]);
+
+struct PoolStatistics {
+    QAtomicInteger<quint64> hits;
+    QAtomicInteger<quint64> misses;
+    QAtomicInteger<qint64>  retained;
+};
+
+QMutex                  g_statisticsMutex;
+QList<PoolStatistics *> g_statistics;
+QAtomicInteger<qint64>  g_maxRetainedBytes(1024 * 1024);
+
+// counters of the pools of finished threads, guarded by g_statisticsMutex
+quint64 g_finishedHits = 0;
+quint64 g_finishedMisses = 0;
+
+class ThreadBufferPool {
+ public:
+    ThreadBufferPool() : statistics(new PoolStatistics) {
+        QMutexLocker locker(&g_statisticsMutex);
+        g_statistics.append(statistics);
+    }
+
+    ~ThreadBufferPool() {
+        QMutexLocker locker(&g_statisticsMutex);
+        g_finishedHits += statistics->hits.load();
+        g_finishedMisses += statistics->misses.load();
+        g_statistics.removeOne(statistics);
+        delete statistics;
+    }
+
+    PoolStatistics *const statistics;
+    QVector<QByteArray>   freeBuffers[kSizeClassCount];
+
+ private:
+    Q_DISABLE_COPY(ThreadBufferPool)
+};
+
+thread_local ThreadBufferPool t_pool;
+thread_local QString          t_textBuffer;
+
+}  // namespace
+
+QByteArray BufferPoolPrivate::acquire(int size) {
+    for (int i = 0; i < kSizeClassCount; i++) {
+        if (size > kSizeClasses[i]) {
+            continue;
+        }
+        QVector<QByteArray> &freeBuffers = t_pool.freeBuffers[i];
+        if (!freeBuffers.isEmpty()) {
+            QByteArray buffer = freeBuffers.takeLast();
+            t_pool.statistics->hits.fetchAndAddRelaxed(1);
+            t_pool.statistics->retained.fetchAndAddRelaxed(-buffer.capacity());
+            return buffer;
+        }
+        t_pool.statistics->misses.fetchAndAddRelaxed(1);
+        QByteArray buffer;
+        buffer.reserve(kSizeClasses[i]);
+        return buffer;
+    }
+
+    t_pool.statistics->misses.fetchAndAddRelaxed(1);
+    QByteArray buffer;
+    buffer.reserve(size);
+    return buffer;
+}
+
+void BufferPoolPrivate::release(QByteArray *buffer) {
+    if (!buffer->isDetached()) {
+        buffer->clear();
+        return;
+    }
+
+    int capacity = buffer->capacity();
+    for (int i = kSizeClassCount - 1; i >= 0; i--) {
+        if (capacity < kSizeClasses[i]) {
+            continue;
+        }
+        if (capacity > kSizeClasses[kSizeClassCount - 1] ||
+            t_pool.statistics->retained.load() + capacity > g_maxRetainedBytes.load()) {
+            break;
+        }
+        // keep the capacity when truncating, even for buffers not reserved by the pool
+        buffer->reserve(capacity);
+        buffer->resize(0);
+        t_pool.freeBuffers[i].append(*buffer);
+        t_pool.statistics->retained.fetchAndAddRelaxed(capacity);
+        buffer->clear();
+        return;
+    }
+
+    buffer->clear();
+}
+
+QString &BufferPoolPrivate::textBuffer() {
+    // a previous message might still be shared, e.g. when it was queued for another thread
+    if (!t_textBuffer.isDetached() || t_textBuffer.capacity() < 1024) {
+        t_textBuffer = QString();
+        t_textBuffer.reserve(1024);
+    }
+    t_textBuffer.resize(0);
+    return t_textBuffer;
+}
+
+int utf8Length(const QChar *unicode, int size) {
+    int length = 0;
+    for (int i = 0; i < size; i++) {
+        ushort c = unicode[i].unicode();
+        if (c < 0x80) {
+            length += 1;
+        } else if (c < 0x800) {
+            length += 2;
+        } else if (QChar::isHighSurrogate(c) && i + 1 < size && unicode[i + 1].isLowSurrogate()) {
+            length += 4;
+            i++;
+        } else {
+            length += 3;
+        }
+    }
+    return length;
+}
+
+void encodeUtf8(const QChar *unicode, int size, QByteArray *buffer) {
+    buffer->resize(utf8Length(unicode, size));
+    encodeUtf8(unicode, size, reinterpret_cast<uchar *>(buffer->data()));
+}
+
+void encodeUtf8(const QChar *unicode, int size, uchar *out) {
+    for (int i = 0; i < size; i++) {
+        uint c = unicode[i].unicode();
+        if (c < 0x80) {
+            *out++ = static_cast<uchar>(c);
+        } else if (c < 0x800) {
+            *out++ = static_cast<uchar>(0xc0 | (c >> 6));
+            *out++ = static_cast<uchar>(0x80 | (c & 0x3f));
+        } else if (QChar::isHighSurrogate(c) && i + 1 < size && unicode[i + 1].isLowSurrogate()) {
+            uint ucs4 = QChar::surrogateToUcs4(static_cast<ushort>(c), unicode[++i].unicode());
+            *out++ = static_cast<uchar>(0xf0 | (ucs4 >> 18));
+            *out++ = static_cast<uchar>(0x80 | ((ucs4 >> 12) & 0x3f));
+            *out++ = static_cast<uchar>(0x80 | ((ucs4 >> 6) & 0x3f));
+            *out++ = static_cast<uchar>(0x80 | (ucs4 & 0x3f));
+        } else {
+            if (QChar::isSurrogate(c)) {
+                c = QChar::ReplacementCharacter;
+            }
+            *out++ = static_cast<uchar>(0xe0 | (c >> 12));
+            *out++ = static_cast<uchar>(0x80 | ((c >> 6) & 0x3f));
+            *out++ = static_cast<uchar>(0x80 | (c & 0x3f));
+        }
+    }
+}
+
+BufferPool::Statistics BufferPool::statistics() {
+    QMutexLocker locker(&g_statisticsMutex);
+    Statistics   result = {g_finishedHits, g_finishedMisses, 0};
+    for (PoolStatistics *statistics : g_statistics) {
+        result.hits += statistics->hits.load();
+        result.misses += statistics->misses.load();
+        result.retainedBytes += statistics->retained.load();
+    }
+    return result;
+}
+
+void BufferPool::resetStatistics() {
+    QMutexLocker locker(&g_statisticsMutex);
+    g_finishedHits = 0;
+    g_finishedMisses = 0;
+    for (PoolStatistics *statistics : g_statistics) {
+        statistics->hits.store(0);
+        statistics->misses.store(0);
+    }
+}
+
+void BufferPool::setMaxRetainedBytes(qint64 bytes) {
+    g_maxRetainedBytes.store(qMax(Q_INT64_C(0), bytes));
+}
+
+qint64 BufferPool::maxRetainedBytes() {
+    return g_maxRetainedBytes.load();
+}
+
+}  // namespace QWsEngine
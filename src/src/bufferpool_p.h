@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/bufferpool.h>
+
+#include <QByteArray>
+#include <QChar>
+#include <QString>
+
+namespace QWsEngine {
+
+class BufferPoolPrivate {
+ public:
+    /**
+     * @brief Borrow an empty buffer with a capacity of at least size bytes from the pool of the current thread.
+     */
+    static QByteArray acquire(int size);
+
+    /**
+     * @brief Return a buffer to the pool of the current thread.
+     *
+     * Buffers still shared with other QByteArray instances, not originating from the pool or exceeding the retained
+     * memory bound are freed instead.
+     */
+    static void release(QByteArray *buffer);
+
+    /**
+     * @brief Reusable string of the current thread for rendering outbound text messages.
+     *
+     * The string is truncated but keeps its capacity. It must not be used across calls which could use it themselves.
+     */
+    static QString &textBuffer();
+};
+
+/**
+ * @brief Scoped buffer borrowed from the pool of the current thread.
+ */
+class PooledBuffer {
+ public:
+    explicit PooledBuffer(int size) : buffer(BufferPoolPrivate::acquire(size)) {}
+    ~PooledBuffer() { BufferPoolPrivate::release(&buffer); }
+
+    QByteArray buffer;
+
+ private:
+    Q_DISABLE_COPY(PooledBuffer)
+};
+
+/**
+ * @brief Number of bytes required to encode the UTF-16 string in UTF-8.
+ */
+int utf8Length(const QChar *unicode, int size);
+
+/**
+ * @brief Encode the UTF-16 string as UTF-8 into the buffer, replacing its content.
+ *
+ * Doesn't allocate if the buffer capacity is sufficient. Unpaired surrogates are replaced with U+FFFD.
+ */
+void encodeUtf8(const QChar *unicode, int size, QByteArray *buffer);
+
+/**
+ * @brief Encode the UTF-16 string as UTF-8 into raw memory of at least utf8Length() bytes.
+ */
+void encodeUtf8(const QChar *unicode, int size, uchar *out);
+
+}  // namespace QWsEngine
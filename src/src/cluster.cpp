@@ -0,0 +1,617 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/cluster.h>
+#include <qwsengine/connection.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+#include <QtEndian>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QRandomGenerator>
+#endif
+
+#include <cstring>
+
+#include "cluster_p.h"
+#include "connection_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+namespace {
+
+const int     kNodeIdShift = 40;
+const quint64 kLocalIdMask = (Q_UINT64_C(1) << kNodeIdShift) - 1;
+const quint32 kNodeIdMask = 0xffffff;
+
+QString lockFilePath(const QString &name) {
+    return QDir::isAbsolutePath(name) ? name + ".lock" : QDir::temp().filePath(name + ".lock");
+}
+
+QByteArray broadcastFrame(quint32 origin, bool binary, const QByteArray &message) {
+    QByteArray frame = ClusterPrivate::createFrame(ClusterFrame::Broadcast, ClusterFrame::BroadcastHeaderSize, message);
+    uchar *    header = reinterpret_cast<uchar *>(frame.data()) + ClusterFrame::HeaderSize;
+    qToLittleEndian<quint32>(origin, header);
+    header[4] = binary ? ClusterFrame::Binary : 0;
+    return frame;
+}
+
+QByteArray directFrame(quint64 target, bool binary, const QByteArray &message) {
+    QByteArray frame = ClusterPrivate::createFrame(ClusterFrame::Direct, ClusterFrame::DirectHeaderSize, message);
+    uchar *    header = reinterpret_cast<uchar *>(frame.data()) + ClusterFrame::HeaderSize;
+    qToLittleEndian<quint64>(target, header);
+    header[8] = binary ? ClusterFrame::Binary : 0;
+    return frame;
+}
+
+void sendMessage(Connection *connection, bool binary, const QByteArray &message) {
+    if (binary) {
+        connection->sendBinaryMessage(message);
+    } else {
+        connection->sendUtf8(message);
+    }
+}
+
+/**
+ * @brief Send the message with the thread-safe send path of the connection.
+ *
+ * The connection reference taken from the registry must be released on the owning thread, since it may be the last
+ * one.
+ */
+void deliver(QSharedPointer<Connection> &connection, bool binary, const QByteArray &message) {
+    sendMessage(connection.data(), binary, message);
+    if (connection->thread() != QThread::currentThread()) {
+        ConnectionPrivate::invokeOnOwnerThread(connection);
+    }
+}
+
+}  // namespace
+
+ClusterPrivate::ClusterPrivate(Cluster *cluster)
+    : QObject(cluster),
+      nodeId(static_cast<quint32>(QCoreApplication::applicationPid()) & kNodeIdMask),
+      maxWriteBufferSize(16 * 1024 * 1024),
+      running(false),
+      hub(false),
+      server(nullptr),
+      hubSocket(nullptr),
+      q(cluster) {
+    reconnectTimer.setSingleShot(true);
+    connect(&reconnectTimer, &QTimer::timeout, this, &ClusterPrivate::rejoin);
+    // connection count changes are reported in batches
+    countTimer.setSingleShot(true);
+    countTimer.setInterval(100);
+    connect(&countTimer, &QTimer::timeout, this, &ClusterPrivate::reportCount);
+}
+
+QByteArray ClusterPrivate::createFrame(ClusterFrame::Type type, int headerSize, const QByteArray &message) {
+    QByteArray frame(headerSize + message.size(), Qt::Uninitialized);
+    uchar *    data = reinterpret_cast<uchar *>(frame.data());
+    qToLittleEndian<quint32>(static_cast<quint32>(frame.size()), data);
+    data[4] = type;
+    if (!message.isEmpty()) {
+        memcpy(data + headerSize, message.constData(), static_cast<size_t>(message.size()));
+    }
+    return frame;
+}
+
+void ClusterPrivate::addConnection(const QSharedPointer<Connection> &connection) {
+    {
+        QMutexLocker locker(&mutex);
+        connections.insert(connection->id(), connection.toWeakRef());
+    }
+    QMetaObject::invokeMethod(this, "scheduleCountReport", Qt::QueuedConnection);
+}
+
+void ClusterPrivate::removeConnection(quint64 id) {
+    {
+        QMutexLocker locker(&mutex);
+        connections.remove(id);
+    }
+    QMetaObject::invokeMethod(this, "scheduleCountReport", Qt::QueuedConnection);
+}
+
+bool ClusterPrivate::becomeHub() {
+    if (!hubLock) {
+        hubLock.reset(new QLockFile(lockFilePath(name)));
+        // the lock of a crashed hub is detected by its process id
+        hubLock->setStaleLockTime(0);
+    }
+    if (!hubLock->tryLock(0)) {
+        return false;
+    }
+
+    // a crashed hub leaves its socket file behind
+    QLocalServer::removeServer(name);
+    server = new QLocalServer(this);
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(server, &QLocalServer::newConnection, this, &ClusterPrivate::onNodeConnected);
+    if (!server->listen(name)) {
+        qCWarning(wsEngine) << "Cluster" << name << "hub can't listen:" << server->errorString();
+        delete server;
+        server = nullptr;
+        hubLock->unlock();
+        return false;
+    }
+
+    hub = true;
+    joined.storeRelease(1);
+    {
+        QMutexLocker locker(&mutex);
+        counts.clear();
+        counts.insert(nodeId, connections.size());
+    }
+    qCDebug(wsEngine) << "Cluster" << name << ": node" << nodeId << "is the hub";
+    emit q->joined(true);
+    return true;
+}
+
+void ClusterPrivate::connectToHub() {
+    if (!hubSocket) {
+        hubSocket = new QLocalSocket(this);
+        connect(hubSocket, &QLocalSocket::connected, this, &ClusterPrivate::onHubConnected);
+        connect(hubSocket, &QLocalSocket::readyRead, this, &ClusterPrivate::onHubReadyRead);
+        // queued: a failed write may disconnect the socket while a frame is being processed
+        connect(hubSocket, &QLocalSocket::stateChanged, this, &ClusterPrivate::onHubStateChanged,
+                Qt::QueuedConnection);
+    }
+    hubBuffer.clear();
+    hubSocket->connectToServer(name);
+}
+
+void ClusterPrivate::readFrames(QLocalSocket *socket, QByteArray *buffer) {
+    buffer->append(socket->readAll());
+
+    int offset = 0;
+    while (buffer->size() - offset >= ClusterFrame::HeaderSize) {
+        quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(buffer->constData()) + offset);
+        if (size < static_cast<quint32>(ClusterFrame::HeaderSize) ||
+            size > static_cast<quint32>(ClusterFrame::MaxSize)) {
+            qCWarning(wsEngine) << "Cluster" << name << ": invalid frame size" << size << ", closing socket";
+            buffer->clear();
+            socket->abort();
+            return;
+        }
+        if (static_cast<quint32>(buffer->size() - offset) < size) {
+            break;
+        }
+        processFrame(socket, buffer->mid(offset, static_cast<int>(size)));
+        offset += static_cast<int>(size);
+    }
+    buffer->remove(0, offset);
+}
+
+void ClusterPrivate::sendFrame(const QByteArray &frame) {
+    processFrame(nullptr, frame);
+}
+
+void ClusterPrivate::post(const QByteArray &frame) {
+    if (QThread::currentThread() == thread()) {
+        sendFrame(frame);
+    } else {
+        QMetaObject::invokeMethod(this, "sendFrame", Qt::QueuedConnection, Q_ARG(QByteArray, frame));
+    }
+}
+
+bool ClusterPrivate::sendDirect(quint64 target, bool binary, const QByteArray &message) {
+    QByteArray frame = directFrame(target, binary, message);
+    if (Cluster::nodeOf(target) == nodeId) {
+        // local connections are looked up right away, the delivery is thread-safe
+        return deliverDirect(frame);
+    }
+    if (!joined.loadAcquire()) {
+        return false;
+    }
+    post(frame);
+    return true;
+}
+
+void ClusterPrivate::processFrame(QLocalSocket *from, const QByteArray &frame) {
+    const uchar *payload = reinterpret_cast<const uchar *>(frame.constData()) + ClusterFrame::HeaderSize;
+    const int    payloadSize = frame.size() - ClusterFrame::HeaderSize;
+    const bool   fromHub = from && from == hubSocket;
+    const bool   hubConnected = hubSocket && hubSocket->state() == QLocalSocket::ConnectedState;
+
+    switch (static_cast<quint8>(frame.at(4))) {
+        case ClusterFrame::Hello:
+            if (hub && from && payloadSize >= 4) {
+                nodes.insert(qFromLittleEndian<quint32>(payload), from);
+            }
+            break;
+        case ClusterFrame::Count:
+            if (hub && payloadSize >= 8) {
+                {
+                    QMutexLocker locker(&mutex);
+                    counts.insert(qFromLittleEndian<quint32>(payload),
+                                  static_cast<int>(qFromLittleEndian<quint32>(payload + 4)));
+                }
+                publishCounts();
+            }
+            break;
+        case ClusterFrame::CountTable: {
+            if (!fromHub || payloadSize < 4) {
+                break;
+            }
+            int entries = qMin(static_cast<int>(qFromLittleEndian<quint32>(payload)), (payloadSize - 4) / 8);
+            QHash<quint32, int> table;
+            for (int i = 0; i < entries; i++) {
+                const uchar *entry = payload + 4 + i * 8;
+                table.insert(qFromLittleEndian<quint32>(entry),
+                             static_cast<int>(qFromLittleEndian<quint32>(entry + 4)));
+            }
+            int total = 0;
+            {
+                QMutexLocker locker(&mutex);
+                // the own count is always up to date
+                table.insert(nodeId, connections.size());
+                counts = table;
+                for (int count : counts) {
+                    total += count;
+                }
+            }
+            emit q->connectionCountChanged(total);
+            break;
+        }
+        case ClusterFrame::Broadcast:
+            if (payloadSize < ClusterFrame::BroadcastHeaderSize - ClusterFrame::HeaderSize) {
+                break;
+            }
+            deliverBroadcast(frame);
+            if (hub) {
+                writeToNodes(frame, from);
+            } else if (!from && hubConnected) {
+                writeFrame(hubSocket, frame);
+            }
+            break;
+        case ClusterFrame::Direct: {
+            if (payloadSize < ClusterFrame::DirectHeaderSize - ClusterFrame::HeaderSize) {
+                break;
+            }
+            quint32 target = Cluster::nodeOf(qFromLittleEndian<quint64>(payload));
+            if (target == nodeId) {
+                deliverDirect(frame);
+            } else if (hub) {
+                QLocalSocket *node = nodes.value(target);
+                if (node) {
+                    writeFrame(node, frame);
+                } else {
+                    qCDebug(wsEngine) << "Cluster" << name << ": unknown node" << target << "for direct message";
+                }
+            } else if (!from && hubConnected) {
+                writeFrame(hubSocket, frame);
+            }
+            break;
+        }
+        default:
+            qCWarning(wsEngine) << "Cluster" << name << ": ignoring unknown frame type"
+                                << static_cast<int>(frame.at(4));
+    }
+}
+
+void ClusterPrivate::deliverBroadcast(const QByteArray &frame) {
+    const bool binary = frame.at(ClusterFrame::BroadcastHeaderSize - 1) & ClusterFrame::Binary;
+    QByteArray message = frame.mid(ClusterFrame::BroadcastHeaderSize);
+
+    QVector<QSharedPointer<Connection>> targets;
+    {
+        QMutexLocker locker(&mutex);
+        targets.reserve(connections.size());
+        for (const QWeakPointer<Connection> &weak : connections) {
+            QSharedPointer<Connection> connection = weak.toStrongRef();
+            if (connection && connection->isAuthenticated()) {
+                targets.append(connection);
+            }
+        }
+    }
+    if (binary) {
+        for (const QSharedPointer<Connection> &connection : targets) {
+            connection->sendBinaryMessage(message);
+        }
+    } else {
+        // transcoded once, the connections share the string
+        const QString text = QString::fromUtf8(message);
+        for (const QSharedPointer<Connection> &connection : targets) {
+            connection->sendTextMessage(text);
+        }
+    }
+    ConnectionPrivate::releaseOnOwnerThreads(targets);
+}
+
+bool ClusterPrivate::deliverDirect(const QByteArray &frame) {
+    const uchar *header = reinterpret_cast<const uchar *>(frame.constData()) + ClusterFrame::HeaderSize;
+    quint64      id = qFromLittleEndian<quint64>(header) & kLocalIdMask;
+
+    QSharedPointer<Connection> connection;
+    {
+        QMutexLocker locker(&mutex);
+        connection = connections.value(id).toStrongRef();
+    }
+    if (!connection || !connection->isAuthenticated()) {
+        return false;
+    }
+    deliver(connection, header[8] & ClusterFrame::Binary, frame.mid(ClusterFrame::DirectHeaderSize));
+    return true;
+}
+
+void ClusterPrivate::writeToNodes(const QByteArray &frame, QLocalSocket *except) {
+    // the same frame is written to every node without serializing it again
+    for (auto it = nodeBuffers.constBegin(); it != nodeBuffers.constEnd(); ++it) {
+        if (it.key() != except) {
+            writeFrame(it.key(), frame);
+        }
+    }
+}
+
+void ClusterPrivate::writeFrame(QLocalSocket *socket, const QByteArray &frame) {
+    if (socket->state() != QLocalSocket::ConnectedState) {
+        return;
+    }
+    // a process which doesn't read its socket would otherwise make the write buffer grow without limit
+    if (socket->bytesToWrite() + frame.size() > maxWriteBufferSize) {
+        if (socket == hubSocket) {
+            qCWarning(wsEngine) << "Cluster" << name << ": hub doesn't keep up, disconnecting";
+        } else {
+            qCWarning(wsEngine) << "Cluster" << name << ": node" << nodes.key(socket)
+                                << "doesn't keep up, disconnecting";
+        }
+        socket->abort();
+        return;
+    }
+    socket->write(frame);
+}
+
+void ClusterPrivate::publishCounts() {
+    QByteArray table;
+    int        total = 0;
+    {
+        QMutexLocker locker(&mutex);
+        table.resize(4 + counts.size() * 8);
+        uchar *data = reinterpret_cast<uchar *>(table.data());
+        qToLittleEndian<quint32>(static_cast<quint32>(counts.size()), data);
+        data += 4;
+        for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+            qToLittleEndian<quint32>(it.key(), data);
+            qToLittleEndian<quint32>(static_cast<quint32>(it.value()), data + 4);
+            data += 8;
+            total += it.value();
+        }
+    }
+    writeToNodes(createFrame(ClusterFrame::CountTable, ClusterFrame::HeaderSize, table), nullptr);
+    emit q->connectionCountChanged(total);
+}
+
+void ClusterPrivate::onNodeConnected() {
+    while (server && server->hasPendingConnections()) {
+        QLocalSocket *node = server->nextPendingConnection();
+        nodeBuffers.insert(node, QByteArray());
+        connect(node, &QLocalSocket::readyRead, this, &ClusterPrivate::onNodeReadyRead);
+        connect(node, &QLocalSocket::disconnected, this, &ClusterPrivate::onNodeDisconnected, Qt::QueuedConnection);
+    }
+}
+
+void ClusterPrivate::onNodeReadyRead() {
+    QLocalSocket *node = qobject_cast<QLocalSocket *>(sender());
+    auto          buffer = nodeBuffers.find(node);
+    if (buffer == nodeBuffers.end()) {
+        return;
+    }
+    readFrames(node, &buffer.value());
+}
+
+void ClusterPrivate::onNodeDisconnected() {
+    QLocalSocket *node = qobject_cast<QLocalSocket *>(sender());
+    if (!node || !nodeBuffers.remove(node)) {
+        return;
+    }
+    quint32 leftNode = nodes.key(node);
+    nodes.remove(leftNode);
+    {
+        QMutexLocker locker(&mutex);
+        counts.remove(leftNode);
+    }
+    qCDebug(wsEngine) << "Cluster" << name << ": node" << leftNode << "left";
+    node->deleteLater();
+    publishCounts();
+}
+
+void ClusterPrivate::onHubConnected() {
+    QByteArray hello(4, Qt::Uninitialized);
+    qToLittleEndian<quint32>(nodeId, reinterpret_cast<uchar *>(hello.data()));
+    writeFrame(hubSocket, createFrame(ClusterFrame::Hello, ClusterFrame::HeaderSize, hello));
+
+    joined.storeRelease(1);
+    qCDebug(wsEngine) << "Cluster" << name << ": node" << nodeId << "joined the hub";
+    emit q->joined(false);
+    reportCount();
+}
+
+void ClusterPrivate::onHubReadyRead() {
+    readFrames(hubSocket, &hubBuffer);
+}
+
+void ClusterPrivate::onHubStateChanged(QLocalSocket::LocalSocketState state) {
+    if (state != QLocalSocket::UnconnectedState || !running || hub) {
+        return;
+    }
+    if (joined.fetchAndStoreOrdered(0)) {
+        qCDebug(wsEngine) << "Cluster" << name << ": lost connection to the hub";
+        {
+            QMutexLocker locker(&mutex);
+            int own = connections.size();
+            counts.clear();
+            counts.insert(nodeId, own);
+        }
+        emit q->disconnected();
+    }
+
+    // spread the rejoins of the remaining nodes, the first one acquiring the lock becomes the new hub
+    int delay = 50;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    delay += QRandomGenerator::global()->bounded(200);
+#else
+    delay += qrand() % 200;
+#endif
+    reconnectTimer.start(delay);
+}
+
+void ClusterPrivate::rejoin() {
+    if (!running || becomeHub()) {
+        return;
+    }
+    connectToHub();
+}
+
+void ClusterPrivate::scheduleCountReport() {
+    if (running && !countTimer.isActive()) {
+        countTimer.start();
+    }
+}
+
+void ClusterPrivate::reportCount() {
+    int count;
+    {
+        QMutexLocker locker(&mutex);
+        count = connections.size();
+        counts.insert(nodeId, count);
+    }
+
+    if (hub) {
+        publishCounts();
+    } else if (hubSocket && hubSocket->state() == QLocalSocket::ConnectedState) {
+        QByteArray report(8, Qt::Uninitialized);
+        uchar *    data = reinterpret_cast<uchar *>(report.data());
+        qToLittleEndian<quint32>(nodeId, data);
+        qToLittleEndian<quint32>(static_cast<quint32>(count), data + 4);
+        writeFrame(hubSocket, createFrame(ClusterFrame::Count, ClusterFrame::HeaderSize, report));
+    }
+}
+
+Cluster::Cluster(const QString &name, QObject *parent) : QObject(parent), d(new ClusterPrivate(this)) {
+    d->name = name;
+}
+
+Cluster::~Cluster() {
+    stop();
+}
+
+QString Cluster::name() const {
+    return d->name;
+}
+
+void Cluster::setNodeId(quint32 nodeId) {
+    d->nodeId = nodeId & kNodeIdMask;
+}
+
+quint32 Cluster::nodeId() const {
+    return d->nodeId;
+}
+
+void Cluster::setMaxWriteBufferSize(qint64 bytes) {
+    d->maxWriteBufferSize = qMax(Q_INT64_C(0), bytes);
+}
+
+qint64 Cluster::maxWriteBufferSize() const {
+    return d->maxWriteBufferSize;
+}
+
+void Cluster::start() {
+    if (d->running) {
+        return;
+    }
+    d->running = true;
+    if (!d->becomeHub()) {
+        d->connectToHub();
+    }
+}
+
+void Cluster::stop() {
+    if (!d->running) {
+        return;
+    }
+    d->running = false;
+    d->joined.storeRelease(0);
+    d->reconnectTimer.stop();
+    d->countTimer.stop();
+
+    if (d->server) {
+        // closing the node sockets triggers the election of a new hub
+        for (QLocalSocket *node : d->nodeBuffers.keys()) {
+            node->disconnect(d);
+            node->abort();
+            node->deleteLater();
+        }
+        d->nodeBuffers.clear();
+        d->nodes.clear();
+        d->server->close();
+        d->server->deleteLater();
+        d->server = nullptr;
+        d->hubLock->unlock();
+        d->hub = false;
+    }
+    if (d->hubSocket) {
+        d->hubSocket->abort();
+    }
+
+    QMutexLocker locker(&d->mutex);
+    d->counts.clear();
+}
+
+bool Cluster::isRunning() const {
+    return d->running;
+}
+
+bool Cluster::isHub() const {
+    return d->hub;
+}
+
+quint64 Cluster::connectionId(const QSharedPointer<Connection> &connection) const {
+    return (static_cast<quint64>(d->nodeId) << kNodeIdShift) | (connection->id() & kLocalIdMask);
+}
+
+quint32 Cluster::nodeOf(quint64 clusterConnectionId) {
+    return static_cast<quint32>(clusterConnectionId >> kNodeIdShift);
+}
+
+void Cluster::broadcastTextMessage(const QString &message) {
+    // serialized once for all local connections and nodes
+    d->post(broadcastFrame(d->nodeId, false, message.toUtf8()));
+}
+
+void Cluster::broadcastBinaryMessage(const QByteArray &data) {
+    d->post(broadcastFrame(d->nodeId, true, data));
+}
+
+bool Cluster::sendTextMessage(quint64 clusterConnectionId, const QString &message) {
+    return d->sendDirect(clusterConnectionId, false, message.toUtf8());
+}
+
+bool Cluster::sendBinaryMessage(quint64 clusterConnectionId, const QByteArray &data) {
+    return d->sendDirect(clusterConnectionId, true, data);
+}
+
+int Cluster::localConnectionCount() const {
+    QMutexLocker locker(&d->mutex);
+    return d->connections.size();
+}
+
+int Cluster::connectionCount() const {
+    QMutexLocker locker(&d->mutex);
+    int          total = 0;
+    for (auto it = d->counts.constBegin(); it != d->counts.constEnd(); ++it) {
+        total += it.key() == d->nodeId ? 0 : it.value();
+    }
+    return total + d->connections.size();
+}
+
+QHash<quint32, int> Cluster::nodeConnectionCounts() const {
+    QMutexLocker        locker(&d->mutex);
+    QHash<quint32, int> counts = d->counts;
+    counts.insert(d->nodeId, d->connections.size());
+    return counts;
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/cluster.h>
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLockFile>
+#include <QMutex>
+#include <QObject>
+#include <QScopedPointer>
+#include <QTimer>
+#include <QWeakPointer>
+
+namespace QWsEngine {
+
+/**
+ * @brief Cluster bus frame format.
+ *
+ * All integers are little endian. Frame header: size u32 (including the header), type u8.
+ *
+ * Frame payloads:
+ * - Hello (node -> hub): node id u32
+ * - Count (node -> hub): node id u32, connection count u32
+ * - CountTable (hub -> nodes): entry count u32, per entry: node id u32, connection count u32
+ * - Broadcast: origin node id u32, flags u8, message
+ * - Direct: cluster connection id u64, flags u8, message
+ *
+ * Broadcast and direct frames are forwarded by the hub as they are, without serializing them again.
+ */
+namespace ClusterFrame {
+
+enum Type : quint8 { Hello = 1, Count, CountTable, Broadcast, Direct };
+
+enum Flag : quint8 { Binary = 0x01 };
+
+const int HeaderSize = 5;
+const int BroadcastHeaderSize = HeaderSize + 5;
+const int DirectHeaderSize = HeaderSize + 9;
+const int MaxSize = 256 * 1024 * 1024;
+
+}  // namespace ClusterFrame
+
+class ClusterPrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit ClusterPrivate(Cluster *cluster);
+
+    static ClusterPrivate *get(Cluster *cluster) { return cluster->d; }
+
+    /**
+     * @brief Register a new connection. Called from the listener thread owning the connection.
+     */
+    void addConnection(const QSharedPointer<Connection> &connection);
+    void removeConnection(quint64 id);
+
+    bool becomeHub();
+    void connectToHub();
+
+    static QByteArray createFrame(ClusterFrame::Type type, int headerSize, const QByteArray &message);
+
+    /**
+     * @brief Process a frame sent by this process.
+     */
+    Q_INVOKABLE void sendFrame(const QByteArray &frame);
+
+    /**
+     * @brief Send a frame of this process from any thread.
+     */
+    void post(const QByteArray &frame);
+    bool sendDirect(quint64 target, bool binary, const QByteArray &message);
+
+    /**
+     * @brief Process a frame of this process (from == nullptr), a node or the hub.
+     */
+    void processFrame(QLocalSocket *from, const QByteArray &frame);
+    void readFrames(QLocalSocket *socket, QByteArray *buffer);
+
+    void deliverBroadcast(const QByteArray &frame);
+    bool deliverDirect(const QByteArray &frame);
+    void writeToNodes(const QByteArray &frame, QLocalSocket *except);
+
+    /**
+     * @brief Write a frame to a node or the hub. A socket exceeding the write buffer limit is aborted.
+     */
+    void writeFrame(QLocalSocket *socket, const QByteArray &frame);
+    void publishCounts();
+
+    QString name;
+    quint32 nodeId;
+    qint64  maxWriteBufferSize;
+    bool    running;
+    bool    hub;
+    // set while this process is the hub or connected to the hub, readable from other threads
+    QAtomicInt joined;
+
+    QScopedPointer<QLockFile> hubLock;
+    QLocalServer *            server;
+    QLocalSocket *            hubSocket;
+    QByteArray                hubBuffer;
+
+    // hub: read buffers and node ids of the connected nodes
+    QHash<QLocalSocket *, QByteArray> nodeBuffers;
+    QHash<quint32, QLocalSocket *>    nodes;
+
+    // guards connections and counts, which are accessed from the listener threads
+    mutable QMutex                           mutex;
+    QHash<quint64, QWeakPointer<Connection>> connections;
+    QHash<quint32, int>                      counts;
+
+    QTimer reconnectTimer;
+    QTimer countTimer;
+
+ public Q_SLOTS:  // NOLINT
+    void onNodeConnected();
+    void onNodeReadyRead();
+    void onNodeDisconnected();
+    void onHubConnected();
+    void onHubReadyRead();
+    void onHubStateChanged(QLocalSocket::LocalSocketState state);
+    void rejoin();
+    void scheduleCountReport();
+    void reportCount();
+
+ private:
+    Cluster *const q;
+};
+
+}  // namespace QWsEngine
@@ -3,27 +3,391 @@
 
 #include <qwsengine/connection.h>
 #include <qwsengine/handler.h>
+#include <qwsengine/jsonwriter.h>
 
+#include <QCoreApplication>
+#include <QFutureWatcher>
+#include <QJsonDocument>
+#include <QThread>
+
+#include "bufferpool_p.h"
 #include "connection_p.h"
+#include "memorybudget_p.h"
+#include "sessionmanager_p.h"
+#include "tracerecorder_p.h"
+#include "trafficcapture_p.h"
 #include "wslogging_p.h"
 
 namespace QWsEngine {
 
+static QAtomicInteger<quint64> g_nextConnectionId(1);
+static QAtomicInteger<quint64> g_nextStreamId(1);
+
+/**
+ * @brief Render an error message template like `messageTemplate.arg(statusCode).arg(errorMsg)`.
+ *
+ * Appends to the output string without creating temporary strings.
+ */
+static void renderErrorTemplate(QString *out, const QString &messageTemplate, int statusCode, const QString &errorMsg) {
+    char digits[16];
+    int  digitCount = qsnprintf(digits, sizeof(digits), "%d", statusCode);
+
+    const QChar *data = messageTemplate.constData();
+    const int    size = messageTemplate.size();
+    int          start = 0;
+    for (int i = 0; i + 1 < size; i++) {
+        if (data[i] != QLatin1Char('%') || (data[i + 1] != QLatin1Char('1') && data[i + 1] != QLatin1Char('2'))) {
+            continue;
+        }
+        out->append(data + start, i - start);
+        if (data[i + 1] == QLatin1Char('1')) {
+            out->append(QLatin1String(digits, digitCount));
+        } else {
+            out->append(errorMsg);
+        }
+        i++;
+        start = i + 1;
+    }
+    out->append(data + start, size - start);
+}
+
 ConnectionPrivate::ConnectionPrivate(Connection *connection, QWebSocket *webSocket)
-    : socket(webSocket), handler(nullptr), authenticated(false), q(connection) {
+    : socket(webSocket), handler(nullptr), id(g_nextConnectionId.fetchAndAddRelaxed(1)), authenticated(false),
+      capture(nullptr), sessionManager(nullptr), sessionHandler(nullptr), writeWatermark(64 * 1024),
+      watchingBytesWritten(false), q(connection) {
     Q_ASSERT(webSocket);
 
-    connect(webSocket, &QWebSocket::textMessageReceived, q, &Connection::processTextMessage);
-    connect(webSocket, &QWebSocket::binaryMessageReceived, q, &Connection::processBinaryMessage);
+    QObject::connect(webSocket, &QWebSocket::textMessageReceived, q, &Connection::processTextMessage);
+    QObject::connect(webSocket, &QWebSocket::binaryMessageReceived, q, &Connection::processBinaryMessage);
 }
 
 ConnectionPrivate::~ConnectionPrivate() {
     qCDebug(wsEngine) << "ConnectionPrivate destructor";
+    // nobody is waiting for the replies anymore
+    for (QFutureWatcherBase *watcher : pendingReplies) {
+        watcher->disconnect();
+        watcher->cancel();
+    }
+    // discard messages which couldn't be sent anymore
+    while (OutboundMessage *message = outbound.pop()) {
+        delete message;
+    }
+    // held back messages can't be flushed during the socket close anymore
+    pending.reset();
+    if (account) {
+        account->detach();
+    }
+    if (session) {
+        SessionManagerPrivate::detach(session, q);
+    }
     socket->close();
     // socket may not be deleted immediately if triggered from QWebSocketServer::socketDisconnected
     socket->deleteLater();
 }
 
+QEvent::Type ConnectionPrivate::drainEventType() {
+    static const QEvent::Type type = static_cast<QEvent::Type>(QEvent::registerEventType());
+    return type;
+}
+
+QEvent::Type ConnectionPrivate::invokeEventType() {
+    static const QEvent::Type type = static_cast<QEvent::Type>(QEvent::registerEventType());
+    return type;
+}
+
+void ConnectionPrivate::invokeOnOwnerThread(QSharedPointer<Connection> &connection,
+                                            const std::function<void()> &function) {
+    Connection * target = connection.data();
+    InvokeEvent *event = new InvokeEvent(invokeEventType(), function);
+    // the connection reference is released when the delivered event is deleted
+    event->connection.swap(connection);
+    QCoreApplication::postEvent(target, event);
+}
+
+void ConnectionPrivate::releaseOnOwnerThreads(QVector<QSharedPointer<Connection>> &connections) {
+    QHash<QThread *, InvokeEvent *> events;
+    for (QSharedPointer<Connection> &connection : connections) {
+        QThread *thread = connection->thread();
+        if (thread == QThread::currentThread()) {
+            connection.reset();
+            continue;
+        }
+        InvokeEvent *&event = events[thread];
+        if (!event) {
+            event = new InvokeEvent(invokeEventType(), std::function<void()>());
+            event->connection.swap(connection);
+        } else {
+            event->references.append(connection);
+            connection.reset();
+        }
+    }
+    connections.clear();
+
+    for (InvokeEvent *event : events) {
+        QCoreApplication::postEvent(event->connection.data(), event);
+    }
+}
+
+QSharedPointer<SerialExecutor> ConnectionPrivate::serialExecutor(QThreadPool *pool) {
+    QSharedPointer<SerialExecutor> &executor = executors[pool];
+    if (!executor) {
+        executor = QSharedPointer<SerialExecutor>::create(pool);
+    }
+    return executor;
+}
+
+void ConnectionPrivate::post(OutboundMessage *message) {
+    outbound.push(message);
+    // Only the first producer after a drain wakes up the owning thread. The flag is reset before draining, so a
+    // producer still in the middle of a push schedules another drain.
+    if (drainScheduled.testAndSetOrdered(0, 1)) {
+        QCoreApplication::postEvent(q, new QEvent(drainEventType()));
+    }
+}
+
+void ConnectionPrivate::drainOutbound() {
+    drainScheduled.storeRelease(0);
+
+    while (OutboundMessage *message = outbound.pop()) {
+        switch (message->kind) {
+            case OutboundMessage::Text:
+                writeText(message->text);
+                break;
+            case OutboundMessage::Binary:
+                writeBinary(message->data);
+                break;
+            case OutboundMessage::Conflated:
+                sendConflated(message->key, message->text);
+                break;
+            case OutboundMessage::BulkText:
+            case OutboundMessage::BulkBinary: {
+                BulkMessage bulk;
+                bulk.text = message->text;
+                bulk.data = message->data;
+                bulk.binary = message->kind == OutboundMessage::BulkBinary;
+                sendBulk(bulk);
+                break;
+            }
+            case OutboundMessage::Stream:
+                startStream(*message->stream);
+                break;
+        }
+        delete message;
+    }
+}
+
+qint64 ConnectionPrivate::sendConflated(const QString &key, const QString &message) {
+    if (canWriteDirectly()) {
+        return writeText(message);
+    }
+    pendingOutbound()->setConflated(key, message);
+    accountOutbound();
+    return 0;
+}
+
+qint64 ConnectionPrivate::sendBulk(const BulkMessage &message) {
+    if (canWriteDirectly()) {
+        return message.binary ? writeBinary(message.data) : writeText(message.text);
+    }
+    pendingOutbound()->enqueue(message);
+    accountOutbound();
+    return 0;
+}
+
+qint64 ConnectionPrivate::writeText(const QString &message) {
+    // record before the socket check: messages sent during a disconnect are the ones to replay
+    if (session) {
+        session->record(q, SessionMessage::Text, message, QByteArray());
+    }
+    if (!socket || !socket->isValid()) {
+        qCDebug(wsEngine) << "Invalid socket, cannot send message:" << message;
+        return 0;
+    }
+    QWSENGINE_TRACE_MESSAGE(Send, id, static_cast<quint32>(message.size()));
+    qint64 written = socket->sendTextMessage(message);
+    accountOutbound();
+    return written;
+}
+
+qint64 ConnectionPrivate::writeUtf8(const QByteArray &utf8) {
+    if (session) {
+        session->record(q, SessionMessage::Utf8, QString(), utf8);
+    }
+    if (!socket || !socket->isValid()) {
+        qCDebug(wsEngine) << "Invalid socket, cannot send message:" << utf8;
+        return 0;
+    }
+    QWSENGINE_TRACE_MESSAGE(Send, id, static_cast<quint32>(utf8.size()));
+    // QWebSocket only accepts text messages as QString
+    qint64 written = socket->sendTextMessage(QString::fromUtf8(utf8));
+    accountOutbound();
+    return written;
+}
+
+qint64 ConnectionPrivate::writeBinary(const QByteArray &data) {
+    if (session) {
+        session->record(q, SessionMessage::Binary, QString(), data);
+    }
+    if (!socket || !socket->isValid()) {
+        qCDebug(wsEngine) << "Invalid socket, cannot send binary message";
+        return 0;
+    }
+    QWSENGINE_TRACE_MESSAGE(Send, id, static_cast<quint32>(data.size()));
+    qint64 written = socket->sendBinaryMessage(data);
+    accountOutbound();
+    return written;
+}
+
+qint64 ConnectionPrivate::writeBacklog() const {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    return socket ? socket->bytesToWrite() : 0;
+#else
+    return 0;
+#endif
+}
+
+PendingOutbound *ConnectionPrivate::pendingOutbound() {
+    if (!pending) {
+        pending.reset(new PendingOutbound());
+        watchBytesWritten();
+    }
+    return pending.data();
+}
+
+void ConnectionPrivate::watchBytesWritten() {
+    if (watchingBytesWritten) {
+        return;
+    }
+    watchingBytesWritten = true;
+    // also updates the memory account
+    QObject::connect(socket, &QWebSocket::bytesWritten, q, [this]() { flushPending(); });
+}
+
+void ConnectionPrivate::flushPending() {
+    while (pending && !pending->isEmpty() && writeBacklog() < writeWatermark) {
+        if (!pending->conflatedKeys.isEmpty()) {
+            writeText(pending->takeConflated());
+            continue;
+        }
+        if (!pending->bulk.isEmpty()) {
+            BulkMessage message = pending->dequeue();
+            if (message.binary) {
+                writeBinary(message.data);
+            } else {
+                writeText(message.text);
+            }
+            continue;
+        }
+        if (!writeStreamChunk()) {
+            break;
+        }
+    }
+    accountOutbound();
+}
+
+void ConnectionPrivate::startStream(const OutboundStream &stream) {
+    if (stream.device) {
+        QSharedPointer<bool> readFinished = stream.readFinished;
+        QObject::connect(stream.device.data(), &QIODevice::readyRead, q, [this]() { flushPending(); });
+        QObject::connect(stream.device.data(), &QIODevice::readChannelFinished, q, [this, readFinished]() {
+            *readFinished = true;
+            flushPending();
+        });
+    }
+    pendingOutbound()->streams.enqueue(stream);
+    flushPending();
+}
+
+quint64 ConnectionPrivate::queueStream(OutboundStream *stream) {
+    const quint64 id = stream->id;
+    if (QThread::currentThread() != q->thread()) {
+        // queued with the other messages of foreign threads to keep their order
+        OutboundMessage *message = new OutboundMessage;
+        message->kind = OutboundMessage::Stream;
+        message->stream.reset(stream);
+        post(message);
+        return id;
+    }
+
+    QScopedPointer<OutboundStream> owner(stream);
+    if (drainScheduled.loadAcquire()) {
+        drainOutbound();
+    }
+    startStream(*stream);
+    return id;
+}
+
+bool ConnectionPrivate::writeStreamChunk() {
+    OutboundStream &stream = pending->streams.head();
+
+    if (stream.file) {
+        const qint64 size = stream.file->size();
+        if (stream.offset < size && stream.file->isTruncated()) {
+            qCWarning(wsEngine) << "File truncated while streaming:" << stream.file->fileName();
+            finishStream(false);
+            return true;
+        }
+        if (stream.offset < size) {
+            const int   length = static_cast<int>(qMin<qint64>(size - stream.offset, stream.chunkSize));
+            const char *chunk = stream.file->data() + stream.offset;
+            stream.offset += length;
+            // the socket copies the frame: a view on the mapping is enough, unless a session keeps it for a replay
+            writeBinary(session ? QByteArray(chunk, length) : QByteArray::fromRawData(chunk, length));
+        }
+        if (stream.offset >= size) {
+            finishStream(true);
+        }
+        return true;
+    }
+
+    QIODevice *device = stream.device.data();
+    QByteArray chunk = device->read(stream.chunkSize);
+    if (!chunk.isEmpty()) {
+        stream.offset += chunk.size();
+        writeBinary(chunk);
+        if (!device->isSequential() && device->atEnd()) {
+            finishStream(true);
+        }
+        return true;
+    }
+    if (!device->isSequential()) {
+        // nothing read before the end: read error
+        finishStream(device->atEnd());
+        return true;
+    }
+    if (*stream.readFinished || !device->isReadable()) {
+        finishStream(true);
+        return true;
+    }
+    return false;  // wait for readyRead
+}
+
+void ConnectionPrivate::finishStream(bool success) {
+    OutboundStream stream = pending->streams.dequeue();
+    qCDebug(wsEngine) << "Stream" << stream.id << (success ? "sent," : "failed after") << stream.offset << "bytes";
+    // queued: a slot may release the connection
+    QMetaObject::invokeMethod(q, "streamFinished", Qt::QueuedConnection, Q_ARG(quint64, stream.id),
+                              Q_ARG(bool, success));
+}
+
+void ConnectionPrivate::setMemoryAccount(const QSharedPointer<MemoryAccount> &memoryAccount) {
+    account = memoryAccount;
+    // Complete messages are accounted in Connection::processTextMessage() and processBinaryMessage(). Partial
+    // messages are only accounted for binary uploads, text messages are bounded by the maximum message size.
+    QObject::connect(socket, &QWebSocket::binaryFrameReceived, q, [this](const QByteArray &frame, bool isLastFrame) {
+        if (!isLastFrame) {
+            account->addInbound(frame.size());
+        }
+    });
+    watchBytesWritten();
+}
+
+void ConnectionPrivate::accountOutbound() {
+    if (account) {
+        account->setOutbound(writeBacklog() + (pending ? pending->bytes : 0));
+    }
+}
+
 Connection::Connection(QWebSocket *webSocket, bool authenticated) : d(new ConnectionPrivate(this, webSocket)) {
     setAuthenticated(authenticated);
 }
@@ -50,45 +414,107 @@ QWebSocket *Connection::webSocket() const {
     return d->socket;
 }
 
+quint64 Connection::id() const {
+    return d->id;
+}
+
 bool Connection::isAuthenticated() const {
     return d->authenticated;
 }
 
 void Connection::setAuthenticated(bool authenticated) {
     d->authenticated = authenticated;
+    if (authenticated && d->sessionManager && !d->session) {
+        SessionManagerPrivate::get(d->sessionManager)->createSession(sharedFromThis());
+    }
+}
+
+QHostAddress Connection::clientAddress() const {
+    QVariant address = d->socket->property(ClientAddressProperty);
+    return address.isValid() ? QHostAddress(address.toString()) : d->socket->peerAddress();
+}
+
+quint16 Connection::clientPort() const {
+    QVariant port = d->socket->property(ClientPortProperty);
+    return port.isValid() ? static_cast<quint16>(port.toUInt()) : d->socket->peerPort();
+}
+
+QString Connection::routeId() const {
+    return d->routeId;
+}
+
+QString Connection::pathParameter(const QString &name) const {
+    return d->pathParameters.value(name);
+}
+
+QHash<QString, QString> Connection::pathParameters() const {
+    return d->pathParameters;
 }
 
 void Connection::processTextMessage(const QString &message) {
+    if (d->capture) {
+        d->capture->recordTextMessage(d->id, message);
+    }
+    // keeps the account valid if the connection is released while routing
+    QSharedPointer<MemoryAccount> account = d->account;
+    if (account) {
+        if (account->isPaused()) {
+            account->setInbound(0);
+            sendErrorResponse(503, "Server busy");
+            return;
+        }
+        account->setInbound(textBytes(message));
+    }
     if (d->handler) {
         d->handler->routeTextMessage(sharedFromThis(), message);
     } else {
         sendErrorResponse(500, "No message handler defined");
     }
+    if (account) {
+        account->setInbound(0);
+    }
 }
 
 void Connection::processBinaryMessage(const QByteArray &message) {
+    if (d->capture) {
+        d->capture->recordBinaryMessage(d->id, message);
+    }
+    QSharedPointer<MemoryAccount> account = d->account;
+    if (account) {
+        if (account->isPaused()) {
+            account->setInbound(0);
+            sendErrorResponse(503, "Server busy");
+            return;
+        }
+        account->setInbound(message.size());
+    }
     if (d->handler) {
         d->handler->routeBinaryMessage(sharedFromThis(), message);
     } else {
         sendErrorResponse(500, "No message handler defined");
     }
+    if (account) {
+        account->setInbound(0);
+    }
 }
 
 void Connection::close(QWebSocketProtocol::CloseCode closeCode, const QString &reason) {
     if (!d->socket) {
         return;
     }
-    qCDebug(wsEngine) << "Close request for:" << d->socket->peerAddress().toString();
+    qCDebug(wsEngine) << "Close request for:" << clientAddress().toString();
     d->socket->close(closeCode, reason);  // triggers onDisconnected
 }
 
 void Connection::sendErrorResponse(int statusCode, const QString &errorMsg) {
     qCDebug(wsEngine) << "Sending error response:" << statusCode;
+    QString &message = BufferPoolPrivate::textBuffer();
     if (d->handler) {
-        sendTextMessage(d->handler->errorResponseMsgTemplate().arg(statusCode).arg(errorMsg));
+        renderErrorTemplate(&message, d->handler->errorResponseMsgTemplate(), statusCode, errorMsg);
     } else {
-        sendTextMessage(QString("{\"status_code\": %1}").arg(statusCode));
+        renderErrorTemplate(&message, QStringLiteral("{\"status_code\": %1}"), statusCode, errorMsg);
     }
+    sendTextMessage(message);
 }
 
 void Connection::sendAuthRequired() {
@@ -101,19 +527,176 @@ void Connection::sendAuthRequired() {
 }
 
 qint64 Connection::sendTextMessage(const QString &message) {
-    if (!d->socket || !d->socket->isValid()) {
-        qCDebug(wsEngine) << "Invalid socket, cannot send message:" << message;
+    if (QThread::currentThread() != thread()) {
+        postTextMessage(message);
+        return 0;
+    }
+    // keep the order of previously posted messages
+    if (d->drainScheduled.loadAcquire()) {
+        d->drainOutbound();
+    }
+    return d->writeText(message);
+}
+
+qint64 Connection::sendUtf8(const QByteArray &utf8) {
+    if (QThread::currentThread() != thread()) {
+        postTextMessage(QString::fromUtf8(utf8));
+        return 0;
+    }
+    if (d->drainScheduled.loadAcquire()) {
+        d->drainOutbound();
+    }
+    return d->writeUtf8(utf8);
+}
+
+qint64 Connection::sendConflated(const QString &key, const QString &message) {
+    if (QThread::currentThread() != thread()) {
+        OutboundMessage *msg = new OutboundMessage;
+        msg->kind = OutboundMessage::Conflated;
+        msg->key = key;
+        msg->text = message;
+        d->post(msg);
+        return 0;
+    }
+    if (d->drainScheduled.loadAcquire()) {
+        d->drainOutbound();
+    }
+    return d->sendConflated(key, message);
+}
+
+qint64 Connection::sendBulkTextMessage(const QString &message) {
+    if (QThread::currentThread() != thread()) {
+        OutboundMessage *msg = new OutboundMessage;
+        msg->kind = OutboundMessage::BulkText;
+        msg->text = message;
+        d->post(msg);
         return 0;
     }
-    return d->socket->sendTextMessage(message.toUtf8());
+    if (d->drainScheduled.loadAcquire()) {
+        d->drainOutbound();
+    }
+
+    BulkMessage bulk;
+    bulk.text = message;
+    bulk.binary = false;
+    return d->sendBulk(bulk);
+}
+
+qint64 Connection::sendBulkBinaryMessage(const QByteArray &data) {
+    if (QThread::currentThread() != thread()) {
+        OutboundMessage *msg = new OutboundMessage;
+        msg->kind = OutboundMessage::BulkBinary;
+        msg->data = data;
+        d->post(msg);
+        return 0;
+    }
+    if (d->drainScheduled.loadAcquire()) {
+        d->drainOutbound();
+    }
+
+    BulkMessage bulk;
+    bulk.data = data;
+    bulk.binary = true;
+    return d->sendBulk(bulk);
+}
+
+quint64 Connection::sendBinaryStream(QIODevice *device, int chunkSize) {
+    if (!device || !device->isReadable()) {
+        qCWarning(wsEngine) << "Cannot stream from a device which isn't readable";
+        if (device) {
+            device->deleteLater();
+        }
+        return 0;
+    }
+
+    Q_ASSERT_X(!device->parent(), "Connection::sendBinaryStream", "the device must not have a parent");
+    // moveToThread() only works from the thread the device lives in
+    if (device->thread() != thread() && device->thread() != QThread::currentThread()) {
+        qCWarning(wsEngine) << "Cannot stream from a device living in another thread";
+        device->deleteLater();
+        return 0;
+    }
+
+    OutboundStream *stream = new OutboundStream;
+    stream->id = g_nextStreamId.fetchAndAddRelaxed(1);
+    stream->device = QSharedPointer<QIODevice>(device, &QObject::deleteLater);
+    stream->offset = 0;
+    stream->chunkSize = qMax(chunkSize, 1);
+    stream->readFinished = QSharedPointer<bool>::create(false);
+
+    if (device->thread() != thread()) {
+        device->moveToThread(thread());
+    }
+    return d->queueStream(stream);
+}
+
+quint64 Connection::sendBinaryStream(const QSharedPointer<MappedFile> &file, int chunkSize) {
+    if (!file) {
+        return 0;
+    }
+
+    OutboundStream *stream = new OutboundStream;
+    stream->id = g_nextStreamId.fetchAndAddRelaxed(1);
+    stream->file = file;
+    stream->offset = 0;
+    stream->chunkSize = qMax(chunkSize, 1);
+    return d->queueStream(stream);
+}
+
+void Connection::setWriteBufferWatermark(int bytes) {
+    d->writeWatermark = bytes;
+    d->flushPending();
+}
+
+int Connection::writeBufferWatermark() const {
+    return d->writeWatermark;
+}
+
+qint64 Connection::sendJson(const JsonWriter &json) {
+    return sendUtf8(json.data());
+}
+
+qint64 Connection::sendJson(const QJsonObject &json) {
+    return sendUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
 }
 
 qint64 Connection::sendBinaryMessage(const QByteArray &data) {
-    if (!d->socket || !d->socket->isValid()) {
-        qCDebug(wsEngine) << "Invalid socket, cannot send binary message";
+    if (QThread::currentThread() != thread()) {
+        postBinaryMessage(data);
         return 0;
     }
-    return d->socket->sendBinaryMessage(data);
+    if (d->drainScheduled.loadAcquire()) {
+        d->drainOutbound();
+    }
+    return d->writeBinary(data);
+}
+
+void Connection::postTextMessage(const QString &message) {
+    OutboundMessage *msg = new OutboundMessage;
+    msg->text = message;
+    d->post(msg);
+}
+
+void Connection::postBinaryMessage(const QByteArray &data) {
+    OutboundMessage *msg = new OutboundMessage;
+    msg->kind = OutboundMessage::Binary;
+    msg->data = data;
+    d->post(msg);
+}
+
+bool Connection::event(QEvent *event) {
+    if (event->type() == ConnectionPrivate::drainEventType()) {
+        d->drainOutbound();
+        return true;
+    }
+    if (event->type() == ConnectionPrivate::invokeEventType()) {
+        InvokeEvent *invokeEvent = static_cast<InvokeEvent *>(event);
+        if (invokeEvent->function) {
+            invokeEvent->function();
+        }
+        return true;
+    }
+    return QObject::event(event);
 }
 
 }  // namespace QWsEngine
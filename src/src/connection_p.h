@@ -4,25 +4,324 @@
 #pragma once
 
 #include <qwsengine/connection.h>
+#include <qwsengine/mappedfile.h>
 
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QEvent>
+#include <QHash>
+#include <QIODevice>
 #include <QList>
 #include <QObject>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVariant>
+#include <QVector>
 #include <QtWebSockets/QWebSocket>
 
+#include <functional>
+
+class QFutureWatcherBase;
+
+#include "mpscqueue_p.h"
+#include "serialexecutor_p.h"
+
 namespace QWsEngine {
 
-class ConnectionPrivate : public QObject {
-    Q_OBJECT
+class ConnectionHandler;
+class MemoryAccount;
+class Session;
+class SessionManager;
+class TrafficCapture;
+
+// QWebSocket properties with the client address of a PROXY protocol header
+static const char ClientAddressProperty[] = "clientAddress";
+static const char ClientPortProperty[] = "clientPort";
+
+/**
+ * @brief Returns the client address of the socket for logging, taking a PROXY protocol header into account.
+ */
+inline QString socketClientAddress(QWebSocket *socket) {
+    QVariant address = socket->property(ClientAddressProperty);
+    return address.isValid() ? address.toString() : socket->peerAddress().toString();
+}
+
+/**
+ * @brief Returns the memory held by the UTF-16 data of a string.
+ */
+inline qint64 textBytes(const QString &text) {
+    return text.size() * static_cast<qint64>(sizeof(QChar));
+}
+
+/**
+ * @brief Binary stream sent in chunks while the write buffer is below the watermark.
+ *
+ * The source is either a device owned by the stream or a shared file mapping.
+ */
+struct OutboundStream {
+    quint64                    id;
+    QSharedPointer<QIODevice>  device;
+    QSharedPointer<MappedFile> file;
+    qint64                     offset;
+    int                        chunkSize;
+    // set when a sequential device signalled the end of its data
+    QSharedPointer<bool> readFinished;
+};
+
+/**
+ * @brief Outbound message queued from a foreign thread.
+ *
+ * All sends from foreign threads share the queue, so they are processed in the order they were posted.
+ */
+struct OutboundMessage {
+    enum Kind : quint8 { Text, Binary, Conflated, BulkText, BulkBinary, Stream };
+
+    Kind       kind = Text;
+    QString    text;
+    QByteArray data;
+    // conflation key
+    QString key;
+    // only allocated for streams
+    QScopedPointer<OutboundStream>  stream;
+    QAtomicPointer<OutboundMessage> next;
+};
+
+/**
+ * @brief Bulk message waiting for the write buffer to drain.
+ */
+struct BulkMessage {
+    QString    text;
+    QByteArray data;
+    bool       binary;
+};
+
+/**
+ * @brief Outbound messages held back while the socket's write buffer is above the watermark.
+ *
+ * Conflated "latest value wins" messages are kept in order of the first pending message of each key and are sent
+ * before bulk messages. Streams are sent one after another after the bulk messages.
+ */
+struct PendingOutbound {
+    QHash<QString, QString> conflated;
+    QList<QString>          conflatedKeys;
+    QQueue<BulkMessage>     bulk;
+    QQueue<OutboundStream>  streams;
+    // memory held by the messages, for the memory budget
+    qint64 bytes = 0;
+
+    bool isEmpty() const { return conflatedKeys.isEmpty() && bulk.isEmpty() && streams.isEmpty(); }
+
+    void setConflated(const QString &key, const QString &message) {
+        auto existing = conflated.find(key);
+        if (existing == conflated.end()) {
+            conflatedKeys.append(key);
+            conflated.insert(key, message);
+            bytes += textBytes(message);
+        } else {
+            bytes += textBytes(message) - textBytes(*existing);
+            *existing = message;
+        }
+    }
+
+    QString takeConflated() {
+        QString message = conflated.take(conflatedKeys.takeFirst());
+        bytes -= textBytes(message);
+        return message;
+    }
+
+    void enqueue(const BulkMessage &message) {
+        bulk.enqueue(message);
+        bytes += message.binary ? message.data.size() : textBytes(message.text);
+    }
+
+    BulkMessage dequeue() {
+        BulkMessage message = bulk.dequeue();
+        bytes -= message.binary ? message.data.size() : textBytes(message.text);
+        return message;
+    }
+};
 
+/**
+ * @brief Event to execute a function on the thread owning the connection.
+ *
+ * The event holds a strong reference to the connection which is released on the owning thread once the event has been
+ * delivered.
+ */
+class InvokeEvent : public QEvent {
+ public:
+    InvokeEvent(QEvent::Type type, const std::function<void()> &function) : QEvent(type), function(function) {}
+
+    std::function<void()>      function;
+    QSharedPointer<Connection> connection;
+    // further connections of the same thread, released with the event
+    QVector<QSharedPointer<Connection>> references;
+};
+
+/**
+ * @brief Private connection data.
+ *
+ * Intentionally not a QObject: every connection would otherwise carry a second QObject with its own private data
+ * allocation. Events and signals are handled by the Connection itself.
+ */
+class ConnectionPrivate {
  public:
     explicit ConnectionPrivate(Connection *connection, QWebSocket *socket);
-    virtual ~ConnectionPrivate();
+    ~ConnectionPrivate();
+
+    /**
+     * @brief Queue a message for the owning thread. Thread-safe.
+     */
+    void post(OutboundMessage *message);
+
+    /**
+     * @brief Send all queued messages. Must be called from the owning thread.
+     */
+    void drainOutbound();
+
+    /**
+     * @brief Send or hold back a conflated message. Must be called from the owning thread.
+     */
+    qint64 sendConflated(const QString &key, const QString &message);
+
+    /**
+     * @brief Send or hold back a bulk message. Must be called from the owning thread.
+     */
+    qint64 sendBulk(const BulkMessage &message);
+
+    qint64 writeText(const QString &message);
+    qint64 writeUtf8(const QByteArray &utf8);
+    qint64 writeBinary(const QByteArray &data);
+
+    /**
+     * @brief Number of bytes in the socket's write buffer which haven't been written to the network yet.
+     */
+    qint64 writeBacklog() const;
+
+    /**
+     * @brief Returns true if the message can be written right away without bypassing held back messages.
+     */
+    bool canWriteDirectly() const { return (!pending || pending->isEmpty()) && writeBacklog() < writeWatermark; }
+
+    /**
+     * @brief Returns the held back messages, creating them on first use.
+     */
+    PendingOutbound *pendingOutbound();
+
+    /**
+     * @brief Send held back messages while the write backlog is below the watermark.
+     */
+    void flushPending();
+
+    /**
+     * @brief Flush held back messages and update the memory account when the socket wrote data.
+     *
+     * A single bytesWritten() connection serves both, it is made on first use.
+     */
+    void watchBytesWritten();
+
+    /**
+     * @brief Start a stream, or queue it with the outbound messages if called from a foreign thread.
+     *
+     * Takes ownership of the stream and returns its id.
+     */
+    quint64 queueStream(OutboundStream *stream);
+
+    /**
+     * @brief Queue a stream and start sending it. Must be called from the owning thread.
+     */
+    void startStream(const OutboundStream &stream);
+
+    /**
+     * @brief Send the next chunk of the current stream. Returns false if the stream is waiting for device data.
+     */
+    bool writeStreamChunk();
+    void finishStream(bool success);
+
+    /**
+     * @brief Account the inbound and outbound bytes of the connection in a memory budget.
+     */
+    void setMemoryAccount(const QSharedPointer<MemoryAccount> &memoryAccount);
+
+    /**
+     * @brief Update the outbound bytes of the memory account with the write backlog and held back messages.
+     */
+    void accountOutbound();
+
+    static QEvent::Type drainEventType();
+    static QEvent::Type invokeEventType();
+
+    static ConnectionPrivate *get(Connection *connection) { return connection->d.data(); }
+
+    /**
+     * @brief Execute a function on the thread owning the connection. Thread-safe.
+     *
+     * Takes over the given connection reference, which is released on the owning thread after the function has been
+     * executed. The connection is empty after this call.
+     */
+    static void invokeOnOwnerThread(QSharedPointer<Connection> &connection,
+                                    const std::function<void()> &function = std::function<void()>());
+
+    /**
+     * @brief Release connection references, which may be the last ones, on the threads owning the connections.
+     *
+     * A single event is posted per thread. Thread-safe. The vector is empty after this call.
+     */
+    static void releaseOnOwnerThreads(QVector<QSharedPointer<Connection>> &connections);
+
+    /**
+     * @brief Returns the serial executor of the connection for the given pool, creating it on first use.
+     *
+     * Messages are executed in order per pool. Must be called from the owning thread.
+     */
+    QSharedPointer<SerialExecutor> serialExecutor(QThreadPool *pool);
+
+    /**
+     * @brief Number of messages which are still being processed asynchronously.
+     */
+    int inFlight() const {
+        int count = 0;
+        for (const auto &executor : executors) {
+            count += executor->inFlight();
+        }
+        return count;
+    }
+
+    QWebSocket *  socket;
+    Handler *     handler;
+    const quint64 id;
+    bool          authenticated;
+
+    // opt-in capture of inbound messages
+    TrafficCapture *capture;
+
+    // matched path route
+    QString                 routeId;
+    QHash<QString, QString> pathParameters;
+
+    // resumable session, created after the authentication if a session manager is set
+    SessionManager *        sessionManager;
+    QSharedPointer<Session> session;
+    // connection handler which set the session manager, the only one resuming the session
+    ConnectionHandler *sessionHandler;
+
+    MpscQueue<OutboundMessage> outbound;
+    QAtomicInt                 drainScheduled;
+
+    // usually a single pool, handlers may use different pools
+    QHash<QThreadPool *, QSharedPointer<SerialExecutor>> executors;
+
+    // allocated with the first held back message
+    QScopedPointer<PendingOutbound> pending;
+    int                             writeWatermark;
+    bool                            watchingBytesWritten;
 
-    QList<Middleware *> middleware;
+    // set if the server has a memory budget
+    QSharedPointer<MemoryAccount> account;
 
-    QWebSocket *socket;
-    Handler *   handler;
-    bool        authenticated;
+    // asynchronous replies of QObjectHandler, children of the connection. Canceled when the connection is destroyed.
+    QList<QFutureWatcherBase *> pendingReplies;
 
  private:
     Connection *const q;
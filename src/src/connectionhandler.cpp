@@ -4,14 +4,81 @@
 #include <qwsengine/connection.h>
 #include <qwsengine/connectionhandler.h>
 #include <qwsengine/connectionmiddleware.h>
+#include <qwsengine/sessionmanager.h>
 
+#include <QUrlQuery>
+
+#include "connection_p.h"
 #include "connectionhandler_p.h"
+#include "sessionmanager_p.h"
 #include "wslogging_p.h"
 
 namespace QWsEngine {
 
 ConnectionHandlerPrivate::ConnectionHandlerPrivate(ConnectionHandler *connectionHandler)
-    : QObject(connectionHandler), handler(nullptr), q(connectionHandler) {}
+    : QObject(connectionHandler), handler(nullptr), sessionManager(nullptr), q(connectionHandler) {}
+
+void ConnectionHandlerPrivate::update(const std::function<void(ConnectionRouting *)> &modify) {
+    snapshot.update([&modify](ConnectionHandlerSnapshot *next) {
+        modify(&next->routing);
+        next->compile();
+    });
+}
+
+QSharedPointer<Connection> ConnectionHandlerPrivate::resumeSession(QWebSocket *socket) {
+    QUrlQuery query(socket->requestUrl());
+    QString   token = query.queryItemValue(QStringLiteral("resume_token"));
+    if (token.isEmpty()) {
+        return nullptr;
+    }
+
+    bool    ok;
+    quint64 lastSeq = query.queryItemValue(QStringLiteral("last_seq")).toULongLong(&ok);
+    if (!ok) {
+        lastSeq = 0;
+    }
+
+    SessionManagerPrivate * manager = SessionManagerPrivate::get(sessionManager);
+    QSharedPointer<Session> session = manager->takeSession(token, lastSeq, q);
+    if (!session) {
+        qCDebug(wsEngine) << q->name() << ": Session" << token << "can't be resumed, continuing with routing";
+        return nullptr;
+    }
+
+    // the session was authenticated: bypass authenticating connection handlers
+    auto               conn = q->ConnectionHandler::createConnection(socket, true);
+    ConnectionPrivate *connPrivate = ConnectionPrivate::get(conn.data());
+    // continue with the message handler and route of the original connection
+    connPrivate->handler = session->handler;
+    connPrivate->routeId = session->routeId;
+    connPrivate->pathParameters = session->pathParameters;
+    connPrivate->sessionManager = sessionManager;
+    connPrivate->sessionHandler = q;
+    manager->resume(conn, session, lastSeq);
+    return conn;
+}
+
+QSharedPointer<Connection> ConnectionHandlerPrivate::attachSessionManager(
+    const QSharedPointer<Connection> &connection) {
+    if (connection && sessionManager) {
+        ConnectionPrivate *connPrivate = ConnectionPrivate::get(connection.data());
+        if (!connPrivate->sessionManager) {
+            connPrivate->sessionManager = sessionManager;
+            connPrivate->sessionHandler = q;
+            if (connection->isAuthenticated()) {
+                SessionManagerPrivate::get(sessionManager)->createSession(connection);
+            }
+        }
+    }
+    return connection;
+}
+
+void ConnectionHandlerSnapshot::compile() {
+    trie = PathTrie();
+    for (int i = 0; i < routing.routes().size(); i++) {
+        trie.insert(routing.routes().at(i).first, i);
+    }
+}
 
 ConnectionHandler::ConnectionHandler(QObject *parent) : QObject(parent), d(new ConnectionHandlerPrivate(this)) {}
 
@@ -28,43 +95,122 @@ QString ConnectionHandler::name() const {
     return "RootHandler";
 }
 
+ConnectionRouting &ConnectionRouting::addMiddleware(ConnectionMiddleware *middleware) {
+    m_middleware.append(middleware);
+    return *this;
+}
+
+ConnectionRouting &ConnectionRouting::removeMiddleware(ConnectionMiddleware *middleware) {
+    m_middleware.removeAll(middleware);
+    return *this;
+}
+
+ConnectionRouting &ConnectionRouting::addSubHandler(const QRegExp &pattern, ConnectionHandler *handler) {
+    m_subHandlers.append(ConnSubHandler(pattern, handler));
+    return *this;
+}
+
+ConnectionRouting &ConnectionRouting::removeSubHandler(ConnectionHandler *handler) {
+    for (int i = m_subHandlers.size() - 1; i >= 0; i--) {
+        if (m_subHandlers.at(i).second == handler) {
+            m_subHandlers.removeAt(i);
+        }
+    }
+    return *this;
+}
+
+ConnectionRouting &ConnectionRouting::addRoute(const QString &pathPattern, ConnectionHandler *handler) {
+    removeRoute(pathPattern);
+    m_routes.append(qMakePair(pathPattern, handler));
+    return *this;
+}
+
+ConnectionRouting &ConnectionRouting::removeRoute(const QString &pathPattern) {
+    for (int i = m_routes.size() - 1; i >= 0; i--) {
+        if (m_routes.at(i).first == pathPattern) {
+            m_routes.removeAt(i);
+        }
+    }
+    return *this;
+}
+
 void ConnectionHandler::addMiddleware(ConnectionMiddleware *middleware) {
-    d->middleware.append(middleware);
+    d->update([middleware](ConnectionRouting *routing) { routing->addMiddleware(middleware); });
 }
 
 void ConnectionHandler::addSubHandler(const QRegExp &pattern, ConnectionHandler *handler) {
-    d->subHandlers.append(ConnSubHandler(pattern, handler));
+    d->update([&pattern, handler](ConnectionRouting *routing) { routing->addSubHandler(pattern, handler); });
+}
+
+void ConnectionHandler::addRoute(const QString &pathPattern, ConnectionHandler *handler) {
+    d->update([&pathPattern, handler](ConnectionRouting *routing) { routing->addRoute(pathPattern, handler); });
+}
+
+ConnectionRouting ConnectionHandler::routing() const {
+    return d->snapshot.load()->routing;
+}
+
+void ConnectionHandler::setRouting(const ConnectionRouting &routing) {
+    d->update([&routing](ConnectionRouting *next) { *next = routing; });
 }
 
 QSharedPointer<Connection> ConnectionHandler::route(QWebSocket *socket, const QString &path) {
     qCDebug(wsEngine) << name() << ": Routing new" << path
-                      << "connection through the middleware from:" << socket->peerAddress().toString()
+                      << "connection through the middleware from:" << socketClientAddress(socket)
                       << socket->peerPort();
 
+    auto snapshot = d->snapshot.load();
+
     // Run through each of the middleware
-    foreach(ConnectionMiddleware *middleware, d->middleware) {
+    foreach(ConnectionMiddleware *middleware, snapshot->routing.middleware()) {
         if (!middleware->process(socket)) {
             qCDebug(wsEngine) << "Middleware" << middleware->name()
-                              << "stopped processing, closing socket from:" << socket->peerAddress().toString()
+                              << "stopped processing, closing socket from:" << socketClientAddress(socket)
                               << socket->peerPort();
             socket->deleteLater();
             return nullptr;
         }
     }
 
-    foreach(ConnSubHandler subHandler, d->subHandlers) {
+    if (d->sessionManager) {
+        auto conn = d->resumeSession(socket);
+        if (conn) {
+            return conn;
+        }
+    }
+
+    if (!snapshot->trie.isEmpty()) {
+        PathTrie::Match match;
+        if (snapshot->trie.match(path, &match)) {
+            const QPair<QString, ConnectionHandler *> &route = snapshot->routing.routes().at(match.route);
+            auto                                       conn = route.second->route(socket, path);
+            if (conn) {
+                // a nested connection handler may already have matched a more specific route
+                ConnectionPrivate *connPrivate = ConnectionPrivate::get(conn.data());
+                if (connPrivate->routeId.isNull()) {
+                    connPrivate->routeId = route.first;
+                    connPrivate->pathParameters = match.parameters;
+                }
+            }
+            if (conn || !socket->isValid()) {
+                return d->attachSessionManager(conn);
+            }
+        }
+    }
+
+    foreach(ConnSubHandler subHandler, snapshot->routing.subHandlers()) {
         if (subHandler.first.indexIn(path) != -1) {
             qCDebug(wsEngine) << "Path regex(" << subHandler.first.pattern() << ") match on" << path
                               << "for sub-handler:" << subHandler.second->name();
             auto conn = subHandler.second->route(socket, path);
             if (conn || !socket->isValid()) {
-                return conn;
+                return d->attachSessionManager(conn);
             }
         }
     }
 
     // If no match, invoke the process() method
-    return process(socket, path);
+    return d->attachSessionManager(process(socket, path));
 }
 
 void ConnectionHandler::setMessageHandler(Handler *handler) {
@@ -75,6 +221,14 @@ Handler *ConnectionHandler::messageHandler() {
     return d->handler;
 }
 
+void ConnectionHandler::setSessionManager(SessionManager *manager) {
+    d->sessionManager = manager;
+}
+
+SessionManager *ConnectionHandler::sessionManager() const {
+    return d->sessionManager;
+}
+
 QSharedPointer<Connection> ConnectionHandler::process(QWebSocket *socket, const QString &path) {
     if (d->handler) {
         // simple connection without authentication: therefore set connection as authenticated to allow message
@@ -83,7 +237,7 @@ QSharedPointer<Connection> ConnectionHandler::process(QWebSocket *socket, const
     }
     // The default response is to close the connection
     qCDebug(wsEngine) << "No connection processing available for" << path
-                      << ", closing socket from:" << socket->peerAddress().toString() << socket->peerPort();
+                      << ", closing socket from:" << socketClientAddress(socket) << socket->peerPort();
     // TODO(zehnm) send error msg?
     // TODO(zehnm) correct close code? Check WS specs!
     socket->close(QWebSocketProtocol::CloseCodePolicyViolated, "Invalid endpoint: " + path);
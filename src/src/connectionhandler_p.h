@@ -10,20 +10,57 @@
 #include <QObject>
 #include <QPair>
 #include <QRegExp>
+#include <QSharedData>
+
+#include <functional>
+
+#include "pathtrie_p.h"
+#include "snapshot_p.h"
 
 namespace QWsEngine {
 
 typedef QPair<QRegExp, ConnectionHandler *> ConnSubHandler;
 
+/**
+ * @brief Immutable routing snapshot of a connection handler.
+ */
+class ConnectionHandlerSnapshot : public QSharedData {
+ public:
+    /**
+     * @brief Compile the path routes into the trie.
+     */
+    void compile();
+
+    ConnectionRouting routing;
+    PathTrie          trie;
+};
+
 class ConnectionHandlerPrivate : public QObject {
     Q_OBJECT
 
  public:
     explicit ConnectionHandlerPrivate(ConnectionHandler *connectionHandler);
 
-    QList<ConnectionMiddleware *> middleware;
-    QList<ConnSubHandler>         subHandlers;
-    Handler *                     handler;
+    /**
+     * @brief Modify and publish the routing configuration.
+     */
+    void update(const std::function<void(ConnectionRouting *)> &modify);
+
+    /**
+     * @brief Resume the session requested in the query of the socket's request URL.
+     *
+     * Returns null if no session was requested or it can't be resumed anymore.
+     */
+    QSharedPointer<Connection> resumeSession(QWebSocket *socket);
+
+    /**
+     * @brief Enable sessions on a new connection, if not already enabled by a nested connection handler.
+     */
+    QSharedPointer<Connection> attachSessionManager(const QSharedPointer<Connection> &connection);
+
+    SnapshotPointer<ConnectionHandlerSnapshot> snapshot;
+    Handler *                                  handler;
+    SessionManager *                           sessionManager;
 
  private:
     ConnectionHandler *const q;
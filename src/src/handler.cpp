@@ -8,23 +8,87 @@
 #include <QJsonDocument>
 #include <QJsonParseError>
 
+#include "bufferpool_p.h"
 #include "handler_p.h"
+#include "stallwatchdog_p.h"
+#include "tracerecorder_p.h"
 #include "wslogging_p.h"
 
 namespace QWsEngine {
 
 HandlerPrivate::HandlerPrivate(Handler *handler) : QObject(handler), q(handler) {}
 
+void HandlerPrivate::update(const std::function<void(HandlerSnapshot *)> &modify) {
+    snapshot.update([&modify](HandlerSnapshot *next) {
+        modify(next);
+        next->compile();
+    });
+}
+
+void HandlerSnapshot::compile() {
+    QList<BinaryRoute *> binaryRoutes;
+    for (auto it = binaryIds.begin(); it != binaryIds.end(); ++it) {
+        binaryRoutes.append(&it.value());
+    }
+    for (auto it = binaryNames.begin(); it != binaryNames.end(); ++it) {
+        binaryRoutes.append(&it.value());
+    }
+
+    for (BinaryRoute *route : binaryRoutes) {
+        route->subHandler = nullptr;
+        // same order as Handler::route()
+        for (SubHandler subHandler : routing.subHandlers()) {
+            if (subHandler.first.indexIn(route->msgName) != -1) {
+                route->subHandler = subHandler.second;
+                break;
+            }
+        }
+    }
+}
+
 Handler::Handler(QObject *parent) : QObject(parent), d(new HandlerPrivate(this)) {}
 
 Handler::~Handler() {}
 
+HandlerRouting &HandlerRouting::addMiddleware(Middleware *middleware) {
+    m_middleware.append(middleware);
+    return *this;
+}
+
+HandlerRouting &HandlerRouting::removeMiddleware(Middleware *middleware) {
+    m_middleware.removeAll(middleware);
+    return *this;
+}
+
+HandlerRouting &HandlerRouting::addSubHandler(const QRegExp &msgNamePattern, Handler *handler) {
+    m_subHandlers.append(SubHandler(msgNamePattern, handler));
+    return *this;
+}
+
+HandlerRouting &HandlerRouting::removeSubHandler(Handler *handler) {
+    for (int i = m_subHandlers.size() - 1; i >= 0; i--) {
+        if (m_subHandlers.at(i).second == handler) {
+            m_subHandlers.removeAt(i);
+        }
+    }
+    return *this;
+}
+
 void Handler::addMiddleware(Middleware *middleware) {
-    d->middleware.append(middleware);
+    d->update([middleware](HandlerSnapshot *next) { next->routing.addMiddleware(middleware); });
 }
 
 void Handler::addSubHandler(const QRegExp &msgNamePattern, Handler *handler) {
-    d->subHandlers.append(SubHandler(msgNamePattern, handler));
+    d->update(
+        [&msgNamePattern, handler](HandlerSnapshot *next) { next->routing.addSubHandler(msgNamePattern, handler); });
+}
+
+HandlerRouting Handler::routing() const {
+    return d->snapshot.load()->routing;
+}
+
+void Handler::setRouting(const HandlerRouting &routing) {
+    d->update([&routing](HandlerSnapshot *next) { next->routing = routing; });
 }
 
 void Handler::setErrorResponseMsgTemplate(const QString &messageTemplate) {
@@ -43,13 +107,102 @@ QString Handler::authRequiredMsgTemplate() const {
     return d->authTemplate;
 }
 
+void Handler::setBinaryFraming(BinaryFraming framing) {
+    d->update([framing](HandlerSnapshot *next) { next->binaryFraming = framing; });
+}
+
+Handler::BinaryFraming Handler::binaryFraming() const {
+    return d->snapshot.load()->binaryFraming;
+}
+
+void Handler::registerBinaryMessage(quint64 id, const QString &msgName) {
+    d->update([id, &msgName](HandlerSnapshot *next) {
+        BinaryRoute route;
+        route.msgName = msgName;
+        next->binaryIds.insert(id, route);
+        next->binaryNames.insert(msgName.toUtf8(), route);
+    });
+}
+
+bool HandlerPrivate::decodeBinaryFrame(const HandlerSnapshot &snapshot, const QByteArray &frame, QString *msgName,
+                                       QByteArray *payload, const BinaryRoute **route, bool *unknownId) {
+    const uchar *data = reinterpret_cast<const uchar *>(frame.constData());
+    const int    size = frame.size();
+    int          offset = 0;
+
+    if (snapshot.binaryFraming == Handler::VarintIdFraming) {
+        quint64 id = 0;
+        for (int shift = 0;; shift += 7) {
+            if (offset >= size || shift > 63) {
+                return false;
+            }
+            uchar byte = data[offset++];
+            // the 10th byte only holds the highest bit of a 64 bit id
+            if (shift == 63 && (byte & 0x7e)) {
+                return false;
+            }
+            id |= static_cast<quint64>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        auto it = snapshot.binaryIds.constFind(id);
+        if (it == snapshot.binaryIds.constEnd()) {
+            *unknownId = true;
+            return false;
+        }
+        *route = &it.value();
+        *msgName = it->msgName;
+    } else {
+        if (size < 1 || data[0] == 0 || 1 + data[0] > size) {
+            return false;
+        }
+        const int length = data[0];
+        offset = 1 + length;
+        // lookup without copying the name
+        auto it = snapshot.binaryNames.constFind(QByteArray::fromRawData(frame.constData() + 1, length));
+        if (it != snapshot.binaryNames.constEnd()) {
+            *route = &it.value();
+            *msgName = it->msgName;
+        } else {
+            *msgName = QString::fromUtf8(frame.constData() + 1, length);
+        }
+    }
+
+    *payload = QByteArray::fromRawData(frame.constData() + offset, size - offset);
+    return true;
+}
+
+bool HandlerPrivate::runMiddleware(const HandlerSnapshot &snapshot, const QSharedPointer<Connection> &connection,
+                                   const QString &msgName, const QVariant &message) {
+    // Run through each of the middleware
+    foreach(Middleware *middleware, snapshot.routing.middleware()) {
+        bool proceed = middleware->process(connection, msgName, message);
+        QWSENGINE_TRACE_MESSAGE(MiddlewareVerdict, connection->id(), proceed ? 1 : 0);
+        if (!proceed) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void Handler::routeTextMessage(QSharedPointer<Connection> connection, const QString &message) {
     qCDebug(wsEngine()) << "Converting WebSocket text message to JSON object";
 
     // TODO(zehnm) replace with MessageConverter
 
+    QWSENGINE_TRACE_BEGIN_MESSAGE();
+    QWSENGINE_TRACE_MESSAGE(ParseStart, connection->id(), static_cast<quint32>(message.size()));
+
     QJsonParseError parseerror;
-    QJsonDocument   doc = QJsonDocument::fromJson(message.toUtf8(), &parseerror);
+    QJsonDocument   doc;
+    {
+        // QJsonDocument doesn't keep a reference to the input, the buffer can be reused right after parsing
+        PooledBuffer utf8(utf8Length(message.constData(), message.size()));
+        encodeUtf8(message.constData(), message.size(), &utf8.buffer);
+        doc = QJsonDocument::fromJson(utf8.buffer, &parseerror);
+    }
+    QWSENGINE_TRACE_MESSAGE(ParseEnd, connection->id(), parseerror.error == QJsonParseError::NoError ? 1 : 0);
     if (parseerror.error != QJsonParseError::NoError) {
         qCWarning(wsEngine) << "JSON error:" << parseerror.errorString();
         // TODO(zehnm) error handling codes. Try to extract request id with regex
@@ -68,19 +221,56 @@ void Handler::routeTextMessage(QSharedPointer<Connection> connection, const QStr
 
 void Handler::routeBinaryMessage(QSharedPointer<Connection> connection, const QByteArray &message) {
     // TODO(zehnm) add MessageConverter
-    route(connection, "binary", message);
+    QWSENGINE_TRACE_BEGIN_MESSAGE();
+    auto snapshot = d->snapshot.load();
+    if (snapshot->binaryFraming == NoBinaryFraming) {
+        route(connection, "binary", message);
+        return;
+    }
+
+    QString            msgName;
+    QByteArray         payload;
+    const BinaryRoute *binaryRoute = nullptr;
+    bool               unknownId = false;
+    if (!HandlerPrivate::decodeBinaryFrame(*snapshot, message, &msgName, &payload, &binaryRoute, &unknownId)) {
+        if (unknownId) {
+            connection->sendErrorResponse(404, "Unknown message id");
+        } else {
+            connection->sendErrorResponse(400, "Invalid binary frame");
+        }
+        return;
+    }
+    // the payload refers to the received frame, which outlives the routing
+    if (!binaryRoute) {
+        route(connection, msgName, payload);
+        return;
+    }
+
+    // registered message: the sub handler has been resolved when the snapshot was published
+    StallWatchdogScope stallScope(connection->id(), msgName, metaObject()->className());
+    const QVariant     variant(payload);
+    if (!HandlerPrivate::runMiddleware(*snapshot, connection, msgName, variant)) {
+        return;
+    }
+    if (binaryRoute->subHandler) {
+        binaryRoute->subHandler->route(connection, msgName, variant);
+    } else {
+        process(connection, msgName, variant);
+    }
 }
 
 void Handler::route(QSharedPointer<Connection> connection, const QString &msgName, const QVariant &message) {
-    // Run through each of the middleware
-    foreach(Middleware *middleware, d->middleware) {
-        if (!middleware->process(connection, msgName, message)) {
-            return;
-        }
+    StallWatchdogScope stallScope(connection->id(), msgName, metaObject()->className());
+
+    // the snapshot stays valid while the message is being routed, even if the routing is replaced meanwhile
+    auto snapshot = d->snapshot.load();
+
+    if (!HandlerPrivate::runMiddleware(*snapshot, connection, msgName, message)) {
+        return;
     }
 
     // Check each of the sub-handlers for a match
-    foreach(SubHandler subHandler, d->subHandlers) {
+    foreach(SubHandler subHandler, snapshot->routing.subHandlers()) {
         if (subHandler.first.indexIn(msgName) != -1) {
             subHandler.second->route(connection, msgName, message);
             return;
@@ -5,22 +5,95 @@
 
 #include <qwsengine/handler.h>
 
+#include <QByteArray>
+#include <QHash>
 #include <QList>
 #include <QObject>
+#include <QSharedData>
+#include <QVariant>
+
+#include <functional>
+
+#include "snapshot_p.h"
 
 namespace QWsEngine {
 
 typedef QPair<QRegExp, Handler *> SubHandler;
 
+/**
+ * @brief Route of a registered binary message, resolved when the routing is published.
+ */
+struct BinaryRoute {
+    QString msgName;
+    // sub handler matching the message name, or nullptr if the message is processed by the handler itself
+    Handler *subHandler = nullptr;
+};
+
+/**
+ * @brief Immutable routing snapshot of a handler.
+ */
+class HandlerSnapshot : public QSharedData {
+ public:
+    HandlerSnapshot() : binaryFraming(Handler::NoBinaryFraming) {}
+
+    /**
+     * @brief Resolve the sub handlers of the registered binary messages.
+     */
+    void compile();
+
+    HandlerRouting routing;
+
+    Handler::BinaryFraming binaryFraming;
+    // registered binary messages
+    QHash<quint64, BinaryRoute>    binaryIds;
+    QHash<QByteArray, BinaryRoute> binaryNames;
+};
+
+/**
+ * @brief Returns a message which stays valid after routing.
+ *
+ * Payloads of framed binary messages are QByteArray::fromRawData() views on the received frame, which are copied.
+ */
+inline QVariant detachedMessage(const QVariant &message) {
+    if (message.userType() == QMetaType::QByteArray) {
+        QByteArray data = message.toByteArray();
+        // a non-empty view has no allocation of its own (data_ptr() doesn't detach)
+        if (!data.isEmpty() && data.data_ptr()->alloc == 0) {
+            return QVariant(QByteArray(data.constData(), data.size()));
+        }
+    }
+    return message;
+}
+
 class HandlerPrivate : public QObject {
     Q_OBJECT
 
  public:
     explicit HandlerPrivate(Handler *handler);
 
-    QList<Middleware *> middleware;
-    QList<SubHandler>   subHandlers;
-    QString             errorTemplate =
+    static HandlerPrivate *get(Handler *handler) { return handler->d; }
+
+    /**
+     * @brief Modify and publish the routing configuration.
+     */
+    void update(const std::function<void(HandlerSnapshot *)> &modify);
+
+    /**
+     * @brief Run the middleware of the snapshot. Returns false if a middleware consumed or rejected the message.
+     */
+    static bool runMiddleware(const HandlerSnapshot &snapshot, const QSharedPointer<Connection> &connection,
+                              const QString &msgName, const QVariant &message);
+
+    /**
+     * @brief Split a framed binary message into message name and payload view. Returns false if it is malformed.
+     *
+     * route is set to the precomputed route of a registered message, or nullptr.
+     */
+    static bool decodeBinaryFrame(const HandlerSnapshot &snapshot, const QByteArray &frame, QString *msgName,
+                                  QByteArray *payload, const BinaryRoute **route, bool *unknownId);
+
+    SnapshotPointer<HandlerSnapshot> snapshot;
+    QString                          errorTemplate =
         "{\"type\": \"result\", \"success\": false, \"error\": {\"code\": %1, \"message\": \"%2\"}}";
     QString authTemplate = "{\"type\": \"auth_required\"}";
 
@@ -83,13 +83,13 @@ QSharedPointer<Connection> HeaderAuthConnectionHandler::process(QWebSocket *sock
     } else {
         if (d->failedAuthClosesSocket) {
             qCDebug(wsEngine) << "Missing required authorization header" << d->tokenHeaderName << "for endpoint" << path
-                              << "from:" << socket->peerAddress().toString() << socket->peerPort();
+                              << "from:" << socketClientAddress(socket) << socket->peerPort();
         }
     }
 
     if (!authenticated && d->failedAuthClosesSocket) {
         qCDebug(wsEngine) << "Failed authentication for endpoint" << path
-                          << ", closing socket from:" << socket->peerAddress().toString() << socket->peerPort();
+                          << ", closing socket from:" << socketClientAddress(socket) << socket->peerPort();
         // TODO(zehnm) correct close code? Check WS specs!
         socket->close(QWebSocketProtocol::CloseCodePolicyViolated, "Authentication failed");
         socket->deleteLater();
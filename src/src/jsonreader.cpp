@@ -0,0 +1,461 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/jsonreader.h>
+
+#include <cstring>
+
+namespace QWsEngine {
+
+namespace {
+
+// protects the recursive skipValue() against deeply nested input
+const int kMaxDepth = 512;
+
+inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool readHex4(const char *p, uint *value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hexValue(p[i]);
+        if (digit < 0) {
+            return false;
+        }
+        *value = (*value << 4) | static_cast<uint>(digit);
+    }
+    return true;
+}
+
+void appendUtf8(QByteArray *out, uint cp) {
+    if (cp < 0x80) {
+        out->append(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out->append(static_cast<char>(0xc0 | (cp >> 6)));
+        out->append(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        out->append(static_cast<char>(0xe0 | (cp >> 12)));
+        out->append(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out->append(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else {
+        out->append(static_cast<char>(0xf0 | (cp >> 18)));
+        out->append(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+        out->append(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out->append(static_cast<char>(0x80 | (cp & 0x3f)));
+    }
+}
+
+}  // namespace
+
+JsonReader::JsonReader(const char *data, int size)
+    : m_begin(data), m_pos(data), m_end(data + size), m_error(false) {}
+
+JsonReader::JsonReader(const QByteArray &utf8) : JsonReader(utf8.constData(), utf8.size()) {}
+
+bool JsonReader::fail() {
+    m_error = true;
+    return false;
+}
+
+bool JsonReader::skipWhitespace() {
+    while (m_pos < m_end && isWhitespace(*m_pos)) {
+        ++m_pos;
+    }
+    return m_pos < m_end;
+}
+
+bool JsonReader::expect(char c) {
+    if (m_error || !skipWhitespace() || *m_pos != c) {
+        return fail();
+    }
+    ++m_pos;
+    return true;
+}
+
+JsonReader::Type JsonReader::peek() {
+    if (m_error || !skipWhitespace()) {
+        return Invalid;
+    }
+    switch (*m_pos) {
+        case '{':
+            return Object;
+        case '[':
+            return Array;
+        case '"':
+            return String;
+        case 't':
+        case 'f':
+            return Bool;
+        case 'n':
+            return Null;
+        default:
+            return (*m_pos == '-' || isDigit(*m_pos)) ? Number : Invalid;
+    }
+}
+
+bool JsonReader::beginObject() {
+    if (m_first.size() >= kMaxDepth || !expect('{')) {
+        return fail();
+    }
+    m_first.append(true);
+    return true;
+}
+
+bool JsonReader::beginArray() {
+    if (m_first.size() >= kMaxDepth || !expect('[')) {
+        return fail();
+    }
+    m_first.append(true);
+    return true;
+}
+
+bool JsonReader::separator(char end, bool *atEnd) {
+    if (m_error || m_first.isEmpty() || !skipWhitespace()) {
+        return fail();
+    }
+    if (*m_pos == end) {
+        ++m_pos;
+        m_first.removeLast();
+        *atEnd = true;
+        return true;
+    }
+    *atEnd = false;
+    if (m_first.last()) {
+        m_first.last() = false;
+        return true;
+    }
+    if (*m_pos != ',') {
+        return fail();
+    }
+    ++m_pos;
+    return true;
+}
+
+bool JsonReader::nextKey(QLatin1String *key) {
+    bool atEnd;
+    if (!separator('}', &atEnd) || atEnd) {
+        return false;
+    }
+    return readStringView(key) && expect(':');
+}
+
+bool JsonReader::nextElement() {
+    bool atEnd;
+    return separator(']', &atEnd) && !atEnd;
+}
+
+bool JsonReader::scanString(const char **begin, int *size, bool *escaped) {
+    if (!expect('"')) {
+        return false;
+    }
+    const char *p = m_pos;
+    *escaped = false;
+    while (p < m_end) {
+        char c = *p;
+        if (c == '"') {
+            *begin = m_pos;
+            *size = static_cast<int>(p - m_pos);
+            m_pos = p + 1;
+            return true;
+        }
+        if (c == '\\') {
+            *escaped = true;
+            p += 2;
+            continue;
+        }
+        if (static_cast<uchar>(c) < 0x20) {
+            return fail();
+        }
+        ++p;
+    }
+    return fail();
+}
+
+bool JsonReader::unescape(const char *begin, int size) {
+    m_scratch.resize(0);
+    m_scratch.reserve(size);
+    const char *end = begin + size;
+    for (const char *p = begin; p < end; ++p) {
+        if (*p != '\\') {
+            m_scratch.append(*p);
+            continue;
+        }
+        if (++p >= end) {
+            return fail();
+        }
+        switch (*p) {
+            case '"':
+            case '\\':
+            case '/':
+                m_scratch.append(*p);
+                break;
+            case 'b':
+                m_scratch.append('\b');
+                break;
+            case 'f':
+                m_scratch.append('\f');
+                break;
+            case 'n':
+                m_scratch.append('\n');
+                break;
+            case 'r':
+                m_scratch.append('\r');
+                break;
+            case 't':
+                m_scratch.append('\t');
+                break;
+            case 'u': {
+                uint cp;
+                if (end - p < 5 || !readHex4(p + 1, &cp)) {
+                    return fail();
+                }
+                p += 4;
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    // surrogate pair
+                    uint low;
+                    if (end - p < 7 || p[1] != '\\' || p[2] != 'u' || !readHex4(p + 3, &low) || low < 0xdc00 ||
+                        low > 0xdfff) {
+                        return fail();
+                    }
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+                    return fail();
+                }
+                appendUtf8(&m_scratch, cp);
+                break;
+            }
+            default:
+                return fail();
+        }
+    }
+    return true;
+}
+
+bool JsonReader::readStringView(QLatin1String *value) {
+    const char *begin;
+    int         size;
+    bool        escaped;
+    if (!scanString(&begin, &size, &escaped)) {
+        return false;
+    }
+    if (!escaped) {
+        *value = QLatin1String(begin, size);
+        return true;
+    }
+    if (!unescape(begin, size)) {
+        return false;
+    }
+    *value = QLatin1String(m_scratch.constData(), m_scratch.size());
+    return true;
+}
+
+bool JsonReader::readString(QString *value) {
+    QLatin1String view;
+    if (!readStringView(&view)) {
+        return false;
+    }
+    *value = QString::fromUtf8(view.data(), view.size());
+    return true;
+}
+
+bool JsonReader::readUtf8(QByteArray *value) {
+    QLatin1String view;
+    if (!readStringView(&view)) {
+        return false;
+    }
+    *value = QByteArray(view.data(), view.size());
+    return true;
+}
+
+bool JsonReader::readBool(bool *value) {
+    if (m_error || !skipWhitespace()) {
+        return fail();
+    }
+    if (m_end - m_pos >= 4 && memcmp(m_pos, "true", 4) == 0) {
+        m_pos += 4;
+        *value = true;
+        return true;
+    }
+    if (m_end - m_pos >= 5 && memcmp(m_pos, "false", 5) == 0) {
+        m_pos += 5;
+        *value = false;
+        return true;
+    }
+    return fail();
+}
+
+bool JsonReader::readNull() {
+    if (m_error || !skipWhitespace() || m_end - m_pos < 4 || memcmp(m_pos, "null", 4) != 0) {
+        return fail();
+    }
+    m_pos += 4;
+    return true;
+}
+
+bool JsonReader::scanNumber(const char **begin, int *size, bool *integral) {
+    if (m_error || !skipWhitespace()) {
+        return fail();
+    }
+    const char *p = m_pos;
+    *integral = true;
+    if (*p == '-') {
+        ++p;
+    }
+    if (p >= m_end || !isDigit(*p)) {
+        return fail();
+    }
+    while (p < m_end && isDigit(*p)) {
+        ++p;
+    }
+    if (p < m_end && *p == '.') {
+        *integral = false;
+        ++p;
+        if (p >= m_end || !isDigit(*p)) {
+            return fail();
+        }
+        while (p < m_end && isDigit(*p)) {
+            ++p;
+        }
+    }
+    if (p < m_end && (*p == 'e' || *p == 'E')) {
+        *integral = false;
+        ++p;
+        if (p < m_end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+        if (p >= m_end || !isDigit(*p)) {
+            return fail();
+        }
+        while (p < m_end && isDigit(*p)) {
+            ++p;
+        }
+    }
+    *begin = m_pos;
+    *size = static_cast<int>(p - m_pos);
+    m_pos = p;
+    return true;
+}
+
+bool JsonReader::readInt(qint64 *value) {
+    const char *begin;
+    int         size;
+    bool        integral;
+    if (!scanNumber(&begin, &size, &integral) || !integral) {
+        return fail();
+    }
+    const char *p = begin;
+    const bool  negative = *p == '-';
+    if (negative) {
+        ++p;
+    }
+    // the limit of a negative number is one larger
+    const quint64 limit = negative ? Q_UINT64_C(9223372036854775808) : Q_UINT64_C(9223372036854775807);
+    quint64       result = 0;
+    for (; p < begin + size; ++p) {
+        quint64 digit = static_cast<quint64>(*p - '0');
+        if (result > (limit - digit) / 10) {
+            return fail();
+        }
+        result = result * 10 + digit;
+    }
+    *value = negative ? static_cast<qint64>(0 - result) : static_cast<qint64>(result);
+    return true;
+}
+
+bool JsonReader::readDouble(double *value) {
+    const char *begin;
+    int         size;
+    bool        integral;
+    if (!scanNumber(&begin, &size, &integral)) {
+        return false;
+    }
+    if (integral && size < 16) {
+        // exactly representable: skip the generic conversion
+        qint64 number = 0;
+        for (const char *p = *begin == '-' ? begin + 1 : begin; p < begin + size; ++p) {
+            number = number * 10 + (*p - '0');
+        }
+        *value = static_cast<double>(*begin == '-' ? -number : number);
+        return true;
+    }
+    // QByteArray::toDouble() is locale independent
+    bool ok;
+    *value = QByteArray::fromRawData(begin, size).toDouble(&ok);
+    return ok || fail();
+}
+
+bool JsonReader::readRawValue(QByteArray *json) {
+    if (m_error || !skipWhitespace()) {
+        return fail();
+    }
+    const char *begin = m_pos;
+    if (!skipValue()) {
+        return false;
+    }
+    *json = QByteArray(begin, static_cast<int>(m_pos - begin));
+    return true;
+}
+
+bool JsonReader::skipValue() {
+    switch (peek()) {
+        case Object: {
+            QLatin1String key;
+            beginObject();
+            while (nextKey(&key)) {
+                if (!skipValue()) {
+                    return false;
+                }
+            }
+            return !m_error;
+        }
+        case Array:
+            beginArray();
+            while (nextElement()) {
+                if (!skipValue()) {
+                    return false;
+                }
+            }
+            return !m_error;
+        case String: {
+            const char *begin;
+            int         size;
+            bool        escaped;
+            return scanString(&begin, &size, &escaped);
+        }
+        case Number: {
+            const char *begin;
+            int         size;
+            bool        integral;
+            return scanNumber(&begin, &size, &integral);
+        }
+        case Bool: {
+            bool value;
+            return readBool(&value);
+        }
+        case Null:
+            return readNull();
+        default:
+            return fail();
+    }
+}
+
+}  // namespace QWsEngine
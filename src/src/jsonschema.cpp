@@ -0,0 +1,540 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include "jsonschema_p.h"
+
+#include <QStringList>
+#include <QUrl>
+
+#include <algorithm>
+#include <cmath>
+
+namespace QWsEngine {
+
+namespace {
+
+// returned by the compile functions if the schema is invalid
+const int kInvalidNode = -3;
+
+// keywords which change the validation result but aren't supported by the compiler
+const char *const kUnsupportedKeywords[] = {"allOf",
+                                           "anyOf",
+                                           "oneOf",
+                                           "not",
+                                           "if",
+                                           "then",
+                                           "else",
+                                           "contains",
+                                           "uniqueItems",
+                                           "additionalItems",
+                                           "dependencies",
+                                           "dependentRequired",
+                                           "dependentSchemas",
+                                           "patternProperties",
+                                           "propertyNames",
+                                           "unevaluatedItems",
+                                           "unevaluatedProperties"};
+
+QString escapePointerToken(const QString &token) {
+    if (!token.contains(QLatin1Char('~')) && !token.contains(QLatin1Char('/'))) {
+        return token;
+    }
+    QString escaped = token;
+    escaped.replace(QLatin1Char('~'), QLatin1String("~0"));
+    escaped.replace(QLatin1Char('/'), QLatin1String("~1"));
+    return escaped;
+}
+
+QString unescapePointerToken(const QString &token) {
+    QString unescaped = QUrl::fromPercentEncoding(token.toUtf8());
+    unescaped.replace(QLatin1String("~1"), QLatin1String("/"));
+    unescaped.replace(QLatin1String("~0"), QLatin1String("~"));
+    return unescaped;
+}
+
+// JSON schema string lengths are counted in code points, not in UTF-16 code units
+int codePointLength(const QString &string) {
+    int length = string.size();
+    for (const QChar c : string) {
+        if (c.isLowSurrogate()) {
+            length--;
+        }
+    }
+    return length;
+}
+
+bool readCount(const QJsonObject &schema, const char *keyword, int *count) {
+    QJsonValue value = schema.value(QLatin1String(keyword));
+    if (!value.isDouble() || value.toDouble() < 0) {
+        return false;
+    }
+    *count = value.toInt();
+    return true;
+}
+
+bool fail(JsonSchema::Error *error, const char *keyword, const QString &message) {
+    if (error) {
+        error->path.clear();
+        error->keyword = QLatin1String(keyword);
+        error->message = message;
+    }
+    return false;
+}
+
+void prependPath(JsonSchema::Error *error, const QString &token) {
+    if (error) {
+        error->path.prepend(QLatin1Char('/') + escapePointerToken(token));
+    }
+}
+
+}  // namespace
+
+JsonSchema::JsonSchema() : m_rootNode(AnyNode) {}
+
+bool JsonSchema::compile(const QJsonObject &schema, QString *errorString) {
+    m_nodes.clear();
+    m_properties.clear();
+    m_patterns.clear();
+    m_enums.clear();
+    m_root = schema;
+
+    int root = compileValue(schema, QStringLiteral("#"), errorString);
+
+    m_root = QJsonObject();
+    m_compiled.clear();
+    m_resolving.clear();
+
+    if (root == kInvalidNode) {
+        m_rootNode = AnyNode;
+        return false;
+    }
+    m_rootNode = root;
+    return true;
+}
+
+int JsonSchema::compileValue(const QJsonValue &schema, const QString &pointer, QString *errorString) {
+    if (schema.isBool()) {
+        return schema.toBool() ? AnyNode : NoNode;
+    }
+    if (!schema.isObject()) {
+        if (errorString) {
+            *errorString = pointer + QStringLiteral(": schema must be an object or a boolean");
+        }
+        return kInvalidNode;
+    }
+
+    QJsonObject object = schema.toObject();
+    if (object.contains(QLatin1String("$ref"))) {
+        // sibling keywords of a reference are ignored
+        return compileRef(object.value(QLatin1String("$ref")).toString(), errorString);
+    }
+
+    auto compiled = m_compiled.constFind(pointer);
+    if (compiled != m_compiled.constEnd()) {
+        return compiled.value();
+    }
+
+    // register the node before compiling the sub-schemas, so that recursive references resolve to it
+    int index = m_nodes.size();
+    m_nodes.append(Node());
+    m_compiled.insert(pointer, index);
+
+    Node node;
+    if (!compileNode(object, pointer, &node, errorString)) {
+        return kInvalidNode;
+    }
+    m_nodes[index] = node;
+    return index;
+}
+
+int JsonSchema::compileRef(const QString &ref, QString *errorString) {
+    auto compiled = m_compiled.constFind(ref);
+    if (compiled != m_compiled.constEnd()) {
+        return compiled.value();
+    }
+    if (!ref.startsWith(QLatin1Char('#'))) {
+        if (errorString) {
+            *errorString = ref + QStringLiteral(": only local references are supported");
+        }
+        return kInvalidNode;
+    }
+    if (m_resolving.contains(ref)) {
+        if (errorString) {
+            *errorString = ref + QStringLiteral(": circular reference");
+        }
+        return kInvalidNode;
+    }
+
+    QJsonValue target = m_root;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QStringList tokens = ref.mid(1).split(QLatin1Char('/'), Qt::SkipEmptyParts);
+#else
+    const QStringList tokens = ref.mid(1).split(QLatin1Char('/'), QString::SkipEmptyParts);
+#endif
+    for (const QString &token : tokens) {
+        QString name = unescapePointerToken(token);
+        if (target.isObject()) {
+            target = target.toObject().value(name);
+        } else if (target.isArray()) {
+            target = target.toArray().at(name.toInt());
+        } else {
+            target = QJsonValue(QJsonValue::Undefined);
+        }
+        if (target.isUndefined()) {
+            if (errorString) {
+                *errorString = ref + QStringLiteral(": unresolved reference");
+            }
+            return kInvalidNode;
+        }
+    }
+
+    m_resolving.insert(ref);
+    int index = compileValue(target, ref, errorString);
+    m_resolving.remove(ref);
+    return index;
+}
+
+bool JsonSchema::compileNode(const QJsonObject &schema, const QString &pointer, Node *node, QString *errorString) {
+    for (const char *keyword : kUnsupportedKeywords) {
+        if (schema.contains(QLatin1String(keyword))) {
+            if (errorString) {
+                *errorString = QStringLiteral("%1: unsupported keyword %2").arg(pointer, QLatin1String(keyword));
+            }
+            return false;
+        }
+    }
+
+    // type
+    QJsonValue type = schema.value(QLatin1String("type"));
+    if (!type.isUndefined()) {
+        QJsonArray types = type.isArray() ? type.toArray() : QJsonArray{type};
+        node->types = 0;
+        for (const QJsonValue &name : types) {
+            static const QHash<QString, int> kTypes = {{QStringLiteral("null"), NullType},
+                                                       {QStringLiteral("boolean"), BooleanType},
+                                                       {QStringLiteral("integer"), IntegerType},
+                                                       {QStringLiteral("number"), NumberType},
+                                                       {QStringLiteral("string"), StringType},
+                                                       {QStringLiteral("array"), ArrayType},
+                                                       {QStringLiteral("object"), ObjectType}};
+            int flag = kTypes.value(name.toString());
+            if (!flag) {
+                if (errorString) {
+                    *errorString = pointer + QStringLiteral(": invalid type ") + name.toString();
+                }
+                return false;
+            }
+            node->types |= flag;
+        }
+    }
+
+    // enum & const
+    if (schema.contains(QLatin1String("enum"))) {
+        node->enumValues = m_enums.size();
+        m_enums.append(schema.value(QLatin1String("enum")).toArray());
+    } else if (schema.contains(QLatin1String("const"))) {
+        node->enumValues = m_enums.size();
+        m_enums.append(QJsonArray{schema.value(QLatin1String("const"))});
+    }
+
+    // numbers
+    QJsonValue value = schema.value(QLatin1String("minimum"));
+    if (value.isDouble()) {
+        node->checks |= Minimum;
+        node->minimum = value.toDouble();
+    }
+    value = schema.value(QLatin1String("maximum"));
+    if (value.isDouble()) {
+        node->checks |= Maximum;
+        node->maximum = value.toDouble();
+    }
+    value = schema.value(QLatin1String("exclusiveMinimum"));
+    if (value.isDouble()) {
+        node->checks |= ExclusiveMinimum;
+        node->exclusiveMinimum = value.toDouble();
+    } else if (value.toBool() && (node->checks & Minimum)) {
+        // draft 4: boolean modifier of minimum
+        node->checks = (node->checks & ~Minimum) | ExclusiveMinimum;
+        node->exclusiveMinimum = node->minimum;
+    }
+    value = schema.value(QLatin1String("exclusiveMaximum"));
+    if (value.isDouble()) {
+        node->checks |= ExclusiveMaximum;
+        node->exclusiveMaximum = value.toDouble();
+    } else if (value.toBool() && (node->checks & Maximum)) {
+        node->checks = (node->checks & ~Maximum) | ExclusiveMaximum;
+        node->exclusiveMaximum = node->maximum;
+    }
+    value = schema.value(QLatin1String("multipleOf"));
+    if (value.isDouble() && value.toDouble() > 0) {
+        node->checks |= MultipleOf;
+        node->multipleOf = value.toDouble();
+    }
+
+    // sizes
+    if (readCount(schema, "minLength", &node->minLength)) {
+        node->checks |= MinLength;
+    }
+    if (readCount(schema, "maxLength", &node->maxLength)) {
+        node->checks |= MaxLength;
+    }
+    if (readCount(schema, "minItems", &node->minItems)) {
+        node->checks |= MinItems;
+    }
+    if (readCount(schema, "maxItems", &node->maxItems)) {
+        node->checks |= MaxItems;
+    }
+    if (readCount(schema, "minProperties", &node->minProperties)) {
+        node->checks |= MinProperties;
+    }
+    if (readCount(schema, "maxProperties", &node->maxProperties)) {
+        node->checks |= MaxProperties;
+    }
+
+    // pattern
+    value = schema.value(QLatin1String("pattern"));
+    if (value.isString()) {
+        QRegularExpression pattern(value.toString());
+        if (!pattern.isValid()) {
+            if (errorString) {
+                *errorString = pointer + QStringLiteral(": invalid pattern: ") + pattern.errorString();
+            }
+            return false;
+        }
+        pattern.optimize();
+        node->pattern = m_patterns.size();
+        m_patterns.append(pattern);
+    }
+
+    // array items
+    value = schema.value(QLatin1String("items"));
+    if (value.isArray()) {
+        if (errorString) {
+            *errorString = pointer + QStringLiteral(": tuple validation with an items array is not supported");
+        }
+        return false;
+    }
+    if (!value.isUndefined()) {
+        node->items = compileValue(value, pointer + QStringLiteral("/items"), errorString);
+        if (node->items == kInvalidNode) {
+            return false;
+        }
+    }
+
+    // object properties: sub-schemas are compiled first, since they append their own properties to the table
+    QVector<Property> properties;
+    QJsonObject       propertySchemas = schema.value(QLatin1String("properties")).toObject();
+    for (auto it = propertySchemas.constBegin(); it != propertySchemas.constEnd(); ++it) {
+        int child = compileValue(it.value(), pointer + QStringLiteral("/properties/") + escapePointerToken(it.key()),
+                                 errorString);
+        if (child == kInvalidNode) {
+            return false;
+        }
+        properties.append(Property{it.key(), child, false});
+    }
+
+    value = schema.value(QLatin1String("additionalProperties"));
+    if (!value.isUndefined()) {
+        node->additionalProperties =
+            compileValue(value, pointer + QStringLiteral("/additionalProperties"), errorString);
+        if (node->additionalProperties == kInvalidNode) {
+            return false;
+        }
+    }
+
+    value = schema.value(QLatin1String("required"));
+    if (value.isArray()) {
+        for (const QJsonValue &name : value.toArray()) {
+            auto property = std::find_if(properties.begin(), properties.end(),
+                                         [&name](const Property &p) { return p.name == name.toString(); });
+            if (property != properties.end()) {
+                property->required = true;
+            } else {
+                // a required property without own schema is an additional property
+                properties.append(Property{name.toString(), node->additionalProperties, true});
+            }
+        }
+    }
+
+    std::sort(properties.begin(), properties.end(),
+              [](const Property &a, const Property &b) { return a.name < b.name; });
+    node->propertyBegin = m_properties.size();
+    node->propertyCount = properties.size();
+    for (const Property &property : properties) {
+        if (property.required) {
+            node->requiredCount++;
+        }
+        m_properties.append(property);
+    }
+
+    return true;
+}
+
+int JsonSchema::findProperty(const Node &node, const QString &name) const {
+    auto begin = m_properties.constBegin() + node.propertyBegin;
+    auto end = begin + node.propertyCount;
+    auto it = std::lower_bound(begin, end, name, [](const Property &p, const QString &n) { return p.name < n; });
+    if (it == end || it->name != name) {
+        return -1;
+    }
+    return static_cast<int>(it - m_properties.constBegin());
+}
+
+bool JsonSchema::validate(const QJsonValue &value, Error *error) const {
+    return validateNode(m_rootNode, value, error);
+}
+
+bool JsonSchema::validateNode(int index, const QJsonValue &value, Error *error) const {
+    if (index == AnyNode) {
+        return true;
+    }
+    if (index == NoNode) {
+        return fail(error, "false", QStringLiteral("Value is not allowed"));
+    }
+
+    const Node &node = m_nodes.at(index);
+    switch (value.type()) {
+        case QJsonValue::Null:
+            if (!(node.types & NullType)) {
+                return fail(error, "type", QStringLiteral("Unexpected null value"));
+            }
+            break;
+        case QJsonValue::Bool:
+            if (!(node.types & BooleanType)) {
+                return fail(error, "type", QStringLiteral("Unexpected boolean value"));
+            }
+            break;
+        case QJsonValue::Double: {
+            double number = value.toDouble();
+            bool   integral = std::isfinite(number) && std::floor(number) == number;
+            if (!(node.types & NumberType) && !(integral && (node.types & IntegerType))) {
+                return fail(error, "type",
+                            (node.types & IntegerType) ? QStringLiteral("Expected an integer value")
+                                                       : QStringLiteral("Unexpected number value"));
+            }
+            if (!node.checks) {
+                break;
+            }
+            if ((node.checks & Minimum) && number < node.minimum) {
+                return fail(error, "minimum", QStringLiteral("Value must be >= %1").arg(node.minimum));
+            }
+            if ((node.checks & ExclusiveMinimum) && number <= node.exclusiveMinimum) {
+                return fail(error, "exclusiveMinimum", QStringLiteral("Value must be > %1").arg(node.exclusiveMinimum));
+            }
+            if ((node.checks & Maximum) && number > node.maximum) {
+                return fail(error, "maximum", QStringLiteral("Value must be <= %1").arg(node.maximum));
+            }
+            if ((node.checks & ExclusiveMaximum) && number >= node.exclusiveMaximum) {
+                return fail(error, "exclusiveMaximum", QStringLiteral("Value must be < %1").arg(node.exclusiveMaximum));
+            }
+            if (node.checks & MultipleOf) {
+                double quotient = number / node.multipleOf;
+                if (std::fabs(quotient - std::round(quotient)) > 1e-9) {
+                    return fail(error, "multipleOf",
+                                QStringLiteral("Value must be a multiple of %1").arg(node.multipleOf));
+                }
+            }
+            break;
+        }
+        case QJsonValue::String: {
+            if (!(node.types & StringType)) {
+                return fail(error, "type", QStringLiteral("Unexpected string value"));
+            }
+            if (!(node.checks & (MinLength | MaxLength)) && node.pattern < 0) {
+                break;
+            }
+            QString string = value.toString();
+            if (node.checks & (MinLength | MaxLength)) {
+                int length = codePointLength(string);
+                if ((node.checks & MinLength) && length < node.minLength) {
+                    return fail(error, "minLength", QStringLiteral("String must have at least %1 characters")
+                                                        .arg(node.minLength));
+                }
+                if ((node.checks & MaxLength) && length > node.maxLength) {
+                    return fail(error, "maxLength", QStringLiteral("String must have at most %1 characters")
+                                                        .arg(node.maxLength));
+                }
+            }
+            if (node.pattern >= 0 && !m_patterns.at(node.pattern).match(string).hasMatch()) {
+                return fail(error, "pattern", QStringLiteral("String doesn't match pattern %1")
+                                                  .arg(m_patterns.at(node.pattern).pattern()));
+            }
+            break;
+        }
+        case QJsonValue::Array: {
+            if (!(node.types & ArrayType)) {
+                return fail(error, "type", QStringLiteral("Unexpected array value"));
+            }
+            QJsonArray array = value.toArray();
+            if ((node.checks & MinItems) && array.size() < node.minItems) {
+                return fail(error, "minItems", QStringLiteral("Array must have at least %1 items").arg(node.minItems));
+            }
+            if ((node.checks & MaxItems) && array.size() > node.maxItems) {
+                return fail(error, "maxItems", QStringLiteral("Array must have at most %1 items").arg(node.maxItems));
+            }
+            if (node.items != AnyNode) {
+                for (int i = 0; i < array.size(); i++) {
+                    if (!validateNode(node.items, array.at(i), error)) {
+                        prependPath(error, QString::number(i));
+                        return false;
+                    }
+                }
+            }
+            break;
+        }
+        case QJsonValue::Object: {
+            if (!(node.types & ObjectType)) {
+                return fail(error, "type", QStringLiteral("Unexpected object value"));
+            }
+            QJsonObject object = value.toObject();
+            if ((node.checks & MinProperties) && object.size() < node.minProperties) {
+                return fail(error, "minProperties",
+                            QStringLiteral("Object must have at least %1 properties").arg(node.minProperties));
+            }
+            if ((node.checks & MaxProperties) && object.size() > node.maxProperties) {
+                return fail(error, "maxProperties",
+                            QStringLiteral("Object must have at most %1 properties").arg(node.maxProperties));
+            }
+            int required = 0;
+            for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+                const QString key = it.key();
+                int           property = findProperty(node, key);
+                int           child = node.additionalProperties;
+                if (property >= 0) {
+                    const Property &p = m_properties.at(property);
+                    if (p.required) {
+                        required++;
+                    }
+                    child = p.node;
+                } else if (child == NoNode) {
+                    fail(error, "additionalProperties", QStringLiteral("Property is not allowed"));
+                    prependPath(error, key);
+                    return false;
+                }
+                if (!validateNode(child, it.value(), error)) {
+                    prependPath(error, key);
+                    return false;
+                }
+            }
+            if (required < node.requiredCount) {
+                // slow path: find the first missing property for the error message
+                for (int i = node.propertyBegin; i < node.propertyBegin + node.propertyCount; i++) {
+                    const Property &p = m_properties.at(i);
+                    if (p.required && !object.contains(p.name)) {
+                        return fail(error, "required", QStringLiteral("Missing required property %1").arg(p.name));
+                    }
+                }
+            }
+            break;
+        }
+        case QJsonValue::Undefined:
+            return true;
+    }
+
+    if (node.enumValues >= 0 && !m_enums.at(node.enumValues).contains(value)) {
+        return fail(error, "enum", QStringLiteral("Value is not allowed"));
+    }
+    return true;
+}
+
+}  // namespace QWsEngine
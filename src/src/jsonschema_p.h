@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QRegularExpression>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+namespace QWsEngine {
+
+/**
+ * @brief Flat validation program compiled from a JSON schema.
+ *
+ * Every (sub-)schema is compiled into a node with a bit mask of the allowed types and the constraints to check.
+ * Nodes reference their sub-schemas by index and keep their object properties in a sorted table. Local `$ref`
+ * references are resolved at compile time, including recursive ones.
+ *
+ * Validation walks the payload once: each object member is looked up with a binary search in the property table of
+ * the node, the validation cost therefore depends on the payload size and not on the number of schema properties.
+ *
+ * Supported keywords: type, enum, const, $ref, properties, required, additionalProperties, minProperties,
+ * maxProperties, items, minItems, maxItems, minLength, maxLength, pattern, minimum, maximum, exclusiveMinimum,
+ * exclusiveMaximum (draft 4 and draft 6 style) and multipleOf. Annotations and unknown keywords are ignored. Schemas
+ * with the unsupported combinators or conditional keywords, e.g. anyOf, fail to compile.
+ */
+class JsonSchema {
+ public:
+    // special node indexes for the `true` and `false` schemas
+    static const int AnyNode = -1;
+    static const int NoNode = -2;
+
+    struct Error {
+        // JSON pointer to the invalid value
+        QString path;
+        // schema keyword which failed
+        QString keyword;
+        QString message;
+    };
+
+    JsonSchema();
+
+    /**
+     * @brief Compile the schema. Returns false and the reason in errorString if the schema is invalid or unsupported.
+     */
+    bool compile(const QJsonObject &schema, QString *errorString);
+
+    bool validate(const QJsonValue &value, Error *error) const;
+
+ private:
+    enum TypeFlag {
+        NullType = 0x01,
+        BooleanType = 0x02,
+        IntegerType = 0x04,
+        NumberType = 0x08,
+        StringType = 0x10,
+        ArrayType = 0x20,
+        ObjectType = 0x40,
+        AllTypes = 0x7f
+    };
+
+    enum Check {
+        Minimum = 0x0001,
+        ExclusiveMinimum = 0x0002,
+        Maximum = 0x0004,
+        ExclusiveMaximum = 0x0008,
+        MultipleOf = 0x0010,
+        MinLength = 0x0020,
+        MaxLength = 0x0040,
+        MinItems = 0x0080,
+        MaxItems = 0x0100,
+        MinProperties = 0x0200,
+        MaxProperties = 0x0400
+    };
+
+    struct Property {
+        QString name;
+        int     node;
+        bool    required;
+    };
+
+    struct Node {
+        int    types = AllTypes;
+        int    checks = 0;
+        double minimum = 0;
+        double exclusiveMinimum = 0;
+        double maximum = 0;
+        double exclusiveMaximum = 0;
+        double multipleOf = 0;
+        int    minLength = 0;
+        int    maxLength = 0;
+        int    minItems = 0;
+        int    maxItems = 0;
+        int    minProperties = 0;
+        int    maxProperties = 0;
+        // range in the property table
+        int propertyBegin = 0;
+        int propertyCount = 0;
+        int requiredCount = 0;
+        int additionalProperties = AnyNode;
+        int items = AnyNode;
+        // index of the pattern or the enum values, -1 if not set
+        int pattern = -1;
+        int enumValues = -1;
+    };
+
+    int  compileValue(const QJsonValue &schema, const QString &pointer, QString *errorString);
+    int  compileRef(const QString &ref, QString *errorString);
+    bool compileNode(const QJsonObject &schema, const QString &pointer, Node *node, QString *errorString);
+    int  findProperty(const Node &node, const QString &name) const;
+    bool validateNode(int index, const QJsonValue &value, Error *error) const;
+
+    QVector<Node>               m_nodes;
+    QVector<Property>           m_properties;
+    QVector<QRegularExpression> m_patterns;
+    QVector<QJsonArray>         m_enums;
+    int                         m_rootNode;
+
+    // only used while compiling
+    QJsonObject         m_root;
+    QHash<QString, int> m_compiled;
+    QSet<QString>       m_resolving;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/jsonwriter.h>
+
+#include <QLocale>
+
+#include <cmath>
+#include <cstring>
+
+#include "bufferpool_p.h"
+
+namespace QWsEngine {
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+inline void appendEscaped(QByteArray *buffer, uint c) {
+    switch (c) {
+        case '"':
+            buffer->append("\\\"", 2);
+            break;
+        case '\\':
+            buffer->append("\\\\", 2);
+            break;
+        case '\n':
+            buffer->append("\\n", 2);
+            break;
+        case '\r':
+            buffer->append("\\r", 2);
+            break;
+        case '\t':
+            buffer->append("\\t", 2);
+            break;
+        case '\b':
+            buffer->append("\\b", 2);
+            break;
+        case '\f':
+            buffer->append("\\f", 2);
+            break;
+        default: {
+            char escaped[6] = {'\\', 'u', '0', '0', kHexDigits[(c >> 4) & 0xf], kHexDigits[c & 0xf]};
+            buffer->append(escaped, 6);
+        }
+    }
+}
+
+inline bool needsEscape(uint c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+inline void appendUtf8(QByteArray *buffer, const QChar *unicode, int size) {
+    if (size == 0) {
+        return;
+    }
+    int offset = buffer->size();
+    buffer->resize(offset + utf8Length(unicode, size));
+    encodeUtf8(unicode, size, reinterpret_cast<uchar *>(buffer->data() + offset));
+}
+
+}  // namespace
+
+JsonWriter::JsonWriter(int reserve) : m_afterKey(false) {
+    m_buffer.reserve(reserve);
+}
+
+void JsonWriter::clear() {
+    // the buffer keeps its capacity since it has been reserved
+    m_buffer.resize(0);
+    m_firstElement.clear();
+    m_afterKey = false;
+}
+
+void JsonWriter::separator() {
+    if (m_afterKey) {
+        m_afterKey = false;
+        return;
+    }
+    if (!m_firstElement.isEmpty()) {
+        if (m_firstElement.last()) {
+            m_firstElement.last() = false;
+        } else {
+            m_buffer.append(',');
+        }
+    }
+}
+
+JsonWriter &JsonWriter::beginObject() {
+    separator();
+    m_buffer.append('{');
+    m_firstElement.append(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+    m_buffer.append('}');
+    if (!m_firstElement.isEmpty()) {
+        m_firstElement.removeLast();
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray() {
+    separator();
+    m_buffer.append('[');
+    m_firstElement.append(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+    m_buffer.append(']');
+    if (!m_firstElement.isEmpty()) {
+        m_firstElement.removeLast();
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(const char *key) {
+    separator();
+    appendString(key, static_cast<int>(strlen(key)));
+    m_buffer.append(':');
+    m_afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(QLatin1String key) {
+    separator();
+    appendString(key);
+    m_buffer.append(':');
+    m_afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(const QString &key) {
+    separator();
+    appendString(key.constData(), key.size());
+    m_buffer.append(':');
+    m_afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *value) {
+    separator();
+    appendString(value, static_cast<int>(strlen(value)));
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(QLatin1String value) {
+    separator();
+    appendString(value);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const QString &value) {
+    separator();
+    appendString(value.constData(), value.size());
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(bool value) {
+    separator();
+    if (value) {
+        m_buffer.append("true", 4);
+    } else {
+        m_buffer.append("false", 5);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(int value) {
+    separator();
+    m_buffer.append(QByteArray::number(value));
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(qint64 value) {
+    separator();
+    m_buffer.append(QByteArray::number(value));
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(double value) {
+    separator();
+    if (std::isfinite(value)) {
+        m_buffer.append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+    } else {
+        // JSON has no representation for NaN and infinity
+        m_buffer.append("null", 4);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::nullValue() {
+    separator();
+    m_buffer.append("null", 4);
+    return *this;
+}
+
+JsonWriter &JsonWriter::rawValue(const QByteArray &json) {
+    separator();
+    m_buffer.append(json);
+    return *this;
+}
+
+void JsonWriter::appendString(const char *utf8, int size) {
+    m_buffer.append('"');
+    int start = 0;
+    for (int i = 0; i < size; i++) {
+        uchar c = static_cast<uchar>(utf8[i]);
+        if (needsEscape(c)) {
+            m_buffer.append(utf8 + start, i - start);
+            appendEscaped(&m_buffer, c);
+            start = i + 1;
+        }
+    }
+    m_buffer.append(utf8 + start, size - start);
+    m_buffer.append('"');
+}
+
+void JsonWriter::appendString(QLatin1String latin1) {
+    // Latin-1 characters above 0x7f need a UTF-8 multi-byte sequence
+    m_buffer.append('"');
+    for (int i = 0; i < latin1.size(); i++) {
+        uchar c = static_cast<uchar>(latin1.data()[i]);
+        if (c >= 0x80) {
+            m_buffer.append(static_cast<char>(0xc0 | (c >> 6)));
+            m_buffer.append(static_cast<char>(0x80 | (c & 0x3f)));
+        } else if (needsEscape(c)) {
+            appendEscaped(&m_buffer, c);
+        } else {
+            m_buffer.append(static_cast<char>(c));
+        }
+    }
+    m_buffer.append('"');
+}
+
+void JsonWriter::appendString(const QChar *unicode, int size) {
+    m_buffer.append('"');
+    // characters to escape are ASCII and never part of a surrogate pair: the runs in between are encoded as a whole
+    int start = 0;
+    for (int i = 0; i < size; i++) {
+        uint c = unicode[i].unicode();
+        if (needsEscape(c)) {
+            appendUtf8(&m_buffer, unicode + start, i - start);
+            appendEscaped(&m_buffer, c);
+            start = i + 1;
+        }
+    }
+    appendUtf8(&m_buffer, unicode + start, size - start);
+    m_buffer.append('"');
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/mappedfile.h>
+
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWeakPointer>
+
+#include "wslogging_p.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace QWsEngine {
+
+// canonical file path -> mapping, entries of released mappings are replaced on the next open()
+static QMutex                                   g_mappingsMutex;
+static QHash<QString, QWeakPointer<MappedFile>> g_mappings;
+
+// inode of a file, a replaced file has the same path but a different inode
+static quint64 fileInode(const QString &path) {
+#ifdef Q_OS_UNIX
+    struct stat info;
+    if (::stat(QFile::encodeName(path).constData(), &info) == 0) {
+        return static_cast<quint64>(info.st_ino);
+    }
+#else
+    Q_UNUSED(path)
+#endif
+    return 0;
+}
+
+MappedFile::MappedFile(const QString &fileName) : m_file(fileName), m_data(nullptr), m_size(0), m_inode(0) {}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        m_file.unmap(m_data);
+    }
+}
+
+QSharedPointer<MappedFile> MappedFile::open(const QString &fileName) {
+    const QString path = QFileInfo(fileName).canonicalFilePath();
+    if (path.isEmpty()) {
+        qCWarning(wsEngine) << "File not found:" << fileName;
+        return QSharedPointer<MappedFile>();
+    }
+
+    const QFileInfo info(path);
+    const quint64   inode = fileInode(path);
+
+    QMutexLocker               locker(&g_mappingsMutex);
+    QSharedPointer<MappedFile> mapping = g_mappings.value(path).toStrongRef();
+    if (mapping) {
+        if (mapping->m_size == info.size() && mapping->m_modified == info.lastModified() && mapping->m_inode == inode) {
+            return mapping;
+        }
+        // streams of the previous mapping keep it, new ones get the current file
+        qCDebug(wsEngine) << "File changed since it was mapped:" << path;
+    }
+
+    mapping = QSharedPointer<MappedFile>(new MappedFile(path));
+    if (!mapping->m_file.open(QIODevice::ReadOnly)) {
+        qCWarning(wsEngine) << "Cannot open file" << path << ":" << mapping->m_file.errorString();
+        return QSharedPointer<MappedFile>();
+    }
+    mapping->m_size = mapping->m_file.size();
+    mapping->m_modified = info.lastModified();
+    mapping->m_inode = inode;
+    // an empty file can't be mapped but is still a valid stream
+    if (mapping->m_size > 0) {
+        mapping->m_data = mapping->m_file.map(0, mapping->m_size);
+        if (!mapping->m_data) {
+            qCWarning(wsEngine) << "Cannot map file" << path << ":" << mapping->m_file.errorString();
+            return QSharedPointer<MappedFile>();
+        }
+    }
+
+    // drop entries of released mappings
+    for (auto it = g_mappings.begin(); it != g_mappings.end();) {
+        if (it.value().isNull()) {
+            it = g_mappings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    g_mappings.insert(path, mapping);
+    return mapping;
+}
+
+bool MappedFile::isTruncated() const {
+#ifdef Q_OS_UNIX
+    // the open file, not the path: a file replaced by a rename keeps the mapped inode alive
+    struct stat info;
+    return ::fstat(m_file.handle(), &info) == 0 && info.st_size < m_size;
+#else
+    // Windows doesn't allow truncating a mapped file
+    return false;
+#endif
+}
+
+}  // namespace QWsEngine
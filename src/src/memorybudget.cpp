@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/connection.h>
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+#include "connection_p.h"
+#include "memorybudget_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+MemoryAccount::MemoryAccount(MemoryBudgetPrivate *budget, const QSharedPointer<Connection> &connection)
+    : connectionId(connection->id()), connection(connection), m_budget(budget) {}
+
+void MemoryAccount::detach() {
+    MemoryBudgetPrivate *budget = m_budget.fetchAndStoreOrdered(nullptr);
+    if (budget) {
+        budget->account(-total());
+    }
+}
+
+void MemoryAccount::apply(qint64 delta) {
+    MemoryBudgetPrivate *budget = m_budget.load();
+    if (delta != 0 && budget) {
+        budget->account(delta);
+    }
+}
+
+MemoryBudgetPrivate::MemoryBudgetPrivate(MemoryBudget *budget)
+    : QObject(budget),
+      maxBytes(0),
+      pauseThreshold(0.8),
+      rejectThreshold(0.9),
+      resumeThreshold(0.7),
+      level(MemoryBudget::Normal),
+      accepting(1),
+      anyPaused(false),
+      q(budget) {
+    checkTimer.setInterval(100);
+    connect(&checkTimer, &QTimer::timeout, this, &MemoryBudgetPrivate::evaluate);
+    checkTimer.start();
+}
+
+void MemoryBudgetPrivate::updateLimits() {
+    pauseBytes.store(static_cast<qint64>(maxBytes * pauseThreshold));
+    rejectBytes.store(static_cast<qint64>(maxBytes * rejectThreshold));
+    resumeBytes.store(static_cast<qint64>(maxBytes * resumeThreshold));
+}
+
+void MemoryBudgetPrivate::addConnection(const QSharedPointer<Connection> &connection) {
+    QSharedPointer<MemoryAccount> memoryAccount = QSharedPointer<MemoryAccount>::create(this, connection);
+    {
+        QMutexLocker locker(&mutex);
+        accounts.insert(memoryAccount->connectionId, memoryAccount);
+    }
+    ConnectionPrivate::get(connection.data())->setMemoryAccount(memoryAccount);
+}
+
+void MemoryBudgetPrivate::removeConnection(Connection *connection) {
+    QSharedPointer<MemoryAccount> memoryAccount;
+    {
+        QMutexLocker locker(&mutex);
+        memoryAccount = accounts.take(connection->id());
+    }
+    if (memoryAccount) {
+        memoryAccount->detach();
+    }
+}
+
+void MemoryBudgetPrivate::account(qint64 delta) {
+    qint64 total = used.fetchAndAddRelaxed(delta) + delta;
+    // only the first update crossing the threshold schedules an evaluation, the flag is reset by evaluate()
+    if (delta > 0 && total > pauseBytes.load() && evaluationScheduled.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(this, "evaluate", Qt::QueuedConnection);
+    }
+}
+
+QVector<AccountUsage> MemoryBudgetPrivate::sortedAccounts() const {
+    QVector<AccountUsage> result;
+    {
+        QMutexLocker locker(&mutex);
+        result.reserve(accounts.size());
+        for (const auto &memoryAccount : accounts) {
+            AccountUsage usage;
+            usage.account = memoryAccount;
+            usage.total = memoryAccount->total();
+            result.append(usage);
+        }
+    }
+    // sort by the snapshot: the counters keep changing in the connection threads
+    std::sort(result.begin(), result.end(),
+              [](const AccountUsage &a, const AccountUsage &b) { return a.total > b.total; });
+    return result;
+}
+
+void MemoryBudgetPrivate::evaluate() {
+    evaluationScheduled.storeRelease(0);
+
+    const qint64 usage = used.load();
+    MemoryBudget::Level newLevel = MemoryBudget::Normal;
+    if (maxBytes > 0) {
+        if (usage >= maxBytes) {
+            newLevel = MemoryBudget::Closing;
+        } else if (usage >= rejectBytes.load()) {
+            newLevel = MemoryBudget::Rejecting;
+        } else if (usage >= pauseBytes.load()) {
+            newLevel = MemoryBudget::Pausing;
+        }
+    }
+
+    accepting.storeRelease(newLevel < MemoryBudget::Rejecting ? 1 : 0);
+
+    // nothing to shed and nothing to resume: skip iterating the connections
+    if (newLevel == MemoryBudget::Normal && !anyPaused) {
+        if (level.load() != MemoryBudget::Normal) {
+            level.store(newLevel);
+            qCInfo(wsEngine) << "Memory usage back to normal:" << usage << "bytes";
+            emit q->levelChanged(newLevel);
+        }
+        return;
+    }
+
+    const QVector<AccountUsage> sorted = sortedAccounts();
+
+    if (usage < resumeBytes.load() || maxBytes <= 0) {
+        for (const auto &entry : sorted) {
+            entry.account->paused.storeRelease(0);
+        }
+        anyPaused = false;
+    } else if (newLevel >= MemoryBudget::Pausing) {
+        // pause the heaviest connections until they hold at least the excess over the pause threshold
+        const qint64 excess = usage - pauseBytes.load();
+        qint64       pausedBytes = 0;
+        for (const auto &entry : sorted) {
+            if (entry.account->isPaused()) {
+                pausedBytes += entry.total;
+            }
+        }
+        for (const auto &entry : sorted) {
+            if (pausedBytes >= excess) {
+                break;
+            }
+            if (!entry.account->isPaused()) {
+                entry.account->paused.storeRelease(1);
+                pausedBytes += entry.total;
+                anyPaused = true;
+                qCDebug(wsEngine) << "Pausing connection" << entry.account->connectionId << "holding" << entry.total
+                                  << "bytes";
+            }
+        }
+    }
+
+    if (newLevel == MemoryBudget::Closing) {
+        // close the worst offenders until the usage is projected below the reject threshold
+        qint64 projected = usage;
+        for (const auto &entry : sorted) {
+            if (projected < rejectBytes.load()) {
+                break;
+            }
+            projected -= entry.total;
+            if (!entry.account->closing.testAndSetOrdered(0, 1)) {
+                continue;  // already closing
+            }
+            QSharedPointer<Connection> connection = entry.account->connection.toStrongRef();
+            if (!connection) {
+                continue;
+            }
+            qCWarning(wsEngine) << "Memory budget exceeded, closing connection" << entry.account->connectionId
+                                << "holding" << entry.total << "bytes";
+            Connection *target = connection.data();
+            ConnectionPrivate::invokeOnOwnerThread(connection, [target]() {
+                target->close(CloseCodeTryAgainLater, QStringLiteral("Server busy"));
+            });
+        }
+    }
+
+    if (level.load() != newLevel) {
+        level.store(newLevel);
+        if (newLevel == MemoryBudget::Normal) {
+            qCInfo(wsEngine) << "Memory usage back to normal:" << usage << "bytes";
+        } else {
+            qCWarning(wsEngine) << "Memory budget level" << newLevel << "usage:" << usage << "of" << maxBytes
+                                << "bytes";
+        }
+        emit q->levelChanged(newLevel);
+    }
+}
+
+MemoryBudget::MemoryBudget(qint64 maxBytes, QObject *parent) : QObject(parent), d(new MemoryBudgetPrivate(this)) {
+    d->maxBytes = maxBytes;
+    d->updateLimits();
+}
+
+MemoryBudget::~MemoryBudget() {}
+
+void MemoryBudget::setMaxBytes(qint64 maxBytes) {
+    d->maxBytes = maxBytes;
+    d->updateLimits();
+    d->evaluate();
+}
+
+qint64 MemoryBudget::maxBytes() const {
+    return d->maxBytes;
+}
+
+void MemoryBudget::setPauseThreshold(double fraction) {
+    d->pauseThreshold = fraction;
+    d->updateLimits();
+}
+
+double MemoryBudget::pauseThreshold() const {
+    return d->pauseThreshold;
+}
+
+void MemoryBudget::setRejectThreshold(double fraction) {
+    d->rejectThreshold = fraction;
+    d->updateLimits();
+}
+
+double MemoryBudget::rejectThreshold() const {
+    return d->rejectThreshold;
+}
+
+void MemoryBudget::setResumeThreshold(double fraction) {
+    d->resumeThreshold = fraction;
+    d->updateLimits();
+}
+
+double MemoryBudget::resumeThreshold() const {
+    return d->resumeThreshold;
+}
+
+void MemoryBudget::setCheckInterval(int ms) {
+    d->checkTimer.setInterval(ms);
+}
+
+int MemoryBudget::checkInterval() const {
+    return d->checkTimer.interval();
+}
+
+qint64 MemoryBudget::usedBytes() const {
+    return d->used.load();
+}
+
+MemoryBudget::Level MemoryBudget::level() const {
+    return static_cast<Level>(d->level.load());
+}
+
+bool MemoryBudget::isAcceptingConnections() const {
+    return d->accepting.loadAcquire() != 0;
+}
+
+QVector<MemoryBudget::ConnectionUsage> MemoryBudget::heaviestConnections(int count) const {
+    const QVector<AccountUsage> sorted = d->sortedAccounts();
+
+    QVector<ConnectionUsage> result;
+    result.reserve(qMin(count, sorted.size()));
+    for (int i = 0; i < sorted.size() && i < count; i++) {
+        const MemoryAccount *memoryAccount = sorted[i].account.data();
+        ConnectionUsage      usage;
+        usage.connectionId = memoryAccount->connectionId;
+        usage.inboundBytes = memoryAccount->inbound.load();
+        usage.outboundBytes = memoryAccount->outbound.load();
+        usage.paused = memoryAccount->isPaused();
+        result.append(usage);
+    }
+    return result;
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/memorybudget.h>
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+#include <QWeakPointer>
+#include <QtWebSockets/QWebSocketProtocol>
+
+namespace QWsEngine {
+
+class Connection;
+class MemoryBudgetPrivate;
+
+/**
+ * @brief Memory held by a single connection.
+ *
+ * The byte counts are only updated from the thread owning the connection, the budget reads them from its own thread.
+ */
+class MemoryAccount {
+ public:
+    MemoryAccount(MemoryBudgetPrivate *budget, const QSharedPointer<Connection> &connection);
+
+    void setInbound(qint64 bytes) { apply(bytes - inbound.fetchAndStoreRelaxed(bytes)); }
+    void addInbound(qint64 bytes) {
+        inbound.fetchAndAddRelaxed(bytes);
+        apply(bytes);
+    }
+    void setOutbound(qint64 bytes) { apply(bytes - outbound.fetchAndStoreRelaxed(bytes)); }
+
+    qint64 total() const { return inbound.load() + outbound.load(); }
+    bool   isPaused() const { return paused.loadAcquire() != 0; }
+
+    /**
+     * @brief Release the accounted bytes from the budget. Later updates are ignored.
+     */
+    void detach();
+
+    const quint64                  connectionId;
+    const QWeakPointer<Connection> connection;
+    QAtomicInteger<qint64>         inbound;
+    QAtomicInteger<qint64>         outbound;
+    QAtomicInt                     paused;
+    QAtomicInt                     closing;
+
+ private:
+    void apply(qint64 delta);
+
+    QAtomicPointer<MemoryBudgetPrivate> m_budget;
+};
+
+struct AccountUsage {
+    QSharedPointer<MemoryAccount> account;
+    qint64                        total;
+};
+
+class MemoryBudgetPrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit MemoryBudgetPrivate(MemoryBudget *budget);
+
+    static MemoryBudgetPrivate *get(MemoryBudget *budget) { return budget->d; }
+
+    // 1013 "Try Again Later", not part of QWebSocketProtocol::CloseCode
+    static const QWebSocketProtocol::CloseCode CloseCodeTryAgainLater =
+        static_cast<QWebSocketProtocol::CloseCode>(1013);
+
+    /**
+     * @brief Account the memory of a new connection. Must be called from the thread owning the connection.
+     */
+    void addConnection(const QSharedPointer<Connection> &connection);
+    void removeConnection(Connection *connection);
+
+    /**
+     * @brief Update the total and schedule an evaluation if the pause threshold is exceeded. Thread-safe.
+     */
+    void account(qint64 delta);
+
+    /**
+     * @brief Compare the usage with the thresholds and shed load. Called in the budget's thread.
+     */
+    Q_INVOKABLE void evaluate();
+
+    void updateLimits();
+
+    qint64 maxBytes;
+    double pauseThreshold;
+    double rejectThreshold;
+    double resumeThreshold;
+    QTimer checkTimer;
+
+    // limits in bytes, read from the connection threads
+    QAtomicInteger<qint64> pauseBytes;
+    QAtomicInteger<qint64> rejectBytes;
+    QAtomicInteger<qint64> resumeBytes;
+
+    QAtomicInteger<qint64> used;
+    QAtomicInt             level;
+    QAtomicInt             accepting;
+    QAtomicInt             evaluationScheduled;
+    bool                   anyPaused;
+
+    mutable QMutex                                mutex;
+    QHash<quint64, QSharedPointer<MemoryAccount>> accounts;
+
+    /**
+     * @brief Snapshot of all accounts, heaviest first. Thread-safe.
+     */
+    QVector<AccountUsage> sortedAccounts() const;
+
+ private:
+    MemoryBudget *const q;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QAtomicPointer>
+
+namespace QWsEngine {
+
+/**
+ * @brief Intrusive lock-free multi-producer single-consumer queue.
+ *
+ * Based on Dmitry Vyukov's intrusive MPSC node-based queue. Nodes must provide a
+ * `QAtomicPointer<T> next` member and be default constructible for the internal stub node.
+ * push() may be called from any thread, pop() only from the single consumer thread.
+ * The queue does not own the nodes: the consumer is responsible for deleting popped nodes.
+ */
+template <typename T>
+class MpscQueue {
+ public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub) { m_stub.next.store(nullptr); }
+
+    /**
+     * @brief Append a node. Wait-free, safe to call from any thread.
+     */
+    void push(T *node) {
+        node->next.store(nullptr);
+        T *prev = m_head.fetchAndStoreOrdered(node);
+        prev->next.storeRelease(node);
+    }
+
+    /**
+     * @brief Remove the oldest node, or nullptr if the queue is empty.
+     *
+     * May also return nullptr if a producer is in the middle of a push. The producer's wakeup logic must therefore
+     * re-schedule a drain after its push completed.
+     */
+    T *pop() {
+        T *tail = m_tail;
+        T *next = tail->next.loadAcquire();
+        if (tail == &m_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->next.loadAcquire();
+        }
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        if (tail != m_head.loadAcquire()) {
+            return nullptr;
+        }
+        push(&m_stub);
+        next = tail->next.loadAcquire();
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+ private:
+    Q_DISABLE_COPY(MpscQueue)
+
+    QAtomicPointer<T> m_head;
+    T *               m_tail;
+    T                 m_stub;
+};
+
+}  // namespace QWsEngine
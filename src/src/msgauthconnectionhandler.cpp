@@ -46,7 +46,7 @@ QSharedPointer<Connection> MsgAuthConnectionHandler::createConnection(QWebSocket
     auto conn = QSharedPointer<Connection>::create(socket, messageHandler(), false);
     conn->sendAuthRequired();
 
-    qCDebug(wsEngine) << "Created new Connection for:" << socket->peerAddress().toString();
+    qCDebug(wsEngine) << "Created new Connection for:" << socketClientAddress(socket);
     // Don't hold a strong reference to the connection: the client might disconnect before the timeout.
     // If there's still a strong reference the connection object won't be deleted
     QWeakPointer<Connection> weakConn = conn.toWeakRef();
@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <algorithm>
+
+#include "pathtrie_p.h"
+
+namespace QWsEngine {
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+static const Qt::SplitBehavior SkipEmptySegments = Qt::SkipEmptyParts;
+#else
+static const QString::SplitBehavior SkipEmptySegments = QString::SkipEmptyParts;
+#endif
+
+static bool segmentLess(const QPair<QString, int> &child, const QStringRef &segment) {
+    return QStringRef(&child.first) < segment;
+}
+
+PathTrie::PathTrie() : m_nodes(1), m_empty(true) {}
+
+int PathTrie::child(int node, const QStringRef &segment) const {
+    const QVector<QPair<QString, int>> &children = m_nodes.at(node).children;
+
+    auto it = std::lower_bound(children.constBegin(), children.constEnd(), segment, segmentLess);
+    if (it != children.constEnd() && QStringRef(&it->first) == segment) {
+        return it->second;
+    }
+    return -1;
+}
+
+int PathTrie::addChild(int node, const QString &segment) {
+    int existing = child(node, QStringRef(&segment));
+    if (existing >= 0) {
+        return existing;
+    }
+    int index = m_nodes.size();
+    m_nodes.append(Node());
+
+    QVector<QPair<QString, int>> &children = m_nodes[node].children;
+
+    auto it = std::lower_bound(children.begin(), children.end(), QStringRef(&segment), segmentLess);
+    children.insert(it, qMakePair(segment, index));
+    return index;
+}
+
+void PathTrie::insert(const QString &pattern, int route) {
+    const QStringList segments = pattern.split(QLatin1Char('/'), SkipEmptySegments);
+    QStringList       parameterNames;
+
+    int node = 0;
+    for (int i = 0; i < segments.size(); i++) {
+        const QString &segment = segments.at(i);
+        if (segment == QLatin1String("*") && i == segments.size() - 1) {
+            m_nodes[node].prefixRoute = route;
+            m_parameterNames.insert(route, parameterNames);
+            m_empty = false;
+            return;
+        }
+        if (segment.size() > 2 && segment.startsWith(QLatin1Char('{')) && segment.endsWith(QLatin1Char('}'))) {
+            if (m_nodes.at(node).parameterChild < 0) {
+                int index = m_nodes.size();
+                m_nodes.append(Node());
+                m_nodes[node].parameterChild = index;
+            }
+            node = m_nodes.at(node).parameterChild;
+            parameterNames.append(segment.mid(1, segment.size() - 2));
+        } else {
+            node = addChild(node, segment);
+        }
+    }
+    m_nodes[node].route = route;
+    m_parameterNames.insert(route, parameterNames);
+    m_empty = false;
+}
+
+bool PathTrie::matchNode(int node, const QVector<QStringRef> &segments, int index, QVector<QStringRef> *values,
+                         Match *match) const {
+    const Node &current = m_nodes.at(node);
+    if (index == segments.size()) {
+        if (current.route >= 0) {
+            match->route = current.route;
+            return true;
+        }
+        if (current.prefixRoute >= 0) {
+            match->route = current.prefixRoute;
+            return true;
+        }
+        return false;
+    }
+
+    int exact = child(node, segments.at(index));
+    if (exact >= 0 && matchNode(exact, segments, index + 1, values, match)) {
+        return true;
+    }
+    if (current.parameterChild >= 0) {
+        values->append(segments.at(index));
+        if (matchNode(current.parameterChild, segments, index + 1, values, match)) {
+            return true;
+        }
+        values->removeLast();
+    }
+    if (current.prefixRoute >= 0) {
+        match->route = current.prefixRoute;
+        return true;
+    }
+    return false;
+}
+
+bool PathTrie::match(const QString &path, Match *match) const {
+    if (m_empty) {
+        return false;
+    }
+    const QVector<QStringRef> segments = path.splitRef(QLatin1Char('/'), SkipEmptySegments);
+    // values of the parameter segments on the path to the matched route
+    QVector<QStringRef> values;
+    if (!matchNode(0, segments, 0, &values, match)) {
+        return false;
+    }
+
+    const QStringList names = m_parameterNames.value(match->route);
+    for (int i = 0; i < names.size() && i < values.size(); i++) {
+        match->parameters.insert(names.at(i), values.at(i).toString());
+    }
+    return true;
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QStringRef>
+#include <QVector>
+
+namespace QWsEngine {
+
+/**
+ * @brief Compiled path routing trie.
+ *
+ * Route patterns consist of `/` separated segments:
+ * - exact segments, e.g. `/devices`
+ * - parameter segments, e.g. `/{id}`, matching any single segment and capturing it with the given name. The names
+ *   belong to the route: `/a/{id}` and `/a/{name}/x` share the parameter node but capture `id` and `name`
+ * - a trailing `*` segment, e.g. `/static/*`, matching the prefix and any path below it
+ *
+ * Exact segments take precedence over parameter segments, which take precedence over prefix routes. Matching cost
+ * depends on the number of path segments, not on the number of routes.
+ */
+class PathTrie {
+ public:
+    struct Match {
+        int                     route = -1;
+        QHash<QString, QString> parameters;
+    };
+
+    PathTrie();
+
+    /**
+     * @brief Insert a route pattern with the given route index. An existing route with the same pattern is replaced.
+     */
+    void insert(const QString &pattern, int route);
+
+    bool isEmpty() const { return m_empty; }
+
+    /**
+     * @brief Find the route of the given path. Returns false if no route matches.
+     */
+    bool match(const QString &path, Match *match) const;
+
+ private:
+    struct Node {
+        // exact child segments, sorted for a binary search without creating temporary strings
+        QVector<QPair<QString, int>> children;
+        int                          parameterChild = -1;
+        int                          route = -1;
+        int                          prefixRoute = -1;
+    };
+
+    int  child(int node, const QStringRef &segment) const;
+    int  addChild(int node, const QString &segment);
+    bool matchNode(int node, const QVector<QStringRef> &segments, int index, QVector<QStringRef> *values,
+                   Match *match) const;
+
+    QVector<Node> m_nodes;
+    // route index -> names of the parameter segments in path order
+    QHash<int, QStringList> m_parameterNames;
+    bool                    m_empty;
+};
+
+}  // namespace QWsEngine
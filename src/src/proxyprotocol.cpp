@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <QList>
+#include <QtEndian>
+
+#include <cstring>
+
+#include "proxyprotocol_p.h"
+
+namespace QWsEngine {
+
+static const char V1Signature[] = "PROXY ";
+static const int  V1SignatureSize = 6;
+static const int  V1MaxSize = 107;
+
+static const char V2Signature[] = "\x0D\x0A\x0D\x0A\x00\x0D\x0A\x51\x55\x49\x54\x0A";
+static const int  V2SignatureSize = 12;
+static const int  V2HeaderSize = 16;
+
+const int ProxyProtocol::MinHeaderSize;
+const int ProxyProtocol::MaxHeaderSize;
+const int ProxyProtocol::DefaultMaxHeaderSize;
+
+/**
+ * @brief Returns true if data starts with the signature, or with a prefix of it if data is shorter.
+ */
+static bool startsWithSignature(const QByteArray &data, const char *signature, int size) {
+    return std::memcmp(data.constData(), signature, static_cast<size_t>(qMin(data.size(), size))) == 0;
+}
+
+ProxyProtocol::Result ProxyProtocol::parse(const QByteArray &data, int versions, int maxHeaderSize, Header *header) {
+    if (data.isEmpty()) {
+        return Incomplete;
+    }
+    if ((versions & V2) && startsWithSignature(data, V2Signature, V2SignatureSize)) {
+        return parseV2(data, maxHeaderSize, header);
+    }
+    if ((versions & V1) && startsWithSignature(data, V1Signature, V1SignatureSize)) {
+        return parseV1(data, header);
+    }
+    return Invalid;
+}
+
+ProxyProtocol::Result ProxyProtocol::parseV1(const QByteArray &data, Header *header) {
+    // PROXY TCP4 <src> <dst> <sport> <dport>\r\n
+    int end = data.indexOf("\r\n");
+    if (end < 0) {
+        return data.size() < V1MaxSize ? Incomplete : Invalid;
+    }
+    if (end + 2 > V1MaxSize) {
+        return Invalid;
+    }
+
+    const QList<QByteArray> fields = data.left(end).split(' ');
+    header->length = end + 2;
+    if (fields.size() >= 2 && fields.at(1) == "UNKNOWN") {
+        header->hasAddress = false;
+        return Complete;
+    }
+    if (fields.size() != 6 || (fields.at(1) != "TCP4" && fields.at(1) != "TCP6")) {
+        return Invalid;
+    }
+
+    QHostAddress address;
+    bool         ok = false;
+    uint         port = fields.at(4).toUInt(&ok);
+    if (!ok || port > 0xFFFF || !address.setAddress(QString::fromLatin1(fields.at(2)))) {
+        return Invalid;
+    }
+    header->hasAddress = true;
+    header->sourceAddress = address;
+    header->sourcePort = static_cast<quint16>(port);
+    return Complete;
+}
+
+ProxyProtocol::Result ProxyProtocol::parseV2(const QByteArray &data, int maxHeaderSize, Header *header) {
+    if (data.size() < V2HeaderSize) {
+        return Incomplete;
+    }
+    const uchar *raw = reinterpret_cast<const uchar *>(data.constData());
+    quint8       versionCommand = raw[12];
+    quint8       family = raw[13];
+    int          addressLength = qFromBigEndian<quint16>(raw + 14);
+
+    if ((versionCommand & 0xF0) != 0x20 || V2HeaderSize + addressLength > maxHeaderSize) {
+        return Invalid;
+    }
+    if (data.size() < V2HeaderSize + addressLength) {
+        return Incomplete;
+    }
+    header->length = V2HeaderSize + addressLength;
+    header->hasAddress = false;
+
+    // LOCAL command: connection established by the proxy itself
+    if ((versionCommand & 0x0F) == 0x00) {
+        return Complete;
+    }
+    if ((versionCommand & 0x0F) != 0x01) {
+        return Invalid;
+    }
+
+    const uchar *addresses = raw + V2HeaderSize;
+    switch (family >> 4) {
+        case 0x1:  // AF_INET
+            if (addressLength < 12) {
+                return Invalid;
+            }
+            header->sourceAddress = QHostAddress(qFromBigEndian<quint32>(addresses));
+            header->sourcePort = qFromBigEndian<quint16>(addresses + 8);
+            header->hasAddress = true;
+            break;
+        case 0x2:  // AF_INET6
+            if (addressLength < 36) {
+                return Invalid;
+            }
+            header->sourceAddress = QHostAddress(addresses);
+            header->sourcePort = qFromBigEndian<quint16>(addresses + 32);
+            header->hasAddress = true;
+            break;
+        default:
+            // AF_UNSPEC or AF_UNIX: no usable client address
+            break;
+    }
+    return Complete;
+}
+
+}  // namespace QWsEngine
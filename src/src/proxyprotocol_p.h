@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QByteArray>
+#include <QHostAddress>
+
+namespace QWsEngine {
+
+/**
+ * @brief Parser for the HAProxy PROXY protocol header, version 1 (text) and 2 (binary).
+ *
+ * See https://www.haproxy.org/download/2.0/doc/proxy-protocol.txt
+ */
+class ProxyProtocol {
+ public:
+    enum Version { V1 = 0x1, V2 = 0x2 };
+
+    enum Result {
+        /// More data is required.
+        Incomplete,
+        /// Not a valid or not an accepted PROXY protocol header.
+        Invalid,
+        /// The header has been parsed.
+        Complete
+    };
+
+    struct Header {
+        int length = 0;
+        // false for LOCAL (v2) or UNKNOWN (v1) connections, e.g. health checks: the socket address is to be used
+        bool         hasAddress = false;
+        QHostAddress sourceAddress;
+        quint16      sourcePort = 0;
+    };
+
+    /**
+     * @brief Parse the PROXY protocol header at the start of data.
+     *
+     * @param versions accepted protocol versions, a combination of Version values.
+     * @param maxHeaderSize v2 headers with a larger address block, i.e. with more TLVs, are invalid.
+     */
+    static Result parse(const QByteArray &data, int versions, int maxHeaderSize, Header *header);
+
+    // protocol limits: v1 is limited to 107 bytes, v2 to 16 bytes plus the address block with optional TLVs
+    static const int MinHeaderSize = 107;
+    static const int MaxHeaderSize = 16 + 0xFFFF;
+    // large enough for the addresses and the common TLVs of load balancers
+    static const int DefaultMaxHeaderSize = 1024;
+
+ private:
+    static Result parseV1(const QByteArray &data, Header *header);
+    static Result parseV2(const QByteArray &data, int maxHeaderSize, Header *header);
+};
+
+}  // namespace QWsEngine
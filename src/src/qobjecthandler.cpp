@@ -21,20 +21,67 @@
  */
 
 #include <qwsengine/connection.h>
+#include <qwsengine/jsonwriter.h>
 #include <qwsengine/qobjecthandler.h>
 
+#include <QFutureWatcher>
 #include <QGenericArgument>
+#include <QJsonObject>
 #include <QMetaMethod>
 
+#include "connection_p.h"
+#include "handler_p.h"
 #include "qobjecthandler_p.h"
+#include "stallwatchdog_p.h"
+#include "tracerecorder_p.h"
+#include "wslogging_p.h"
 
 namespace QWsEngine {
 
-QObjectHandlerPrivate::QObjectHandlerPrivate(QObjectHandler *handler) : QObject(handler), q(handler) {}
+QObjectHandlerPrivate::QObjectHandlerPrivate(QObjectHandler *handler)
+    : QObject(handler), threadPool(nullptr), maxInFlight(16), reqIdFieldName("req_id"), q(handler) {}
 
 QObjectHandler::QObjectHandler(QObject *parent) : Handler(parent), d(new QObjectHandlerPrivate(this)) {}
 
+QObjectHandlerSnapshot::QObjectHandlerSnapshot(const QObjectHandlerSnapshot &other)
+    : QSharedData(other), map(other.map) {
+    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+        if (!it->oldSlot && it->slot.slotObj) {
+            it->slot.slotObj->ref();
+        }
+    }
+}
+
+QObjectHandlerSnapshot::~QObjectHandlerSnapshot() {
+    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+        release(*it);
+    }
+}
+
+void QObjectHandlerSnapshot::insert(const QString &name, const QObjectHandlerPrivate::Method &method) {
+    remove(name);
+    map.insert(name, method);
+}
+
+void QObjectHandlerSnapshot::remove(const QString &name) {
+    auto it = map.find(name);
+    if (it != map.end()) {
+        release(*it);
+        map.erase(it);
+    }
+}
+
+void QObjectHandlerSnapshot::release(const QObjectHandlerPrivate::Method &method) {
+    if (!method.oldSlot && method.slot.slotObj) {
+        method.slot.slotObj->destroyIfLastRef();
+    }
+}
+
 void QObjectHandlerPrivate::invokeSlot(QSharedPointer<Connection> connection, const QVariant &message, Method m) {
+    if (Q_UNLIKELY(StallWatchdogPrivate::enabled.load()) && m.receiver) {
+        StallWatchdogPrivate::setHandler(m.receiver->metaObject()->className());
+    }
+
     // Invoke the slot
     if (m.oldSlot) {
         // Obtain the slot index
@@ -55,7 +102,8 @@ void QObjectHandlerPrivate::invokeSlot(QSharedPointer<Connection> connection, co
 
         // Invoke the method
         // TODO(zehnm) old slot code not yet tested !!!
-        if (!m.receiver->metaObject()->method(index).invoke(m.receiver, Q_ARG(QSharedPointer<Connection>, connection),
+        if (!m.receiver->metaObject()->method(index).invoke(m.receiver, Qt::DirectConnection,
+                                                            Q_ARG(QSharedPointer<Connection>, connection),
                                                             Q_ARG(QVariant, message))) {
             connection->sendErrorResponse(500);
             return;
@@ -69,24 +117,168 @@ void QObjectHandlerPrivate::invokeSlot(QSharedPointer<Connection> connection, co
     }
 }
 
+void QObjectHandlerPrivate::dispatchToThreadPool(
+    QSharedPointer<Connection> connection, const QVariant &message,
+    const QExplicitlySharedDataPointer<const QObjectHandlerSnapshot> &snapshot, Method m) {
+    QThreadPool *  pool = threadPool ? threadPool : QThreadPool::globalInstance();
+    auto           executor = ConnectionPrivate::get(connection.data())->serialExecutor(pool);
+    const QVariant ownedMessage = detachedMessage(message);
+
+    // the task doesn't refer to the handler, which may be destroyed while the task is queued
+    bool queued = executor->tryExecute(
+        [connection, ownedMessage, snapshot, m]() mutable {
+            invokeSlot(connection, ownedMessage, m);
+            // never release the last reference on a pool thread: the connection must be deleted on its own thread
+            ConnectionPrivate::invokeOnOwnerThread(connection);
+        },
+        maxInFlight);
+
+    if (!queued) {
+        qCDebug(wsEngine) << "Too many messages in flight:" << executor->inFlight();
+        connection->sendErrorResponse(429, "Too many requests");
+    }
+}
+
+/**
+ * @brief Write the common part of a result reply: `{"type": "result", "req_id": 1, "success": ...`
+ */
+static void beginResult(JsonWriter *json, const QString &reqIdFieldName, const QJsonValue &reqId, bool success) {
+    json->beginObject().field("type", "result");
+    if (reqId.isDouble()) {
+        json->key(reqIdFieldName).value(static_cast<qint64>(reqId.toDouble()));
+    }
+    json->field("success", success);
+}
+
+static void sendErrorResult(Connection *connection, const QString &reqIdFieldName, const QJsonValue &reqId, int code,
+                            const QString &errorMsg) {
+    JsonWriter json;
+    beginResult(&json, reqIdFieldName, reqId, false);
+    json.key("error").beginObject().field("code", code).field("message", errorMsg).endObject().endObject();
+    connection->sendJson(json);
+}
+
+void QObjectHandlerPrivate::invokeAsync(const QSharedPointer<Connection> &connection, const QVariant &message,
+                                        const Method &m) {
+    ConnectionPrivate *connectionPrivate = ConnectionPrivate::get(connection.data());
+    const QJsonValue   reqId = message.toJsonObject().value(reqIdFieldName);
+
+    if (maxInFlight > 0 && connectionPrivate->pendingReplies.size() >= maxInFlight) {
+        qCDebug(wsEngine) << "Too many pending replies:" << connectionPrivate->pendingReplies.size();
+        sendErrorResult(connection.data(), reqIdFieldName, reqId, 429, "Too many requests");
+        return;
+    }
+
+    QFuture<QByteArray> future = m.async(connection, detachedMessage(message));
+
+    // The watcher is a child of the connection: no reference keeps the connection alive while the work is pending,
+    // and a destroyed connection cancels the future, see ConnectionPrivate::~ConnectionPrivate().
+    auto        watcher = new QFutureWatcher<QByteArray>(connection.data());
+    Connection *target = connection.data();
+    // the handler may be gone when the future finishes
+    const QString fieldName = reqIdFieldName;
+    QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, [watcher, target, fieldName, reqId]() {
+        ConnectionPrivate::get(target)->pendingReplies.removeOne(watcher);
+        watcher->deleteLater();
+
+        QFuture<QByteArray> result = watcher->future();
+        if (result.isCanceled() || result.resultCount() == 0) {
+            sendErrorResult(target, fieldName, reqId, 500, "Request canceled");
+            return;
+        }
+        JsonWriter json;
+        beginResult(&json, fieldName, reqId, true);
+        const QByteArray msgData = result.result();
+        if (!msgData.isEmpty()) {
+            json.key("msg_data").rawValue(msgData);
+        }
+        json.endObject();
+        target->sendJson(json);
+    });
+    connectionPrivate->pendingReplies.append(watcher);
+    watcher->setFuture(future);
+}
+
 void QObjectHandler::process(QSharedPointer<Connection> connection, const QString &msgName, const QVariant &message) {
+    auto snapshot = d->snapshot.load();
+
     // Ensure the method has been registered
-    if (!d->map.contains(msgName)) {
+    auto it = snapshot->map.constFind(msgName);
+    if (it == snapshot->map.constEnd()) {
         connection->sendErrorResponse(404);
         return;
     }
 
-    QObjectHandlerPrivate::Method m = d->map.value(msgName);
+    QObjectHandlerPrivate::Method m = *it;
+
+    QWSENGINE_TRACE_MESSAGE(Dispatch, connection->id(), qHash(msgName));
+    if (m.async) {
+        d->invokeAsync(connection, message, m);
+    } else if (m.policy == ThreadPoolExecution) {
+        d->dispatchToThreadPool(connection, message, snapshot, m);
+    } else {
+        d->invokeSlot(connection, message, m);
+    }
+}
+
+void QObjectHandler::setExecutionPolicy(const QString &name, ExecutionPolicy policy) {
+    if (!d->snapshot.load()->map.contains(name)) {
+        qCWarning(wsEngine) << "Cannot set execution policy of unregistered message:" << name;
+        return;
+    }
+    d->snapshot.update([&name, policy](QObjectHandlerSnapshot *next) {
+        auto it = next->map.find(name);
+        if (it != next->map.end()) {
+            it->policy = policy;
+        }
+    });
+}
+
+QObjectHandler::ExecutionPolicy QObjectHandler::executionPolicy(const QString &name) const {
+    return d->snapshot.load()->map.value(name).policy;
+}
+
+void QObjectHandler::setThreadPool(QThreadPool *pool) {
+    d->threadPool = pool;
+}
+
+QThreadPool *QObjectHandler::threadPool() const {
+    return d->threadPool ? d->threadPool : QThreadPool::globalInstance();
+}
+
+void QObjectHandler::setMaxInFlightMessages(int max) {
+    d->maxInFlight = max;
+}
+
+int QObjectHandler::maxInFlightMessages() const {
+    return d->maxInFlight;
+}
+
+void QObjectHandler::setReqIdFieldName(const QString &fieldName) {
+    d->reqIdFieldName = fieldName;
+}
+
+QString QObjectHandler::reqIdFieldName() const {
+    return d->reqIdFieldName;
+}
 
-    d->invokeSlot(connection, message, m);
+void QObjectHandler::registerAsyncMessage(const QString &name, const AsyncFunction &function) {
+    QObjectHandlerPrivate::Method m(function);
+    d->snapshot.update([&name, &m](QObjectHandlerSnapshot *next) { next->insert(name, m); });
 }
 
 void QObjectHandler::registerMessage(const QString &name, QObject *receiver, const char *method) {
-    d->map.insert(name, QObjectHandlerPrivate::Method(receiver, method));
+    QObjectHandlerPrivate::Method m(receiver, method);
+    d->snapshot.update([&name, &m](QObjectHandlerSnapshot *next) { next->insert(name, m); });
+}
+
+void QObjectHandler::unregisterMessage(const QString &name) {
+    d->snapshot.update([&name](QObjectHandlerSnapshot *next) { next->remove(name); });
 }
 
 void QObjectHandler::registerMessageImpl(const QString &name, QObject *receiver, QtPrivate::QSlotObjectBase *slotObj) {
-    d->map.insert(name, QObjectHandlerPrivate::Method(receiver, slotObj));
+    QObjectHandlerPrivate::Method m(receiver, slotObj);
+    d->snapshot.update([&name, &m](QObjectHandlerSnapshot *next) { next->insert(name, m); });
 }
 
 }  // namespace QWsEngine
@@ -22,15 +22,21 @@
 
 #pragma once
 
-#include <QMap>
+#include <qwsengine/qobjecthandler.h>
+
+#include <QHash>
 #include <QObject>
 #include <QRegExp>
+#include <QSharedData>
 #include <QSharedPointer>
+#include <QThreadPool>
+
+#include "snapshot_p.h"
 
 namespace QWsEngine {
 
 class Connection;
-class QObjectHandler;
+class QObjectHandlerSnapshot;
 
 class QObjectHandlerPrivate : public QObject {
     Q_OBJECT
@@ -43,13 +49,21 @@ class QObjectHandlerPrivate : public QObject {
 
     class Method {
      public:
-        Method() {}
-        Method(QObject *receiver, const char *method) : receiver(receiver), oldSlot(true), slot(method) {}
+        Method() : receiver(nullptr), oldSlot(false), policy(QObjectHandler::DirectExecution) {}
+        Method(QObject *receiver, const char *method)
+            : receiver(receiver), oldSlot(true), policy(QObjectHandler::DirectExecution), slot(method) {}
         Method(QObject *receiver, QtPrivate::QSlotObjectBase *slotObj)
-            : receiver(receiver), oldSlot(false), slot(slotObj) {}
+            : receiver(receiver), oldSlot(false), policy(QObjectHandler::DirectExecution), slot(slotObj) {}
+        explicit Method(const QObjectHandler::AsyncFunction &function)
+            : receiver(nullptr),
+              oldSlot(false),
+              policy(QObjectHandler::DirectExecution),
+              slot(static_cast<QtPrivate::QSlotObjectBase *>(nullptr)),
+              async(function) {}
 
-        QObject *receiver;
-        bool     oldSlot;
+        QObject *                       receiver;
+        bool                            oldSlot;
+        QObjectHandler::ExecutionPolicy policy;
         union slot {
             slot() {}
             slot(const char *method) : method(method) {}
@@ -57,14 +71,58 @@ class QObjectHandlerPrivate : public QObject {
             const char *                method;
             QtPrivate::QSlotObjectBase *slotObj;
         } slot;
+        // set for asynchronous methods, which have no slot
+        QObjectHandler::AsyncFunction async;
     };
 
-    void invokeSlot(QSharedPointer<QWsEngine::Connection> connection, const QVariant &message, Method m);
+    static void invokeSlot(QSharedPointer<QWsEngine::Connection> connection, const QVariant &message, Method m);
+
+    /**
+     * @brief Invoke the slot with the connection's serial executor on the thread pool.
+     *
+     * The snapshot is kept until the slot has been invoked, which keeps the slot object alive. The queued task doesn't
+     * refer to the handler. The receiver must outlive the queued tasks, see QObjectHandler::setExecutionPolicy().
+     */
+    void dispatchToThreadPool(QSharedPointer<QWsEngine::Connection> connection, const QVariant &message,
+                              const QExplicitlySharedDataPointer<const QObjectHandlerSnapshot> &snapshot, Method m);
+
+    /**
+     * @brief Invoke an asynchronous method and send the reply when its future finishes.
+     */
+    void invokeAsync(const QSharedPointer<QWsEngine::Connection> &connection, const QVariant &message,
+                     const Method &m);
 
-    QMap<QString, Method> map;
+    SnapshotPointer<QObjectHandlerSnapshot> snapshot;
+    QThreadPool *                           threadPool;
+    int                                     maxInFlight;
+    QString                                 reqIdFieldName;
 
  private:
     QObjectHandler *const q;
 };
 
+/**
+ * @brief Immutable snapshot of the registered messages.
+ *
+ * Each snapshot holds a reference to the slot objects of its methods, a slot object is destroyed with the last
+ * snapshot using it.
+ */
+class QObjectHandlerSnapshot : public QSharedData {
+ public:
+    QObjectHandlerSnapshot() {}
+    QObjectHandlerSnapshot(const QObjectHandlerSnapshot &other);
+    ~QObjectHandlerSnapshot();
+
+    /**
+     * @brief Insert or replace a method, releasing the replaced slot object.
+     */
+    void insert(const QString &name, const QObjectHandlerPrivate::Method &method);
+    void remove(const QString &name);
+
+    QHash<QString, QObjectHandlerPrivate::Method> map;
+
+ private:
+    static void release(const QObjectHandlerPrivate::Method &method);
+};
+
 }  // namespace QWsEngine
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/connection.h>
+#include <qwsengine/jsonwriter.h>
+#include <qwsengine/schemavalidationmiddleware.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+#include "schemavalidationmiddleware_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+SchemaValidationMiddlewarePrivate::SchemaValidationMiddlewarePrivate(SchemaValidationMiddleware *middleware)
+    : QObject(middleware), rejectUnknownMessages(false), reqIdFieldName("req_id"), q(middleware) {}
+
+void SchemaValidationMiddlewarePrivate::sendValidationError(const QSharedPointer<Connection> &connection,
+                                                            const QJsonObject &               message,
+                                                            const JsonSchema::Error &         error) {
+    JsonWriter json;
+    json.beginObject().field("type", "result").field("success", false);
+    QJsonValue reqId = message.value(reqIdFieldName);
+    if (reqId.isDouble()) {
+        json.key(reqIdFieldName).value(static_cast<qint64>(reqId.toDouble()));
+    }
+    json.key("error")
+        .beginObject()
+        .field("code", 400)
+        .field("message", error.message)
+        .field("path", error.path)
+        .field("keyword", error.keyword)
+        .endObject()
+        .endObject();
+    connection->sendJson(json);
+}
+
+SchemaValidationMiddleware::SchemaValidationMiddleware(QObject *parent)
+    : Middleware(parent), d(new SchemaValidationMiddlewarePrivate(this)) {}
+
+SchemaValidationMiddleware::~SchemaValidationMiddleware() {}
+
+QString SchemaValidationMiddleware::name() const {
+    return "SchemaValidation";
+}
+
+bool SchemaValidationMiddleware::addSchema(const QString &msgName, const QJsonObject &schema, QString *errorString) {
+    JsonSchema compiled;
+    if (!compiled.compile(schema, errorString)) {
+        qCWarning(wsEngine) << "Invalid schema for message" << msgName << ":" << (errorString ? *errorString : "");
+        return false;
+    }
+    d->schemas.insert(msgName, compiled);
+    return true;
+}
+
+bool SchemaValidationMiddleware::loadSchemas(const QString &directory, QString *errorString) {
+    QDir dir(directory);
+    if (!dir.exists()) {
+        if (errorString) {
+            *errorString = QStringLiteral("Schema directory doesn't exist: ") + directory;
+        }
+        return false;
+    }
+
+    for (const QFileInfo &info : dir.entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Name)) {
+        QFile file(info.absoluteFilePath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            if (errorString) {
+                *errorString = info.fileName() + ": " + file.errorString();
+            }
+            return false;
+        }
+        QJsonParseError parseError;
+        QJsonDocument   doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+            if (errorString) {
+                *errorString = info.fileName() + ": " + parseError.errorString();
+            }
+            return false;
+        }
+
+        QString error;
+        if (!addSchema(info.completeBaseName(), doc.object(), &error)) {
+            if (errorString) {
+                *errorString = info.fileName() + ": " + error;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+void SchemaValidationMiddleware::removeSchema(const QString &msgName) {
+    d->schemas.remove(msgName);
+}
+
+bool SchemaValidationMiddleware::hasSchema(const QString &msgName) const {
+    return d->schemas.contains(msgName);
+}
+
+QStringList SchemaValidationMiddleware::msgNames() const {
+    return d->schemas.keys();
+}
+
+void SchemaValidationMiddleware::setRejectUnknownMessages(bool reject) {
+    d->rejectUnknownMessages = reject;
+}
+
+bool SchemaValidationMiddleware::isRejectUnknownMessages() const {
+    return d->rejectUnknownMessages;
+}
+
+void SchemaValidationMiddleware::setReqIdFieldName(const QString &fieldName) {
+    d->reqIdFieldName = fieldName;
+}
+
+QString SchemaValidationMiddleware::reqIdFieldName() const {
+    return d->reqIdFieldName;
+}
+
+bool SchemaValidationMiddleware::process(QSharedPointer<Connection> connection, const QString &msgName,
+                                         const QVariant &message) {
+    if (message.type() != QMetaType::QJsonObject) {
+        // binary message, continue
+        return true;
+    }
+
+    auto schema = d->schemas.constFind(msgName);
+    if (schema == d->schemas.constEnd()) {
+        if (d->rejectUnknownMessages) {
+            connection->sendErrorResponse(400, "Unknown message");
+            return false;
+        }
+        return true;
+    }
+
+    QJsonObject       jsonMsg = message.toJsonObject();
+    JsonSchema::Error error;
+    if (!schema->validate(jsonMsg, &error)) {
+        qCDebug(wsEngine) << "Invalid message" << msgName << "at" << error.path << ":" << error.message;
+        d->sendValidationError(connection, jsonMsg, error);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/schemavalidationmiddleware.h>
+
+#include <QHash>
+#include <QObject>
+
+#include "jsonschema_p.h"
+
+namespace QWsEngine {
+
+class SchemaValidationMiddlewarePrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit SchemaValidationMiddlewarePrivate(SchemaValidationMiddleware *middleware);
+
+    /**
+     * @brief Send the structured 400 error response for an invalid message.
+     */
+    void sendValidationError(const QSharedPointer<Connection> &connection, const QJsonObject &message,
+                             const JsonSchema::Error &error);
+
+    QHash<QString, JsonSchema> schemas;
+    bool                       rejectUnknownMessages;
+    QString                    reqIdFieldName;
+
+ private:
+    SchemaValidationMiddleware *const q;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include "serialexecutor_p.h"
+
+namespace QWsEngine {
+
+class SerialExecutorRunnable : public QRunnable {
+ public:
+    explicit SerialExecutorRunnable(QSharedPointer<SerialExecutor> executor) : m_executor(executor) {
+        setAutoDelete(true);
+    }
+
+    void run() override { m_executor->runNext(); }
+
+ private:
+    QSharedPointer<SerialExecutor> m_executor;
+};
+
+SerialExecutor::SerialExecutor(QThreadPool *pool) : m_pool(pool), m_running(false) {
+    Q_ASSERT(pool);
+}
+
+bool SerialExecutor::tryExecute(const std::function<void()> &task, int maxInFlight) {
+    if (maxInFlight > 0 && m_inFlight.loadAcquire() >= maxInFlight) {
+        return false;
+    }
+    m_inFlight.ref();
+
+    QMutexLocker locker(&m_mutex);
+    m_tasks.enqueue(task);
+    if (!m_running) {
+        m_running = true;
+        locker.unlock();
+        schedule();
+    }
+    return true;
+}
+
+void SerialExecutor::schedule() {
+    m_pool->start(new SerialExecutorRunnable(sharedFromThis()));
+}
+
+void SerialExecutor::runNext() {
+    std::function<void()> task;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_tasks.isEmpty()) {
+            m_running = false;
+            return;
+        }
+        task = m_tasks.dequeue();
+    }
+
+    task();
+    task = nullptr;
+    m_inFlight.deref();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_tasks.isEmpty()) {
+        m_running = false;
+    } else {
+        locker.unlock();
+        schedule();
+    }
+}
+
+}  // namespace QWsEngine
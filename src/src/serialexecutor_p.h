@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QEnableSharedFromThis>
+#include <QMutex>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+#include <functional>
+
+namespace QWsEngine {
+
+/**
+ * @brief Executes tasks one after another on a thread pool.
+ *
+ * Each connection has its own serial executor to preserve the message order while the tasks of different connections
+ * run in parallel. A task is only bound to a pool thread while it runs, the next task is re-submitted to the pool to
+ * let other executors interleave.
+ */
+class SerialExecutor : public QEnableSharedFromThis<SerialExecutor> {
+ public:
+    explicit SerialExecutor(QThreadPool *pool);
+
+    /**
+     * @brief Queue a task for execution.
+     *
+     * Returns false without queuing the task if maxInFlight tasks are already queued or running.
+     * A value of 0 or less disables the bound.
+     */
+    bool tryExecute(const std::function<void()> &task, int maxInFlight);
+
+    /**
+     * @brief Number of queued and running tasks.
+     */
+    int inFlight() const { return m_inFlight.loadAcquire(); }
+
+ private:
+    Q_DISABLE_COPY(SerialExecutor)
+
+    void runNext();
+    void schedule();
+
+    QThreadPool *                   m_pool;
+    QMutex                          m_mutex;
+    QQueue<std::function<void()>>   m_tasks;
+    bool                            m_running;
+    QAtomicInt                      m_inFlight;
+
+    friend class SerialExecutorRunnable;
+};
+
+}  // namespace QWsEngine
@@ -2,18 +2,58 @@
 // SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
 
 #include <qwsengine/connectionhandler.h>
+#include <qwsengine/stallwatchdog.h>
 
 #include <QDebug>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QRandomGenerator>
+#endif
+
+#ifdef Q_OS_UNIX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
 
+#include "cluster_p.h"
 #include "connection_p.h"
+#include "memorybudget_p.h"
+#include "proxyprotocol_p.h"
 #include "server_p.h"
+#include "tracerecorder_p.h"
+#include "trafficcapture_p.h"
 #include "wslogging_p.h"
 
 namespace QWsEngine {
 
+static const int  ProxyHeaderTimeoutMs = 5000;
+static const char ProxyTimeoutTimerName[] = "qwsengine_proxyHeaderTimeout";
+
 ServerPrivate::ServerPrivate(Server *httpServer)
-    : QObject(httpServer), handler(nullptr), maxAllowedIncomingMessageSize(0), q(httpServer) {
+    : QObject(httpServer),
+      handler(nullptr),
+      maxAllowedIncomingMessageSize(0),
+      capture(nullptr),
+      cluster(nullptr),
+      stallWatchdog(nullptr),
+      memoryBudget(nullptr),
+      proxyProtocol(Server::NoProxyProtocol),
+      proxyMaxHeaderSize(ProxyProtocol::DefaultMaxHeaderSize),
+      proxyListener(nullptr),
+      // parented, so the timer is moved to the thread of a listener together with this object
+      drainTimer(this),
+      drainRequested(false),
+      draining(false),
+      pendingListenerDrains(0),
+      drainBatchSize(0),
+      drainDeadlineMs(0),
+      drainJitterMs(0),
+      q(httpServer) {
     connect(q, &QWebSocketServer::newConnection, this, &ServerPrivate::onNewConnection);
+    connect(&drainTimer, &QTimer::timeout, this, &ServerPrivate::onDrainTimeout);
 }
 
 void ServerPrivate::onNewConnection() {
@@ -21,6 +61,7 @@ void ServerPrivate::onNewConnection() {
     if (socket == nullptr) {
         return;  // should never happen, but safety first!
     }
+    QWSENGINE_TRACE(Handshake, 0, 0);
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
     if (maxAllowedIncomingMessageSize > 0) {
@@ -28,6 +69,22 @@ void ServerPrivate::onNewConnection() {
     }
 #endif
 
+    if (proxyProtocol) {
+        auto client = proxyClients.find(qMakePair(socket->peerAddress(), socket->peerPort()));
+        if (client != proxyClients.end()) {
+            socket->setProperty(ClientAddressProperty, client->first.toString());
+            socket->setProperty(ClientPortProperty, client->second);
+            proxyClients.erase(client);
+        }
+    }
+
+    if (memoryBudget && !memoryBudget->isAcceptingConnections()) {
+        qCWarning(wsEngine) << "Memory budget exceeded, refusing connection:" << socketClientAddress(socket);
+        socket->close(MemoryBudgetPrivate::CloseCodeTryAgainLater, "Server busy");
+        socket->deleteLater();
+        return;
+    }
+
     QString path = socket->requestUrl().path();
 
     if (handler) {
@@ -35,15 +92,25 @@ void ServerPrivate::onNewConnection() {
         // If the connection routing fails, it will be closed and disposed with deleteLater().
         auto conn = handler->route(socket, path);
         if (conn) {
-            qCDebug(wsEngine) << "Created new" << path << "client connection from:" << socket->peerAddress().toString()
-                              << socket->peerPort();
-            connect(this, &ServerPrivate::disconnectAllClients, conn.data(), &Connection::close);
-
+            qCDebug(wsEngine) << "Created new" << path << "client connection from:" << conn->clientAddress().toString()
+                              << conn->clientPort();
             connect(socket, &QWebSocket::disconnected, this, &ServerPrivate::socketDisconnected);
             connections.insert(socket, conn);
+            connectionCounter.ref();
+            QWSENGINE_TRACE(Accept, conn->id(), 0);
+            if (capture) {
+                capture->recordConnection(conn->id(), path, socket->request(), conn->isAuthenticated());
+                ConnectionPrivate::get(conn.data())->capture = capture;
+            }
+            if (cluster) {
+                ClusterPrivate::get(cluster)->addConnection(conn);
+            }
+            if (memoryBudget) {
+                MemoryBudgetPrivate::get(memoryBudget)->addConnection(conn);
+            }
         }
     } else {
-        qCWarning(wsEngine) << "No handler defined, closing connection:" << socket->peerAddress().toString() << path;
+        qCWarning(wsEngine) << "No handler defined, closing connection:" << socketClientAddress(socket) << path;
         // TODO(zehnm) correct close code? Check WS specs!
         socket->close(QWebSocketProtocol::CloseCodePolicyViolated, "Internal server error");
         socket->deleteLater();
@@ -55,17 +122,129 @@ void ServerPrivate::socketDisconnected() {
     if (!(socket && connections.contains(socket))) {
         return;
     }
-    qCDebug(wsEngine) << "Client disconnected, releasing connection:" << socket->peerAddress().toString()
-                      << socket->peerPort();
     auto conn = connections.take(socket);
+    qCDebug(wsEngine) << "Client disconnected, releasing connection:" << conn->clientAddress().toString()
+                      << conn->clientPort();
+    connectionCounter.deref();
+    QWSENGINE_TRACE(Close, conn->id(), static_cast<quint32>(socket->closeCode()));
+    if (capture) {
+        capture->recordClose(conn->id());
+    }
+    if (cluster) {
+        ClusterPrivate::get(cluster)->removeConnection(conn->id());
+    }
+    if (memoryBudget) {
+        MemoryBudgetPrivate::get(memoryBudget)->removeConnection(conn.data());
+    }
     // as soon as the last reference is released, the Connection object will be deleted including QWebSocket!
     conn.clear();
+
+    if (draining && connections.isEmpty()) {
+        finishDrain();
+    }
 }
 
 void ServerPrivate::onServerClosed() {
     // TODO(zehnm) flag? There might be use cases where the server must be closed
     // but the established connections have to stay alive
-    emit disconnectAllClients(QWebSocketProtocol::CloseCodeGoingAway);
+    closeAllConnections(QWebSocketProtocol::CloseCodeGoingAway);
+}
+
+void ServerPrivate::closeAllConnections(QWebSocketProtocol::CloseCode closeCode, const QString &reason) {
+    // closing a socket may synchronously emit disconnected, which modifies the connection map
+    const auto conns = connections.values();
+    for (const auto &conn : conns) {
+        conn->close(closeCode, reason);
+    }
+}
+
+QString ServerPrivate::drainCloseReason() const {
+    int delay = 0;
+    if (drainJitterMs > 0) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        delay = QRandomGenerator::global()->bounded(drainJitterMs + 1);
+#else
+        delay = qrand() % (drainJitterMs + 1);
+#endif
+    }
+    return QString("Server draining; retry-after-ms=%1").arg(delay);
+}
+
+void ServerPrivate::startDrain(int batchSize, int intervalMs, int deadlineMs, int reconnectJitterMs) {
+    if (drainRequested) {
+        return;
+    }
+    qCDebug(wsEngine) << "Draining" << connections.size() << "client connections";
+    drainRequested = true;
+
+    for (Server *listener : listeners) {
+        pendingListenerDrains++;
+        QMetaObject::invokeMethod(listener->d, "startDrain", Qt::QueuedConnection, Q_ARG(int, batchSize),
+                                  Q_ARG(int, intervalMs), Q_ARG(int, deadlineMs), Q_ARG(int, reconnectJitterMs));
+    }
+
+    // stop accepting new connections
+    if (proxyListener) {
+        proxyListener->close();
+    }
+    q->close();
+
+    if (connections.isEmpty()) {
+        finishDrain();
+        return;
+    }
+
+    draining = true;
+    drainBatchSize = qMax(1, batchSize);
+    drainDeadlineMs = qMax(0, deadlineMs);
+    drainJitterMs = qMax(0, reconnectJitterMs);
+    drainClock.start();
+    drainTimer.start(qMax(1, intervalMs));
+    onDrainTimeout();
+}
+
+void ServerPrivate::finishDrain() {
+    drainTimer.stop();
+    draining = false;
+    qCDebug(wsEngine) << "All client connections drained";
+    checkDrained();
+}
+
+void ServerPrivate::onListenerDrained() {
+    pendingListenerDrains--;
+    checkDrained();
+}
+
+void ServerPrivate::checkDrained() {
+    if (drainRequested && !draining && pendingListenerDrains <= 0) {
+        drainRequested = false;
+        emit q->drained();
+    }
+}
+
+void ServerPrivate::onDrainTimeout() {
+    if (drainClock.hasExpired(drainDeadlineMs)) {
+        qCDebug(wsEngine) << "Drain deadline reached, closing remaining connections:" << connections.size();
+        drainTimer.stop();
+        const auto conns = connections.values();
+        for (const auto &conn : conns) {
+            conn->close(QWebSocketProtocol::CloseCodeGoingAway, drainCloseReason());
+        }
+        return;
+    }
+
+    QList<QSharedPointer<Connection>> batch;
+    for (auto it = connections.constBegin(); it != connections.constEnd() && batch.size() < drainBatchSize; ++it) {
+        // skip connections already closing and connections with messages in flight
+        if (it.key()->state() != QAbstractSocket::ConnectedState || ConnectionPrivate::get(it->data())->inFlight()) {
+            continue;
+        }
+        batch.append(it.value());
+    }
+
+    for (const auto &conn : batch) {
+        conn->close(QWebSocketProtocol::CloseCodeGoingAway, drainCloseReason());
+    }
 }
 
 Server::Server(const QString &serverName, SslMode secureMode, QObject *parent)
@@ -76,7 +255,175 @@ Server::Server(ConnectionHandler *handler, const QString &serverName, SslMode se
     setHandler(handler);
 }
 
-Server::~Server() {}
+int ServerPrivate::createReusePortSocket(const QHostAddress &address, quint16 port, bool *unsupported) {
+    *unsupported = false;
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    bool ipv4 = address.protocol() == QAbstractSocket::IPv4Protocol;
+    bool anyIp = address.protocol() == QAbstractSocket::AnyIPProtocol;
+
+    int fd = ::socket(ipv4 ? AF_INET : AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) {
+        qCWarning(wsEngine) << "Cannot create listener socket:" << strerror(errno);
+        return -1;
+    }
+
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        qCWarning(wsEngine) << "Cannot set SO_REUSEPORT:" << strerror(errno);
+        ::close(fd);
+        *unsupported = true;
+        return -1;
+    }
+
+    int ret;
+    if (ipv4) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(address.toIPv4Address());
+        ret = ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    } else {
+        // dual stack socket for QHostAddress::Any
+        int v6only = anyIp ? 0 : 1;
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+
+        sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(port);
+        if (!anyIp) {
+            Q_IPV6ADDR ip6 = address.toIPv6Address();
+            memcpy(&addr.sin6_addr, &ip6, sizeof(ip6));
+        }
+        ret = ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    }
+
+    if (ret < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        qCWarning(wsEngine) << "Cannot bind listener socket to" << address.toString() << port << ":" << strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+#else
+    Q_UNUSED(address)
+    Q_UNUSED(port)
+    *unsupported = true;
+    return -1;
+#endif
+}
+
+void ServerPrivate::closeDescriptor(int socketDescriptor) {
+#ifdef Q_OS_UNIX
+    ::close(socketDescriptor);
+#else
+    Q_UNUSED(socketDescriptor)
+#endif
+}
+
+QTcpServer *ServerPrivate::createProxyListener() {
+    if (!proxyListener) {
+        proxyListener = new QTcpServer(this);
+        proxyListener->setMaxPendingConnections(q->maxPendingConnections());
+        connect(proxyListener, &QTcpServer::newConnection, this, &ServerPrivate::onProxyConnection);
+    }
+    return proxyListener;
+}
+
+void ServerPrivate::onProxyConnection() {
+    while (QTcpSocket *socket = proxyListener->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &ServerPrivate::onProxyHeaderReady);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+        // close sockets which don't send a complete header in time
+        QTimer *timeout = new QTimer(socket);
+        timeout->setObjectName(ProxyTimeoutTimerName);
+        timeout->setSingleShot(true);
+        connect(timeout, &QTimer::timeout, socket, &QTcpSocket::abort);
+        timeout->start(ProxyHeaderTimeoutMs);
+    }
+}
+
+void ServerPrivate::onProxyHeaderReady() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+
+    ProxyProtocol::Header header;
+    QByteArray            data = socket->peek(qMin<qint64>(socket->bytesAvailable(), proxyMaxHeaderSize));
+    switch (ProxyProtocol::parse(data, proxyProtocol, proxyMaxHeaderSize, &header)) {
+        case ProxyProtocol::Incomplete:
+            return;
+        case ProxyProtocol::Invalid:
+            qCWarning(wsEngine) << "Invalid PROXY protocol header, closing socket from:"
+                                << socket->peerAddress().toString() << socket->peerPort();
+            socket->abort();
+            return;
+        case ProxyProtocol::Complete:
+            break;
+    }
+
+    // consume the header, the WebSocket handshake follows
+    socket->read(header.length);
+    disconnect(socket, &QTcpSocket::readyRead, this, &ServerPrivate::onProxyHeaderReady);
+    disconnect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    delete socket->findChild<QTimer *>(ProxyTimeoutTimerName, Qt::FindDirectChildrenOnly);
+
+    if (header.hasAddress) {
+        SocketAddress proxySide = qMakePair(socket->peerAddress(), socket->peerPort());
+        proxyClients.insert(proxySide, qMakePair(header.sourceAddress, header.sourcePort));
+        // forget the client address if the handshake fails
+        connect(socket, &QObject::destroyed, this, [this, proxySide]() { proxyClients.remove(proxySide); });
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+    q->handleConnection(socket);
+    // the handshake may already have been received together with the header
+    if (socket->bytesAvailable() > 0) {
+        QMetaObject::invokeMethod(socket, "readyRead", Qt::QueuedConnection);
+    }
+#else
+    socket->abort();
+#endif
+}
+
+bool ServerPrivate::listenOnDescriptor(int socketDescriptor) {
+    if (proxyProtocol) {
+        if (!createProxyListener()->setSocketDescriptor(socketDescriptor)) {
+            qCWarning(wsEngine) << "Cannot listen on socket descriptor:" << proxyListener->errorString();
+            closeDescriptor(socketDescriptor);
+            return false;
+        }
+        return true;
+    }
+    // the descriptor is only owned by the server if it has been taken over
+    if (!q->setSocketDescriptor(socketDescriptor)) {
+        qCWarning(wsEngine) << "Cannot listen on socket descriptor:" << q->errorString();
+        closeDescriptor(socketDescriptor);
+        return false;
+    }
+    return true;
+}
+
+void ServerPrivate::stopListeners() {
+    for (QThread *thread : listenerThreads) {
+        thread->quit();
+    }
+    for (QThread *thread : listenerThreads) {
+        // the listener is deleted with the finished signal
+        thread->wait();
+        delete thread;
+    }
+    listenerThreads.clear();
+    listeners.clear();
+}
+
+Server::~Server() {
+    d->stopListeners();
+}
 
 void Server::setHandler(ConnectionHandler *handler) {
     d->handler = handler;
@@ -89,4 +436,171 @@ void Server::setMaxAllowedIncomingMessageSize(quint64 maxAllowedIncomingMessageS
     d->maxAllowedIncomingMessageSize = maxAllowedIncomingMessageSize;
 }
 
+void Server::setProxyProtocol(ProxyProtocolVersion versions) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 9, 0)
+    if (versions != NoProxyProtocol) {
+        qCWarning(wsEngine) << "PROXY protocol support requires Qt 5.9";
+        return;
+    }
+#endif
+    d->proxyProtocol = versions;
+}
+
+Server::ProxyProtocolVersion Server::proxyProtocol() const {
+    return static_cast<ProxyProtocolVersion>(d->proxyProtocol);
+}
+
+void Server::setProxyProtocolMaxHeaderSize(int bytes) {
+    d->proxyMaxHeaderSize = qBound(ProxyProtocol::MinHeaderSize, bytes, ProxyProtocol::MaxHeaderSize);
+}
+
+int Server::proxyProtocolMaxHeaderSize() const {
+    return d->proxyMaxHeaderSize;
+}
+
+bool Server::listenProxyProtocol(const QHostAddress &address, quint16 port) {
+    if (!d->proxyProtocol) {
+        return listen(address, port);
+    }
+    if (!d->createProxyListener()->listen(address, port)) {
+        qCWarning(wsEngine) << "Cannot listen on" << address.toString() << port << d->proxyListener->errorString();
+        return false;
+    }
+    return true;
+}
+
+QTcpServer *Server::proxyListener() const {
+    return d->proxyListener;
+}
+
+void Server::setTrafficCapture(TrafficCapture *capture) {
+    d->capture = capture;
+}
+
+TrafficCapture *Server::trafficCapture() const {
+    return d->capture;
+}
+
+void Server::setCluster(Cluster *cluster) {
+    d->cluster = cluster;
+}
+
+Cluster *Server::cluster() const {
+    return d->cluster;
+}
+
+void Server::setStallWatchdog(StallWatchdog *watchdog) {
+    if (d->stallWatchdog) {
+        d->stallWatchdog->unwatch(thread());
+    }
+    d->stallWatchdog = watchdog;
+    if (watchdog) {
+        watchdog->watch(thread());
+    }
+}
+
+StallWatchdog *Server::stallWatchdog() const {
+    return d->stallWatchdog;
+}
+
+void Server::setMemoryBudget(MemoryBudget *budget) {
+    d->memoryBudget = budget;
+}
+
+MemoryBudget *Server::memoryBudget() const {
+    return d->memoryBudget;
+}
+
+bool Server::listenReusePort(const QHostAddress &address, quint16 port, int count) {
+    if (!d->listeners.isEmpty() || isListening() || (d->proxyListener && d->proxyListener->isListening())) {
+        qCWarning(wsEngine) << "Server is already listening";
+        return false;
+    }
+
+    bool unsupported;
+    int  fd = ServerPrivate::createReusePortSocket(address, port, &unsupported);
+    if (fd < 0) {
+        if (!unsupported) {
+            return false;
+        }
+        qCWarning(wsEngine) << "SO_REUSEPORT not available, using a single listener";
+        return listenProxyProtocol(address, port);
+    }
+    if (!d->listenOnDescriptor(fd)) {
+        return false;
+    }
+    // use the effective port for the other listeners if an ephemeral port was requested
+    port = d->proxyListener ? d->proxyListener->serverPort() : serverPort();
+
+    for (int i = 1; i < count; i++) {
+        fd = ServerPrivate::createReusePortSocket(address, port, &unsupported);
+        if (fd < 0) {
+            break;
+        }
+
+        Server *listener = new Server(d->handler, serverName(), secureMode());
+#ifndef QT_NO_SSL
+        if (secureMode() == SecureMode) {
+            listener->setSslConfiguration(sslConfiguration());
+        }
+#endif
+        listener->d->maxAllowedIncomingMessageSize = d->maxAllowedIncomingMessageSize;
+        listener->d->capture = d->capture;
+        listener->d->cluster = d->cluster;
+        listener->d->stallWatchdog = d->stallWatchdog;
+        listener->d->memoryBudget = d->memoryBudget;
+        listener->d->proxyProtocol = d->proxyProtocol;
+        listener->d->proxyMaxHeaderSize = d->proxyMaxHeaderSize;
+        listener->setMaxPendingConnections(maxPendingConnections());
+
+        QThread *thread = new QThread();
+        thread->setObjectName(QString("%1-listener-%2").arg(serverName()).arg(i));
+        listener->moveToThread(thread);
+        connect(thread, &QThread::finished, listener, &QObject::deleteLater);
+        thread->start();
+
+        // the socket notifier must be created in the listener thread
+        bool listening = false;
+        QMetaObject::invokeMethod(listener->d, "listenOnDescriptor", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, listening), Q_ARG(int, fd));
+        if (!listening) {
+            // the listener is deleted with the finished signal
+            thread->quit();
+            thread->wait();
+            delete thread;
+            break;
+        }
+
+        if (d->stallWatchdog) {
+            d->stallWatchdog->watch(thread);
+        }
+        connect(listener, &Server::drained, d, &ServerPrivate::onListenerDrained);
+        d->listeners.append(listener);
+        d->listenerThreads.append(thread);
+    }
+
+    qCDebug(wsEngine) << "Listening on" << address.toString() << port << "with" << listenerCount() << "listeners";
+    return true;
+}
+
+int Server::listenerCount() const {
+    return d->listeners.size() + 1;
+}
+
+void Server::drain(int batchSize, int intervalMs, int deadlineMs, int reconnectJitterMs) {
+    d->startDrain(batchSize, intervalMs, deadlineMs, reconnectJitterMs);
+}
+
+bool Server::isDraining() const {
+    return d->drainRequested;
+}
+
+int Server::connectionCount() const {
+    int count = d->connectionCounter.loadAcquire();
+    for (Server *listener : d->listeners) {
+        count += listener->d->connectionCounter.loadAcquire();
+    }
+    return count;
+}
+
 }  // namespace QWsEngine
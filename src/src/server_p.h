@@ -5,15 +5,29 @@
 
 #include <qwsengine/server.h>
 
-#include <QMap>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QPair>
 #include <QSharedPointer>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
 #include <QtWebSockets/QWebSocket>
 
 namespace QWsEngine {
 
+class Cluster;
 class Connection;
 class ConnectionHandler;
+class MemoryBudget;
+class StallWatchdog;
+class TrafficCapture;
+
+typedef QPair<QHostAddress, quint16> SocketAddress;
 
 class ServerPrivate : public QObject {
     Q_OBJECT
@@ -23,17 +37,73 @@ class ServerPrivate : public QObject {
 
     ConnectionHandler *handler;
     quint64            maxAllowedIncomingMessageSize;
+    TrafficCapture *   capture;
+    Cluster *          cluster;
+    StallWatchdog *    stallWatchdog;
+    MemoryBudget *     memoryBudget;
+
+    // PROXY protocol: TCP listener handing sockets over to QWebSocketServer after the header has been parsed
+    int         proxyProtocol;
+    int         proxyMaxHeaderSize;
+    QTcpServer *proxyListener;
+    // proxy side socket address -> client address of the PROXY header, until the WebSocket handshake completed
+    QHash<SocketAddress, SocketAddress> proxyClients;
+
+    QHash<QWebSocket *, QSharedPointer<Connection>> connections;
+    // connection count readable from other listener threads
+    QAtomicInt connectionCounter;
+
+    // additional SO_REUSEPORT listeners, each living in its own thread
+    QList<Server *>  listeners;
+    QList<QThread *> listenerThreads;
+
+    QTimer        drainTimer;
+    QElapsedTimer drainClock;
+    bool          drainRequested;
+    bool          draining;
+    int           pendingListenerDrains;
+    int           drainBatchSize;
+    int           drainDeadlineMs;
+    int           drainJitterMs;
+
+    /**
+     * @brief Create a listening TCP socket with SO_REUSEPORT. Returns -1 on error or if not supported.
+     *
+     * unsupported is set if the platform doesn't support SO_REUSEPORT, as opposed to e.g. a port already in use.
+     */
+    static int createReusePortSocket(const QHostAddress &address, quint16 port, bool *unsupported);
+
+    /**
+     * @brief Close a socket descriptor which hasn't been taken over by a server.
+     */
+    static void closeDescriptor(int socketDescriptor);
+
+    void stopListeners();
+    void finishDrain();
+    void checkDrained();
+
+    /**
+     * @brief Close all client connections.
+     */
+    void closeAllConnections(QWebSocketProtocol::CloseCode closeCode = QWebSocketProtocol::CloseCodeNormal,
+                             const QString &               reason = QString());
+
+    QString drainCloseReason() const;
 
-    QMap<QWebSocket *, QSharedPointer<Connection>> connections;
+    QTcpServer *createProxyListener();
 
  public Q_SLOTS:  // NOLINT
     void onNewConnection();
     void onServerClosed();
     void socketDisconnected();
+    void onDrainTimeout();
+    void onListenerDrained();
+    void onProxyConnection();
+    void onProxyHeaderReady();
 
- Q_SIGNALS:  // NOLINT
-    void disconnectAllClients(QWebSocketProtocol::CloseCode closeCode = QWebSocketProtocol::CloseCodeNormal,
-                              const QString &               reason = QString());
+    // closes the descriptor on failure
+    Q_INVOKABLE bool listenOnDescriptor(int socketDescriptor);
+    Q_INVOKABLE void startDrain(int batchSize, int intervalMs, int deadlineMs, int reconnectJitterMs);
 
  private:
     Server *const q;
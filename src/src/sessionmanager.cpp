@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/connection.h>
+
+#include <QMutexLocker>
+#include <QUuid>
+
+#include "connection_p.h"
+#include "sessionmanager_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+Session::Session(const QString &token, int capacity)
+    : token(token),
+      ring(qMax(1, capacity)),
+      lastSeq(0),
+      connection(nullptr),
+      connectionHandler(nullptr),
+      handler(nullptr) {}
+
+void Session::record(Connection *from, SessionMessage::Type type, const QString &text, const QByteArray &data) {
+    QMutexLocker locker(&mutex);
+    if (connection != from) {
+        // a replaced connection which hasn't been closed yet
+        return;
+    }
+    SessionMessage &message = ring[static_cast<int>(++lastSeq % static_cast<quint64>(ring.size()))];
+    message.seq = lastSeq;
+    message.type = type;
+    message.text = text;
+    message.data = data;
+}
+
+bool Session::canReplay(quint64 seq) const {
+    if (seq > lastSeq) {
+        return false;
+    }
+    // the oldest message in the ring
+    quint64 oldest = lastSeq >= static_cast<quint64>(ring.size()) ? lastSeq - ring.size() + 1 : 1;
+    return seq + 1 >= oldest;
+}
+
+QVector<SessionMessage> Session::messagesAfter(quint64 seq) const {
+    QVector<SessionMessage> messages;
+    messages.reserve(static_cast<int>(lastSeq - seq));
+    for (quint64 i = seq + 1; i <= lastSeq; i++) {
+        messages.append(ring.at(static_cast<int>(i % static_cast<quint64>(ring.size()))));
+    }
+    return messages;
+}
+
+SessionManagerPrivate::SessionManagerPrivate(SessionManager *manager)
+    : QObject(manager), gracePeriodMs(30000), bufferSize(128), q(manager) {
+    connect(&expiryTimer, &QTimer::timeout, this, &SessionManagerPrivate::expireSessions);
+    expiryTimer.start(1000);
+}
+
+void SessionManagerPrivate::createSession(const QSharedPointer<Connection> &connection) {
+    ConnectionPrivate *connPrivate = ConnectionPrivate::get(connection.data());
+    if (connPrivate->session) {
+        return;
+    }
+
+    QString token = createToken();
+    auto    session = QSharedPointer<Session>::create(token, bufferSize);
+    session->connection = connection.data();
+    session->connectionHandler = connPrivate->sessionHandler;
+    session->handler = connPrivate->handler;
+    session->routeId = connPrivate->routeId;
+    session->pathParameters = connPrivate->pathParameters;
+    {
+        QMutexLocker locker(&mutex);
+        sessions.insert(token, session);
+    }
+
+    // the session message is sent before recording starts and is therefore not counted
+    connection->sendTextMessage(QStringLiteral("{\"type\": \"session\", \"resume_token\": \"%1\"}").arg(token));
+    connPrivate->session = session;
+    qCDebug(wsEngine) << "Created session for connection" << connection->id();
+}
+
+QSharedPointer<Session> SessionManagerPrivate::takeSession(const QString &token, quint64 lastSeq,
+                                                           ConnectionHandler *connectionHandler) {
+    QMutexLocker locker(&mutex);
+    auto         it = sessions.find(token);
+    if (it == sessions.end()) {
+        return QSharedPointer<Session>();
+    }
+
+    QSharedPointer<Session> session = it.value();
+    if (session->connectionHandler != connectionHandler) {
+        // resumed by the handler which created it, e.g. the one of a more specific path route
+        return QSharedPointer<Session>();
+    }
+    QMutexLocker sessionLocker(&session->mutex);
+    if (!session->canReplay(lastSeq)) {
+        qCDebug(wsEngine) << "Cannot resume session, missed messages are no longer available";
+        return QSharedPointer<Session>();
+    }
+    if (session->connection) {
+        // the old connection didn't notice the disconnect yet, e.g. a half-open TCP connection
+        QMetaObject::invokeMethod(session->connection, "close", Qt::QueuedConnection);
+        session->connection = nullptr;
+    }
+    sessions.erase(it);
+    return session;
+}
+
+void SessionManagerPrivate::resume(const QSharedPointer<Connection> &connection,
+                                   const QSharedPointer<Session> &session, quint64 lastSeq) {
+    QVector<SessionMessage> missed;
+    QString                 previousToken;
+    QString                 token = createToken();
+    {
+        QMutexLocker locker(&session->mutex);
+        missed = session->messagesAfter(lastSeq);
+        // a leaked token must not allow taking over the session again
+        previousToken = session->token;
+        session->token = token;
+        session->connection = connection.data();
+        session->detachedSince.invalidate();
+    }
+
+    ConnectionPrivate *connPrivate = ConnectionPrivate::get(connection.data());
+    connection->sendTextMessage(
+        QStringLiteral("{\"type\": \"session_resumed\", \"resume_token\": \"%1\", \"replayed\": %2}")
+            .arg(token)
+            .arg(missed.size()));
+    // replayed messages keep their sequence numbers and are not recorded again
+    for (const SessionMessage &message : missed) {
+        switch (message.type) {
+            case SessionMessage::Text:
+                connPrivate->writeText(message.text);
+                break;
+            case SessionMessage::Utf8:
+                connPrivate->writeUtf8(message.data);
+                break;
+            case SessionMessage::Binary:
+                connPrivate->writeBinary(message.data);
+                break;
+        }
+    }
+    connPrivate->session = session;
+
+    {
+        QMutexLocker locker(&mutex);
+        sessions.insert(token, session);
+    }
+    qCDebug(wsEngine) << "Resumed session with" << missed.size() << "missed messages for connection"
+                      << connection->id();
+    emit q->sessionResumed(connection, token, previousToken);
+}
+
+void SessionManagerPrivate::detach(const QSharedPointer<Session> &session, Connection *connection) {
+    QMutexLocker locker(&session->mutex);
+    if (session->connection == connection) {
+        session->connection = nullptr;
+        session->detachedSince.start();
+    }
+}
+
+QString SessionManagerPrivate::createToken() {
+    // strip the braces of the UUID
+    return QUuid::createUuid().toString().mid(1, 36);
+}
+
+void SessionManagerPrivate::expireSessions() {
+    QStringList expired;
+    {
+        QMutexLocker locker(&mutex);
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            Session *    session = it.value().data();
+            QMutexLocker sessionLocker(&session->mutex);
+            if (!session->connection && session->detachedSince.isValid() &&
+                session->detachedSince.hasExpired(gracePeriodMs)) {
+                expired.append(it.key());
+                sessionLocker.unlock();
+                it = sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const QString &token : expired) {
+        emit q->sessionExpired(token);
+    }
+}
+
+SessionManager::SessionManager(QObject *parent) : QObject(parent), d(new SessionManagerPrivate(this)) {}
+
+SessionManager::~SessionManager() {}
+
+void SessionManager::setGracePeriod(int ms) {
+    d->gracePeriodMs = ms;
+}
+
+int SessionManager::gracePeriod() const {
+    return d->gracePeriodMs;
+}
+
+void SessionManager::setReplayBufferSize(int messages) {
+    d->bufferSize = qMax(1, messages);
+}
+
+int SessionManager::replayBufferSize() const {
+    return d->bufferSize;
+}
+
+int SessionManager::sessionCount() const {
+    QMutexLocker locker(&d->mutex);
+    return d->sessions.size();
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/sessionmanager.h>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+#include <QtWebSockets/QWebSocket>
+
+namespace QWsEngine {
+
+class Connection;
+class ConnectionHandler;
+class Handler;
+
+/**
+ * @brief Outbound message kept for a replay.
+ */
+struct SessionMessage {
+    enum Type : quint8 { Text, Utf8, Binary };
+
+    quint64    seq = 0;
+    QString    text;
+    QByteArray data;
+    Type       type = Text;
+};
+
+/**
+ * @brief Resumable session with a ring buffer of recent outbound messages.
+ *
+ * Recording is done on the thread of the attached connection. Attaching and detaching may happen on other listener
+ * threads, all state is therefore guarded by the session mutex.
+ */
+class Session {
+ public:
+    Session(const QString &token, int capacity);
+
+    /**
+     * @brief Record an outbound message of the attached connection.
+     */
+    void record(Connection *from, SessionMessage::Type type, const QString &text, const QByteArray &data);
+
+    /**
+     * @brief Returns true if all messages after lastSeq are still available.
+     */
+    bool canReplay(quint64 lastSeq) const;
+
+    /**
+     * @brief Returns the messages after lastSeq, oldest first.
+     */
+    QVector<SessionMessage> messagesAfter(quint64 lastSeq) const;
+
+    // replaced on every resume
+    QString                 token;
+    mutable QMutex          mutex;
+    QVector<SessionMessage> ring;
+    quint64                 lastSeq;
+    Connection *            connection;
+    QElapsedTimer           detachedSince;
+
+    // origin of the session, set on creation and restored on resume
+    ConnectionHandler *     connectionHandler;
+    Handler *               handler;
+    QString                 routeId;
+    QHash<QString, QString> pathParameters;
+};
+
+class SessionManagerPrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit SessionManagerPrivate(SessionManager *manager);
+
+    static SessionManagerPrivate *get(SessionManager *manager) { return manager->d; }
+
+    /**
+     * @brief Create a session for the authenticated connection and send the resume token.
+     */
+    void createSession(const QSharedPointer<Connection> &connection);
+
+    /**
+     * @brief Returns the session of the resume token if it can be resumed with lastSeq, or null.
+     *
+     * Only a session created by the given connection handler is returned. The session is detached from a still
+     * attached connection, which is closed, and removed from the session map until resume() attaches it to the new
+     * connection. A session can therefore not be resumed twice.
+     */
+    QSharedPointer<Session> takeSession(const QString &token, quint64 lastSeq, ConnectionHandler *connectionHandler);
+
+    /**
+     * @brief Attach a taken session to the new, already authenticated connection and replay the missed messages.
+     *
+     * The session gets a new resume token, a token can therefore only be used once.
+     */
+    void resume(const QSharedPointer<Connection> &connection, const QSharedPointer<Session> &session, quint64 lastSeq);
+
+    /**
+     * @brief Detach the session from its destroyed connection. Thread-safe.
+     */
+    static void detach(const QSharedPointer<Session> &session, Connection *connection);
+
+    /**
+     * @brief Returns a new random resume token.
+     */
+    static QString createToken();
+
+    mutable QMutex                          mutex;
+    QHash<QString, QSharedPointer<Session>> sessions;
+    int                                     gracePeriodMs;
+    int                                     bufferSize;
+    QTimer                                  expiryTimer;
+
+ public Q_SLOTS:  // NOLINT
+    void expireSessions();
+
+ private:
+    SessionManager *const q;
+};
+
+}  // namespace QWsEngine
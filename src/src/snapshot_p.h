@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QExplicitlySharedDataPointer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+namespace QWsEngine {
+
+/**
+ * @brief Atomically published immutable snapshot, read without locks.
+ *
+ * Readers acquire a reference to the current snapshot with load() and keep it for as long as they use it, e.g. while
+ * a message is being processed on a thread pool. Writers copy the current snapshot, modify the copy and publish it
+ * with update(). A replaced snapshot is deleted as soon as the last reader released it.
+ *
+ * Acquiring a reference is guarded by two acquire counters, selected by the parity of an epoch: after swapping the
+ * pointer, the writer advances the epoch and waits until no reader of the previous epoch is between loading the old
+ * pointer and referencing it. Readers arriving later count on the other counter, so the writer only waits for readers
+ * already in this window of a few instructions and can't be starved by a steady stream of new ones. Writers never
+ * wait for message processing and readers never wait at all, except for retrying if the epoch advanced while they
+ * entered the window.
+ *
+ * A load costs atomic read-modify-write operations on memory shared by all reader threads, the acquire counter and
+ * the reference count of the snapshot. This is cheap compared to processing a message, but these cache lines bounce
+ * between cores under high message rates on many threads.
+ *
+ * T must derive from QSharedData and be copy constructible.
+ */
+template <typename T>
+class SnapshotPointer {
+ public:
+    SnapshotPointer() : m_current(new T()) { m_current.load()->ref.ref(); }
+
+    ~SnapshotPointer() { release(m_current.load()); }
+
+    /**
+     * @brief Returns a reference to the current snapshot. Thread-safe and lock-free.
+     */
+    QExplicitlySharedDataPointer<const T> load() const {
+        QAtomicInt *acquiring;
+        for (;;) {
+            int epoch = m_epoch.loadAcquire();
+            acquiring = &m_acquiring[epoch & 1];
+            acquiring->ref();
+            // a writer advancing the epoch from here on waits for this reader
+            if (m_epoch.loadAcquire() == epoch) {
+                break;
+            }
+            acquiring->deref();
+        }
+        QExplicitlySharedDataPointer<const T> snapshot(m_current.loadAcquire());
+        acquiring->deref();
+        return snapshot;
+    }
+
+    /**
+     * @brief Publish a modified copy of the current snapshot. Thread-safe, concurrent updates are serialized.
+     */
+    template <typename Func>
+    void update(Func modify) {
+        QMutexLocker locker(&m_writeLock);
+        T *          next = new T(*m_current.loadAcquire());
+        modify(next);
+        next->ref.ref();
+
+        T *previous = m_current.fetchAndStoreOrdered(next);
+        // wait for readers which may have loaded the previous pointer but haven't referenced it yet, new readers use
+        // the counter of the next epoch
+        int epoch = m_epoch.fetchAndAddOrdered(1);
+        while (m_acquiring[epoch & 1].loadAcquire() != 0) {
+            QThread::yieldCurrentThread();
+        }
+        release(previous);
+    }
+
+ private:
+    Q_DISABLE_COPY(SnapshotPointer)
+
+    static void release(T *snapshot) {
+        if (!snapshot->ref.deref()) {
+            delete snapshot;
+        }
+    }
+
+    QAtomicPointer<T>  m_current;
+    QAtomicInt         m_epoch;
+    mutable QAtomicInt m_acquiring[2];
+    QMutex             m_writeLock;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,437 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+#include "stallwatchdog_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+namespace {
+
+const int kMaxRecentStalls = 100;
+// bounds the message types created from client supplied message names
+const int kMaxMessageTypes = 1000;
+
+struct Clock {
+    Clock() { timer.start(); }
+    QElapsedTimer timer;
+};
+
+Clock g_clock;
+
+// message types of all threads, entries are never deleted
+QMutex                             g_typesMutex;
+QHash<QString, StallMessageType *> g_types;
+
+thread_local ThreadActivity t_activity;
+
+/**
+ * @brief Consistent copy of the activity fields. Returns false if the owning thread kept writing.
+ */
+bool readActivity(ThreadActivity *activity, qint64 *startNs, quint64 *connectionId, StallMessageType **msgType,
+                  const char **handler) {
+    for (int retry = 0; retry < 100; retry++) {
+        quint32 sequence = activity->sequence.loadAcquire();
+        if (sequence & 1) {
+            continue;
+        }
+        *startNs = activity->startNs.loadAcquire();
+        *connectionId = activity->connectionId.loadAcquire();
+        *msgType = activity->msgType.loadAcquire();
+        *handler = activity->handler.loadAcquire();
+        if (activity->sequence.loadAcquire() == sequence) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+QAtomicInt                    StallWatchdogPrivate::enabled(0);
+QAtomicPointer<StallWatchdog> StallWatchdogPrivate::running(nullptr);
+
+StallWatchdogPrivate::StallWatchdogPrivate(StallWatchdog *watchdog)
+    : QObject(watchdog), threshold(100), monitorThread(nullptr), nextStallId(1), q(watchdog) {}
+
+StallWatchdog::StallWatchdog(QObject *parent) : QObject(parent), d(new StallWatchdogPrivate(this)) {
+    qRegisterMetaType<QWsEngine::StallWatchdog::Stall>();
+}
+
+StallWatchdog::~StallWatchdog() {
+    stop();
+    QList<QThread *> threads;
+    {
+        QMutexLocker locker(&d->mutex);
+        for (const StallWatchdogPrivate::Watched &watched : d->watched) {
+            threads.append(watched.thread);
+        }
+    }
+    for (QThread *thread : threads) {
+        d->unwatch(thread);
+    }
+}
+
+qint64 StallWatchdogPrivate::now() {
+    // never 0, which marks idle activities and loops without heartbeat
+    return g_clock.timer.nsecsElapsed() + 1;
+}
+
+ThreadActivity *StallWatchdogPrivate::threadActivity() {
+    return &t_activity;
+}
+
+StallMessageType *StallWatchdogPrivate::messageType(ThreadActivity *activity, const QString &msgName) {
+    StallMessageType *msgType = activity->cache.value(msgName);
+    if (Q_UNLIKELY(!msgType)) {
+        QMutexLocker locker(&g_typesMutex);
+        msgType = g_types.value(msgName);
+        if (!msgType && g_types.size() < kMaxMessageTypes) {
+            msgType = new StallMessageType(msgName);
+            g_types.insert(msgName, msgType);
+        }
+        if (!msgType) {
+            // the remaining names share one entry, which isn't cached to keep the cache bounded as well
+            const QString other = QStringLiteral("<other>");
+            msgType = g_types.value(other);
+            if (!msgType) {
+                msgType = new StallMessageType(other);
+                g_types.insert(other, msgType);
+            }
+            return msgType;
+        }
+        activity->cache.insert(msgName, msgType);
+    }
+    return msgType;
+}
+
+void StallWatchdogPrivate::beginMessage(ThreadActivity *activity, StallMessageType *msgType, quint64 connectionId,
+                                        const char *handler) {
+    activity->sequence.fetchAndAddOrdered(1);
+    activity->msgType.store(msgType);
+    activity->connectionId.store(connectionId);
+    activity->handler.store(handler);
+    activity->startNs.store(now());
+    activity->sequence.fetchAndAddOrdered(1);
+}
+
+void StallWatchdogPrivate::begin(quint64 connectionId, const QString &msgName, const char *handler) {
+    ThreadActivity *activity = threadActivity();
+    if (activity->depth++ > 0) {
+        setHandler(handler);
+        return;
+    }
+    beginMessage(activity, messageType(activity, msgName), connectionId, handler);
+}
+
+void StallWatchdogPrivate::begin(quint64 connectionId, const char *msgName, const char *handler) {
+    ThreadActivity *activity = threadActivity();
+    if (activity->depth++ > 0) {
+        setHandler(handler);
+        return;
+    }
+    // avoids converting the name for every message
+    StallMessageType *msgType = activity->staticCache.value(msgName);
+    if (Q_UNLIKELY(!msgType)) {
+        msgType = messageType(activity, QString::fromUtf8(msgName));
+        activity->staticCache.insert(msgName, msgType);
+    }
+    beginMessage(activity, msgType, connectionId, handler);
+}
+
+void StallWatchdogPrivate::end() {
+    ThreadActivity *activity = threadActivity();
+    if (--activity->depth > 0) {
+        return;
+    }
+
+    qint64            startNs = activity->startNs.load();
+    StallMessageType *msgType = activity->msgType.load();
+    activity->sequence.fetchAndAddOrdered(1);
+    activity->startNs.store(0);
+    activity->sequence.fetchAndAddOrdered(1);
+
+    if (!msgType || !startNs) {
+        return;
+    }
+    quint64 elapsed = static_cast<quint64>(now() - startNs);
+    msgType->count.fetchAndAddRelaxed(1);
+    msgType->totalNs.fetchAndAddRelaxed(elapsed);
+    quint64 max = msgType->maxNs.load();
+    while (elapsed > max && !msgType->maxNs.testAndSetRelaxed(max, elapsed, max)) {
+    }
+}
+
+void StallWatchdogPrivate::setHandler(const char *handler) {
+    ThreadActivity *activity = threadActivity();
+    if (!handler || activity->depth == 0) {
+        return;
+    }
+    activity->sequence.fetchAndAddOrdered(1);
+    activity->handler.store(handler);
+    activity->sequence.fetchAndAddOrdered(1);
+}
+
+void StallWatchdogPrivate::startHeartbeat(const Watched &watched) {
+    watched.loop->lastBeatNs.store(0);
+    if (watched.heartbeat) {
+        // the timer must be started in its own thread
+        QMetaObject::invokeMethod(watched.heartbeat, "start", Qt::QueuedConnection, Q_ARG(int, heartbeatInterval()));
+    }
+}
+
+StallWatchdog::Stall StallWatchdogPrivate::reportStall(const Watched &watched, qint64 beat, qint64 current) {
+    WatchedLoop *loop = watched.loop.data();
+    loop->stalled = true;
+    loop->stallBeat = beat;
+    loop->stallId = nextStallId++;
+
+    StallWatchdog::Stall stall;
+    stall.durationMs = (current - beat) / 1000000;
+    stall.timestamp = QDateTime::currentMSecsSinceEpoch() - stall.durationMs;
+    stall.ongoing = true;
+    stall.thread = watched.name;
+    stall.connectionId = 0;
+
+    ThreadActivity *  activity = loop->activity.load();
+    qint64            startNs;
+    quint64           connectionId;
+    StallMessageType *msgType;
+    const char *      handler;
+    if (activity && readActivity(activity, &startNs, &connectionId, &msgType, &handler) && startNs && msgType) {
+        stall.msgName = msgType->name;
+        stall.handler = QString::fromLatin1(handler);
+        stall.connectionId = connectionId;
+        msgType->stalls.fetchAndAddRelaxed(1);
+    }
+
+    recentStalls.append({loop->stallId, stall});
+    if (recentStalls.size() > kMaxRecentStalls) {
+        recentStalls.removeFirst();
+    }
+
+    if (stall.msgName.isEmpty()) {
+        qCWarning(wsEngine) << "Event loop" << stall.thread << "stalled for" << stall.durationMs
+                            << "ms outside of message processing";
+    } else {
+        qCWarning(wsEngine) << "Event loop" << stall.thread << "stalled for" << stall.durationMs << "ms processing"
+                            << stall.msgName << "in" << stall.handler << "for connection" << stall.connectionId;
+    }
+    return stall;
+}
+
+void StallWatchdogPrivate::check() {
+    const qint64                  thresholdNs = static_cast<qint64>(threshold) * 1000000;
+    QVector<StallWatchdog::Stall> detected;
+    {
+        // holding the lock prevents watched threads from finishing while their activity is read
+        QMutexLocker locker(&mutex);
+        const qint64 current = now();
+        for (const Watched &entry : watched) {
+            WatchedLoop *loop = entry.loop.data();
+            qint64       beat = loop->lastBeatNs.load();
+            if (!beat) {
+                continue;
+            }
+            if (current - beat > thresholdNs) {
+                if (!loop->stalled) {
+                    detected.append(reportStall(entry, beat, current));
+                }
+            } else if (loop->stalled) {
+                loop->stalled = false;
+                // the stall lasted from the last heartbeat before the detection until the first one after it
+                qint64 durationMs = (beat - loop->stallBeat) / 1000000;
+                for (RecordedStall &recorded : recentStalls) {
+                    if (recorded.id == loop->stallId) {
+                        recorded.stall.durationMs = durationMs;
+                        recorded.stall.ongoing = false;
+                    }
+                }
+                qCInfo(wsEngine) << "Event loop" << entry.name << "recovered after" << durationMs << "ms";
+            }
+        }
+    }
+    for (const StallWatchdog::Stall &stall : detected) {
+        emit q->stallDetected(stall);
+    }
+}
+
+void StallWatchdogPrivate::unwatch(QThread *thread) {
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < watched.size(); i++) {
+        if (watched.at(i).thread != thread) {
+            continue;
+        }
+        Watched entry = watched.takeAt(i);
+        QObject::disconnect(entry.finishedConnection);
+        if (entry.heartbeat) {
+            if (thread == QThread::currentThread() || thread->isFinished()) {
+                delete entry.heartbeat.data();
+            } else {
+                entry.heartbeat->deleteLater();
+            }
+        }
+        return;
+    }
+}
+
+void StallWatchdog::setThreshold(int ms) {
+    d->threshold = qMax(ms, 1);
+}
+
+int StallWatchdog::threshold() const {
+    return d->threshold;
+}
+
+void StallWatchdog::watch(QThread *thread) {
+    QMutexLocker locker(&d->mutex);
+    for (const StallWatchdogPrivate::Watched &watched : d->watched) {
+        if (watched.thread == thread) {
+            return;
+        }
+    }
+
+    StallWatchdogPrivate::Watched watched;
+    watched.thread = thread;
+    watched.name = thread->objectName();
+    if (watched.name.isEmpty()) {
+        watched.name = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()
+                           ? QStringLiteral("main")
+                           : QStringLiteral("thread-%1").arg(reinterpret_cast<quintptr>(thread), 0, 16);
+    }
+    watched.loop = QSharedPointer<WatchedLoop>::create();
+
+    QTimer *heartbeat = new QTimer();
+    heartbeat->moveToThread(thread);
+    QSharedPointer<WatchedLoop> loop = watched.loop;
+    // a functor without context object is invoked directly in the thread of the timer
+    connect(heartbeat, &QTimer::timeout, [loop]() {
+        loop->activity.store(StallWatchdogPrivate::threadActivity());
+        loop->lastBeatNs.store(StallWatchdogPrivate::now());
+    });
+    watched.heartbeat = heartbeat;
+    watched.finishedConnection =
+        connect(thread, &QThread::finished, d, [this, thread]() { d->unwatch(thread); }, Qt::DirectConnection);
+
+    d->watched.append(watched);
+    if (d->monitorThread) {
+        d->startHeartbeat(watched);
+    }
+}
+
+void StallWatchdog::unwatch(QThread *thread) {
+    d->unwatch(thread);
+}
+
+bool StallWatchdog::start() {
+    if (d->monitorThread) {
+        return true;
+    }
+    if (!StallWatchdogPrivate::running.testAndSetOrdered(nullptr, this)) {
+        qCWarning(wsEngine) << "Another stall watchdog is already running";
+        return false;
+    }
+
+    d->monitorThread = new QThread();
+    d->monitorThread->setObjectName(QStringLiteral("stall-watchdog"));
+    QTimer *timer = new QTimer();
+    timer->moveToThread(d->monitorThread);
+    connect(timer, &QTimer::timeout, [this]() { d->check(); });
+    connect(d->monitorThread, &QThread::finished, timer, &QObject::deleteLater);
+    d->monitorTimer = timer;
+    d->monitorThread->start();
+    QMetaObject::invokeMethod(timer, "start", Qt::QueuedConnection, Q_ARG(int, d->heartbeatInterval()));
+
+    {
+        QMutexLocker locker(&d->mutex);
+        for (StallWatchdogPrivate::Watched &watched : d->watched) {
+            watched.loop->stalled = false;
+            d->startHeartbeat(watched);
+        }
+    }
+
+    StallWatchdogPrivate::enabled.store(1);
+    qCDebug(wsEngine) << "Stall watchdog started with a threshold of" << d->threshold << "ms";
+    return true;
+}
+
+void StallWatchdog::stop() {
+    if (!d->monitorThread) {
+        return;
+    }
+    StallWatchdogPrivate::enabled.store(0);
+
+    d->monitorThread->quit();
+    d->monitorThread->wait();
+    delete d->monitorThread;
+    d->monitorThread = nullptr;
+
+    {
+        QMutexLocker locker(&d->mutex);
+        for (const StallWatchdogPrivate::Watched &watched : d->watched) {
+            if (watched.heartbeat) {
+                QMetaObject::invokeMethod(watched.heartbeat, "stop", Qt::QueuedConnection);
+            }
+        }
+    }
+
+    StallWatchdogPrivate::running.testAndSetOrdered(this, nullptr);
+}
+
+bool StallWatchdog::isRunning() const {
+    return d->monitorThread != nullptr;
+}
+
+QVector<StallWatchdog::Stall> StallWatchdog::stalls() const {
+    QMutexLocker   locker(&d->mutex);
+    QVector<Stall> result;
+    result.reserve(d->recentStalls.size());
+    for (const StallWatchdogPrivate::RecordedStall &recorded : d->recentStalls) {
+        result.append(recorded.stall);
+    }
+    return result;
+}
+
+QVector<StallWatchdog::MessageStats> StallWatchdog::messageStats() const {
+    QVector<MessageStats> result;
+    {
+        QMutexLocker locker(&g_typesMutex);
+        for (const StallMessageType *msgType : g_types) {
+            MessageStats stats;
+            stats.msgName = msgType->name;
+            stats.count = msgType->count.load();
+            stats.totalNs = msgType->totalNs.load();
+            stats.maxNs = msgType->maxNs.load();
+            stats.stalls = msgType->stalls.load();
+            if (stats.count || stats.stalls) {
+                result.append(stats);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end(),
+              [](const MessageStats &a, const MessageStats &b) { return a.totalNs > b.totalNs; });
+    return result;
+}
+
+void StallWatchdog::resetStatistics() {
+    {
+        QMutexLocker locker(&g_typesMutex);
+        for (StallMessageType *msgType : g_types) {
+            msgType->count.store(0);
+            msgType->totalNs.store(0);
+            msgType->maxNs.store(0);
+            msgType->stalls.store(0);
+        }
+    }
+    QMutexLocker locker(&d->mutex);
+    d->recentStalls.clear();
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/stallwatchdog.h>
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+namespace QWsEngine {
+
+/**
+ * @brief Processing time statistics of a message name. Entries are never deleted, their name is immutable.
+ */
+struct StallMessageType {
+    explicit StallMessageType(const QString &msgName) : name(msgName) {}
+
+    const QString           name;
+    QAtomicInteger<quint64> count;
+    QAtomicInteger<quint64> totalNs;
+    QAtomicInteger<quint64> maxNs;
+    QAtomicInteger<quint64> stalls;
+};
+
+/**
+ * @brief The message a thread is currently routing.
+ *
+ * Written by the owning thread, read by the monitor thread. The fields are published with a sequence lock: the
+ * sequence is odd while they are being written.
+ */
+struct ThreadActivity {
+    ThreadActivity() : depth(0) {}
+
+    QAtomicInteger<quint32>          sequence;
+    QAtomicInteger<qint64>           startNs;  // 0 while idle
+    QAtomicInteger<quint64>          connectionId;
+    QAtomicPointer<StallMessageType> msgType;
+    QAtomicPointer<const char>       handler;
+
+    // owning thread only
+    int                                     depth;
+    QHash<QString, StallMessageType *>      cache;
+    QHash<const char *, StallMessageType *> staticCache;  // message names with static storage
+};
+
+/**
+ * @brief State of a watched event loop, shared by its heartbeat timer and the monitor.
+ */
+struct WatchedLoop {
+    WatchedLoop() : stalled(false), stallId(0), stallBeat(0) {}
+
+    QAtomicInteger<qint64>         lastBeatNs;  // 0 before the first heartbeat
+    QAtomicPointer<ThreadActivity> activity;
+
+    // monitor thread only
+    bool    stalled;
+    quint64 stallId;
+    qint64  stallBeat;
+};
+
+class StallWatchdogPrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit StallWatchdogPrivate(StallWatchdog *watchdog);
+
+    /**
+     * @brief Check the heartbeats of all watched loops. Called in the monitor thread.
+     */
+    void check();
+    void unwatch(QThread *thread);
+    int  heartbeatInterval() const { return qMax(threshold / 4, 5); }
+
+    struct Watched {
+        QThread *                   thread;
+        QString                     name;
+        QPointer<QTimer>            heartbeat;
+        QSharedPointer<WatchedLoop> loop;
+        QMetaObject::Connection     finishedConnection;
+    };
+
+    StallWatchdog::Stall reportStall(const Watched &watched, qint64 beat, qint64 current);
+    void                 startHeartbeat(const Watched &watched);
+
+    struct RecordedStall {
+        quint64              id;
+        StallWatchdog::Stall stall;
+    };
+
+    int              threshold;
+    QThread *        monitorThread;
+    QPointer<QTimer> monitorTimer;
+
+    mutable QMutex         mutex;
+    QVector<Watched>       watched;
+    QVector<RecordedStall> recentStalls;
+    quint64                nextStallId;
+
+    // process wide hooks, see StallWatchdogScope
+    static QAtomicInt                    enabled;
+    static QAtomicPointer<StallWatchdog> running;
+
+    static qint64          now();
+    static ThreadActivity *threadActivity();
+    static void            begin(quint64 connectionId, const QString &msgName, const char *handler);
+    static void            begin(quint64 connectionId, const char *msgName, const char *handler);
+    static void            end();
+
+    /**
+     * @brief Blame the current message of this thread on a more specific handler, e.g. the receiver of a slot.
+     */
+    static void setHandler(const char *handler);
+
+ private:
+    static void beginMessage(ThreadActivity *activity, StallMessageType *msgType, quint64 connectionId,
+                             const char *handler);
+    static StallMessageType *messageType(ThreadActivity *activity, const QString &msgName);
+
+    StallWatchdog *const q;
+};
+
+/**
+ * @brief Marks the routing of a message in the current thread for the stall watchdog.
+ *
+ * Scopes can be nested: the outermost scope measures the processing time, inner scopes refine the handler.
+ */
+class StallWatchdogScope {
+ public:
+    StallWatchdogScope(quint64 connectionId, const QString &msgName, const char *handler) : m_active(false) {
+        if (Q_UNLIKELY(StallWatchdogPrivate::enabled.load())) {
+            StallWatchdogPrivate::begin(connectionId, msgName, handler);
+            m_active = true;
+        }
+    }
+
+    StallWatchdogScope(quint64 connectionId, const char *msgName, const char *handler) : m_active(false) {
+        if (Q_UNLIKELY(StallWatchdogPrivate::enabled.load())) {
+            StallWatchdogPrivate::begin(connectionId, msgName, handler);
+            m_active = true;
+        }
+    }
+
+    ~StallWatchdogScope() {
+        if (m_active) {
+            StallWatchdogPrivate::end();
+        }
+    }
+
+ private:
+    Q_DISABLE_COPY(StallWatchdogScope)
+    bool m_active;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/connection.h>
+#include <qwsengine/jsonwriter.h>
+#include <qwsengine/statesyncmiddleware.h>
+
+#include <QJsonDocument>
+#include <QMutexLocker>
+
+#include "statesyncmiddleware_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+/**
+ * @brief Returns true if the value can be a member value of a merge patch, i.e. if it doesn't contain null.
+ *
+ * Arrays are replaced as they are and may contain null.
+ */
+static bool isMergeable(const QJsonValue &value) {
+    if (value.isNull()) {
+        return false;
+    }
+    if (value.isObject()) {
+        const QJsonObject object = value.toObject();
+        for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+            if (!isMergeable(it.value())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+StateSyncMiddlewarePrivate::StateSyncMiddlewarePrivate(StateSyncMiddleware *middleware)
+    : QObject(middleware), maxPendingAcks(16), q(middleware) {}
+
+bool StateSyncMiddlewarePrivate::createMergePatch(const QJsonObject &from, const QJsonObject &to, QJsonObject *patch) {
+    for (auto it = from.constBegin(); it != from.constEnd(); ++it) {
+        if (!to.contains(it.key())) {
+            patch->insert(it.key(), QJsonValue::Null);
+        }
+    }
+
+    for (auto it = to.constBegin(); it != to.constEnd(); ++it) {
+        const QJsonValue value = it.value();
+        auto             previous = from.constFind(it.key());
+        if (previous != from.constEnd() && previous.value() == value) {
+            continue;
+        }
+        if (previous != from.constEnd() && previous.value().isObject() && value.isObject()) {
+            QJsonObject nested;
+            if (!createMergePatch(previous.value().toObject(), value.toObject(), &nested)) {
+                return false;
+            }
+            patch->insert(it.key(), nested);
+        } else {
+            if (!isMergeable(value)) {
+                return false;
+            }
+            patch->insert(it.key(), value);
+        }
+    }
+    return true;
+}
+
+quint64 StateSyncMiddlewarePrivate::send(const QSharedPointer<Connection> &connection, const QString &key,
+                                         SyncedState *state) {
+    const quint64    seq = state->nextSeq++;
+    const QByteArray full = QJsonDocument(state->current).toJson(QJsonDocument::Compact);
+
+    QByteArray  patchJson;
+    QJsonObject patch;
+    if (state->ackedSeq && createMergePatch(state->acked, state->current, &patch)) {
+        patchJson = QJsonDocument(patch).toJson(QJsonDocument::Compact);
+    }
+    const bool usePatch = !patchJson.isEmpty() && patchJson.size() < full.size();
+
+    JsonWriter json;
+    json.beginObject().field("type", usePatch ? "state_patch" : "state").field("key", key);
+    json.key("seq").value(static_cast<qint64>(seq));
+    if (usePatch) {
+        json.key("base_seq").value(static_cast<qint64>(state->ackedSeq));
+    }
+    json.key("msg_data").rawValue(usePatch ? patchJson : full).endObject();
+
+    state->pending.insert(seq, state->current);
+    while (state->pending.size() > maxPendingAcks) {
+        state->pending.erase(state->pending.begin());
+    }
+
+    // every update refers to an acknowledged document: only the latest one has to reach a slow client
+    connection->sendConflated(QStringLiteral("state_sync/") + key, QString::fromUtf8(json.data()));
+    return seq;
+}
+
+void StateSyncMiddlewarePrivate::acknowledge(quint64 connectionId, const QString &key, quint64 seq) {
+    QMutexLocker locker(&mutex);
+    auto         states = connections.find(connectionId);
+    if (states == connections.end()) {
+        return;
+    }
+    auto state = states->find(key);
+    if (state == states->end() || !state->pending.contains(seq)) {
+        qCDebug(wsEngine) << "Ignoring state acknowledgement" << key << seq;
+        return;
+    }
+
+    state->ackedSeq = seq;
+    state->acked = state->pending.value(seq);
+    // older documents are not needed as base anymore
+    while (!state->pending.isEmpty() && state->pending.firstKey() <= seq) {
+        state->pending.erase(state->pending.begin());
+    }
+}
+
+void StateSyncMiddlewarePrivate::resync(const QSharedPointer<Connection> &connection, const QString &key) {
+    QMutexLocker locker(&mutex);
+    auto         states = connections.find(connection->id());
+    if (states == connections.end()) {
+        return;
+    }
+    auto state = states->find(key);
+    if (state == states->end()) {
+        return;
+    }
+
+    qCDebug(wsEngine) << "State resync requested:" << key;
+    state->ackedSeq = 0;
+    state->acked = QJsonObject();
+    state->pending.clear();
+    if (state->hasCurrent) {
+        send(connection, key, &state.value());
+    }
+}
+
+StateSyncMiddleware::StateSyncMiddleware(QObject *parent)
+    : Middleware(parent), d(new StateSyncMiddlewarePrivate(this)) {}
+
+StateSyncMiddleware::~StateSyncMiddleware() {}
+
+QString StateSyncMiddleware::name() const {
+    return "StateSync";
+}
+
+quint64 StateSyncMiddleware::publish(const QSharedPointer<Connection> &connection, const QString &key,
+                                     const QJsonObject &state) {
+    QMutexLocker  locker(&d->mutex);
+    const quint64 id = connection->id();
+    auto          states = d->connections.find(id);
+    if (states == d->connections.end()) {
+        states = d->connections.insert(id, QHash<QString, SyncedState>());
+        // the documents are released with the connection
+        connect(connection.data(), &QObject::destroyed, d, [this, id]() {
+            QMutexLocker locker(&d->mutex);
+            d->connections.remove(id);
+        });
+    }
+
+    SyncedState &synced = (*states)[key];
+    synced.current = state;
+    synced.hasCurrent = true;
+    return d->send(connection, key, &synced);
+}
+
+void StateSyncMiddleware::setMaxPendingAcks(int max) {
+    d->maxPendingAcks = qMax(max, 1);
+}
+
+int StateSyncMiddleware::maxPendingAcks() const {
+    return d->maxPendingAcks;
+}
+
+bool StateSyncMiddleware::process(QSharedPointer<Connection> connection, const QString &msgName,
+                                  const QVariant &message) {
+    if (msgName != QLatin1String("state_ack") && msgName != QLatin1String("state_resync")) {
+        return true;
+    }
+
+    const QJsonObject json = message.toJsonObject();
+    const QString     key = json.value("key").toString();
+    if (key.isEmpty()) {
+        connection->sendErrorResponse(400, "Missing state key");
+        return false;
+    }
+
+    if (msgName == QLatin1String("state_ack")) {
+        d->acknowledge(connection->id(), key, static_cast<quint64>(json.value("seq").toDouble()));
+    } else {
+        d->resync(connection, key);
+    }
+    return false;
+}
+
+}  // namespace QWsEngine
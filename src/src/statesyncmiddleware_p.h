@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/statesyncmiddleware.h>
+
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+
+namespace QWsEngine {
+
+/**
+ * @brief Synchronization state of a key of a connection.
+ */
+struct SyncedState {
+    SyncedState() : nextSeq(1), hasCurrent(false), ackedSeq(0) {}
+
+    quint64     nextSeq;
+    QJsonObject current;
+    bool        hasCurrent;
+
+    // 0 while no document has been acknowledged: updates are sent in full
+    quint64     ackedSeq;
+    QJsonObject acked;
+
+    // sent and not yet acknowledged documents by sequence number
+    QMap<quint64, QJsonObject> pending;
+};
+
+class StateSyncMiddlewarePrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit StateSyncMiddlewarePrivate(StateSyncMiddleware *middleware);
+
+    /**
+     * @brief Create the merge patch transforming from into to.
+     *
+     * Returns false if the result can't be expressed as merge patch, i.e. if a changed value contains null.
+     */
+    static bool createMergePatch(const QJsonObject &from, const QJsonObject &to, QJsonObject *patch);
+
+    /**
+     * @brief Send the current document of a key as new update. The mutex must be locked.
+     */
+    quint64 send(const QSharedPointer<Connection> &connection, const QString &key, SyncedState *state);
+
+    void acknowledge(quint64 connectionId, const QString &key, quint64 seq);
+    void resync(const QSharedPointer<Connection> &connection, const QString &key);
+
+    int maxPendingAcks;
+
+    QMutex                                      mutex;
+    QHash<quint64, QHash<QString, SyncedState>> connections;
+
+ private:
+    StateSyncMiddleware *const q;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include "tracerecorder_p.h"
+
+namespace QWsEngine {
+
+namespace {
+
+const quint32 kTraceMagic = 0x51575354;  // "QWST"
+const quint32 kTraceVersion = 1;
+
+QMutex               g_buffersMutex;
+QList<TraceBuffer *> g_buffers;
+QElapsedTimer        g_clock;
+
+thread_local TraceBuffer *t_buffer = nullptr;
+thread_local quint32      t_sampleCounter = 0;
+thread_local bool         t_sampled = true;
+
+TraceBuffer *threadBuffer() {
+    if (Q_UNLIKELY(!t_buffer)) {
+        QMutexLocker locker(&g_buffersMutex);
+        t_buffer = new TraceBuffer(static_cast<quint32>(g_buffers.size()), TraceRecorderPrivate::bufferSize.load());
+        // buffers are kept after the thread finished to include its events in a dump
+        g_buffers.append(t_buffer);
+    }
+    return t_buffer;
+}
+
+int roundUpPowerOfTwo(int value) {
+    int result = 1;
+    while (result < value && result < (1 << 30)) {
+        result <<= 1;
+    }
+    return result;
+}
+
+const char *eventName(quint8 type) {
+    switch (type) {
+        case TraceRecorder::Accept:
+            return "accept";
+        case TraceRecorder::Handshake:
+            return "handshake";
+        case TraceRecorder::ParseStart:
+        case TraceRecorder::ParseEnd:
+            return "parse";
+        case TraceRecorder::MiddlewareVerdict:
+            return "middleware";
+        case TraceRecorder::Dispatch:
+            return "dispatch";
+        case TraceRecorder::Send:
+            return "send";
+        case TraceRecorder::Close:
+            return "close";
+        default:
+            return "unknown";
+    }
+}
+
+void appendChromeEvent(QByteArray *out, bool *first, qint64 pid, quint32 tid, const TraceEvent &event) {
+    const char *phase = "i";
+    if (event.type == TraceRecorder::ParseStart) {
+        phase = "B";
+    } else if (event.type == TraceRecorder::ParseEnd) {
+        phase = "E";
+    }
+
+    if (!*first) {
+        out->append(",\n");
+    }
+    *first = false;
+
+    out->append("{\"name\":\"");
+    out->append(eventName(event.type));
+    out->append("\",\"ph\":\"");
+    out->append(phase);
+    out->append("\",\"ts\":");
+    out->append(QByteArray::number(static_cast<double>(event.timestamp) / 1000.0, 'f', 3));
+    out->append(",\"pid\":");
+    out->append(QByteArray::number(pid));
+    out->append(",\"tid\":");
+    out->append(QByteArray::number(tid));
+    if (phase[0] == 'i') {
+        out->append(",\"s\":\"t\"");
+    }
+    out->append(",\"args\":{\"conn\":");
+    out->append(QByteArray::number(event.connectionId));
+    out->append(",\"arg\":");
+    out->append(QByteArray::number(event.arg));
+    out->append("}}");
+}
+
+bool writeChromeTraceEvents(QIODevice *device, const QMap<quint32, QVector<TraceEvent>> &threads) {
+    qint64     pid = QCoreApplication::applicationPid();
+    bool       first = true;
+    QByteArray out("{\"traceEvents\":[\n");
+
+    for (auto it = threads.constBegin(); it != threads.constEnd(); ++it) {
+        for (const TraceEvent &event : it.value()) {
+            appendChromeEvent(&out, &first, pid, it.key(), event);
+            if (out.size() > 64 * 1024) {
+                if (device->write(out) != out.size()) {
+                    return false;
+                }
+                out.clear();
+            }
+        }
+    }
+    out.append("\n],\"displayTimeUnit\":\"ns\"}\n");
+    return device->write(out) == out.size();
+}
+
+QMap<quint32, QVector<TraceEvent>> snapshotAll() {
+    QMap<quint32, QVector<TraceEvent>> threads;
+    QMutexLocker                       locker(&g_buffersMutex);
+    for (TraceBuffer *buffer : g_buffers) {
+        threads.insert(buffer->threadIndex, buffer->snapshot());
+    }
+    return threads;
+}
+
+}  // namespace
+
+QAtomicInt TraceRecorderPrivate::enabled(0);
+QAtomicInt TraceRecorderPrivate::sampleRate(1);
+QAtomicInt TraceRecorderPrivate::bufferSize(65536);
+
+TraceBuffer::TraceBuffer(quint32 threadIndex, int capacity)
+    : threadIndex(threadIndex),
+      events(capacity),
+      ring(events.data()),
+      mask(static_cast<quint64>(capacity) - 1),
+      head(0) {}
+
+QVector<TraceEvent> TraceBuffer::snapshot() const {
+    quint64             end = head.loadAcquire();
+    quint64             count = qMin(end, static_cast<quint64>(events.size()));
+    QVector<TraceEvent> result;
+    result.reserve(static_cast<int>(count));
+    for (quint64 pos = end - count; pos < end; pos++) {
+        result.append(ring[pos & mask]);
+    }
+    return result;
+}
+
+void TraceRecorderPrivate::record(TraceRecorder::EventType type, quint64 connectionId, quint32 arg) {
+    threadBuffer()->append(static_cast<quint64>(g_clock.nsecsElapsed()), type, connectionId, arg);
+}
+
+void TraceRecorderPrivate::beginMessage() {
+    int rate = sampleRate.load();
+    t_sampled = rate <= 1 || (++t_sampleCounter % static_cast<quint32>(rate)) == 0;
+}
+
+bool TraceRecorderPrivate::isMessageSampled() {
+    return t_sampled;
+}
+
+void TraceRecorder::setEnabled(bool enabled) {
+    if (enabled) {
+        QMutexLocker locker(&g_buffersMutex);
+        if (!g_clock.isValid()) {
+            g_clock.start();
+        }
+    }
+    TraceRecorderPrivate::enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool TraceRecorder::isEnabled() {
+    return TraceRecorderPrivate::enabled.loadAcquire() != 0;
+}
+
+void TraceRecorder::setSampleRate(int n) {
+    TraceRecorderPrivate::sampleRate.storeRelease(qMax(1, n));
+}
+
+int TraceRecorder::sampleRate() {
+    return TraceRecorderPrivate::sampleRate.loadAcquire();
+}
+
+void TraceRecorder::setBufferSize(int events) {
+    TraceRecorderPrivate::bufferSize.storeRelease(roundUpPowerOfTwo(qMax(16, events)));
+}
+
+void TraceRecorder::clear() {
+    QMutexLocker locker(&g_buffersMutex);
+    for (TraceBuffer *buffer : g_buffers) {
+        buffer->head.storeRelease(0);
+    }
+}
+
+bool TraceRecorder::writeBinary(QIODevice *device) {
+    auto threads = snapshotAll();
+
+    QDataStream stream(device);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << kTraceMagic << kTraceVersion << static_cast<quint32>(threads.size());
+    for (auto it = threads.constBegin(); it != threads.constEnd(); ++it) {
+        stream << it.key() << static_cast<quint32>(it.value().size());
+        for (const TraceEvent &event : it.value()) {
+            stream << event.timestamp << event.connectionId << event.arg << event.type;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool TraceRecorder::writeChromeTrace(QIODevice *device) {
+    return writeChromeTraceEvents(device, snapshotAll());
+}
+
+bool TraceRecorder::convertToChromeTrace(QIODevice *binary, QIODevice *json) {
+    QDataStream stream(binary);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic, version, threadCount;
+    stream >> magic >> version >> threadCount;
+    if (stream.status() != QDataStream::Ok || magic != kTraceMagic || version != kTraceVersion) {
+        return false;
+    }
+
+    QMap<quint32, QVector<TraceEvent>> threads;
+    for (quint32 i = 0; i < threadCount && stream.status() == QDataStream::Ok; i++) {
+        quint32 threadIndex, count;
+        stream >> threadIndex >> count;
+        QVector<TraceEvent> &events = threads[threadIndex];
+        for (quint32 e = 0; e < count && stream.status() == QDataStream::Ok; e++) {
+            TraceEvent event;
+            stream >> event.timestamp >> event.connectionId >> event.arg >> event.type;
+            events.append(event);
+        }
+    }
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    return writeChromeTraceEvents(json, threads);
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/tracerecorder.h>
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QVector>
+
+namespace QWsEngine {
+
+/**
+ * @brief Fixed-size binary trace event.
+ */
+struct TraceEvent {
+    quint64 timestamp;
+    quint64 connectionId;
+    quint32 arg;
+    quint8  type;
+};
+
+/**
+ * @brief Ring buffer of a single thread. Written by the owning thread only.
+ */
+class TraceBuffer {
+ public:
+    TraceBuffer(quint32 threadIndex, int capacity);
+
+    void append(quint64 timestamp, TraceRecorder::EventType type, quint64 connectionId, quint32 arg) {
+        quint64     pos = head.load();
+        TraceEvent &event = ring[pos & mask];
+        event.timestamp = timestamp;
+        event.connectionId = connectionId;
+        event.arg = arg;
+        event.type = type;
+        head.storeRelease(pos + 1);
+    }
+
+    /**
+     * @brief Copy of the recorded events, oldest first. Events written concurrently might be inconsistent.
+     */
+    QVector<TraceEvent> snapshot() const;
+
+    const quint32           threadIndex;
+    QVector<TraceEvent>     events;
+    TraceEvent *const       ring;
+    const quint64           mask;
+    QAtomicInteger<quint64> head;
+};
+
+class TraceRecorderPrivate {
+ public:
+    static QAtomicInt enabled;
+    static QAtomicInt sampleRate;
+    static QAtomicInt bufferSize;
+
+    static void record(TraceRecorder::EventType type, quint64 connectionId, quint32 arg);
+
+    /**
+     * @brief Sampling decision for a new inbound message on the current thread.
+     */
+    static void beginMessage();
+
+    /**
+     * @brief Returns true if the events of the current message on this thread are recorded.
+     */
+    static bool isMessageSampled();
+};
+
+}  // namespace QWsEngine
+
+/**
+ * @brief Record a connection event if tracing is enabled.
+ */
+#define QWSENGINE_TRACE(type, connectionId, arg)                                                         \
+    do {                                                                                                 \
+        if (Q_UNLIKELY(QWsEngine::TraceRecorderPrivate::enabled.load())) {                               \
+            QWsEngine::TraceRecorderPrivate::record(QWsEngine::TraceRecorder::type, connectionId, arg); \
+        }                                                                                                \
+    } while (0)
+
+/**
+ * @brief Start tracing a new inbound message, applying the sample rate.
+ */
+#define QWSENGINE_TRACE_BEGIN_MESSAGE()                                    \
+    do {                                                                   \
+        if (Q_UNLIKELY(QWsEngine::TraceRecorderPrivate::enabled.load())) { \
+            QWsEngine::TraceRecorderPrivate::beginMessage();               \
+        }                                                                  \
+    } while (0)
+
+/**
+ * @brief Record a message event if tracing is enabled and the current message is sampled.
+ */
+#define QWSENGINE_TRACE_MESSAGE(type, connectionId, arg)                                                 \
+    do {                                                                                                 \
+        if (Q_UNLIKELY(QWsEngine::TraceRecorderPrivate::enabled.load()) &&                               \
+            QWsEngine::TraceRecorderPrivate::isMessageSampled()) {                                       \
+            QWsEngine::TraceRecorderPrivate::record(QWsEngine::TraceRecorder::type, connectionId, arg); \
+        }                                                                                                \
+    } while (0)
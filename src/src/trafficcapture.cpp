@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <QDateTime>
+#include <QDir>
+#include <QMutexLocker>
+#include <QtEndian>
+
+#include <cstring>
+
+#include "bufferpool_p.h"
+#include "trafficcapture_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+TrafficCapturePrivate::TrafficCapturePrivate(TrafficCapture *capture, const QString &directory)
+    : directory(directory),
+      segmentSize(64 * 1024 * 1024),
+      redactedHeaders({"authorization", "proxy-authorization", "cookie"}),
+      startMs(0),
+      map(nullptr),
+      offset(0),
+      sequence(0),
+      q(capture) {}
+
+QString TrafficCapturePrivate::segmentFileName(quint32 sequence) const {
+    return QDir(directory).filePath(QString("capture-%1.qwscap").arg(sequence, 6, 10, QChar('0')));
+}
+
+bool TrafficCapturePrivate::openSegment() {
+    file.setFileName(segmentFileName(++sequence));
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qCWarning(wsEngine) << "Failed to create capture segment" << file.fileName() << file.errorString();
+        return false;
+    }
+    // preallocate the segment, the mapped pages are zero-filled
+    if (!file.resize(segmentSize) || (map = file.map(0, segmentSize)) == nullptr) {
+        qCWarning(wsEngine) << "Failed to map capture segment" << file.fileName() << file.errorString();
+        file.close();
+        file.remove();
+        return false;
+    }
+
+    std::memcpy(map, CaptureFormat::Magic, sizeof(CaptureFormat::Magic));
+    qToLittleEndian<quint32>(CaptureFormat::Version, map + 8);
+    qToLittleEndian<quint32>(sequence, map + 12);
+    qToLittleEndian<quint64>(static_cast<quint64>(startMs), map + 16);
+    offset = CaptureFormat::SegmentHeaderSize;
+    return true;
+}
+
+void TrafficCapturePrivate::closeSegment() {
+    if (!map) {
+        return;
+    }
+    file.unmap(map);
+    map = nullptr;
+    file.resize(offset);
+    file.close();
+}
+
+uchar *TrafficCapturePrivate::appendRecord(CaptureFormat::RecordType type, quint64 connectionId, qint64 payloadSize) {
+    qint64 size = CaptureFormat::RecordHeaderSize + payloadSize;
+    if (!map || size > segmentSize - CaptureFormat::SegmentHeaderSize) {
+        dropped.fetchAndAddRelaxed(1);
+        return nullptr;
+    }
+    if (offset + size > segmentSize) {
+        closeSegment();
+        if (!openSegment()) {
+            active.storeRelease(0);
+            dropped.fetchAndAddRelaxed(1);
+            return nullptr;
+        }
+    }
+
+    uchar *record = map + offset;
+    qToLittleEndian<quint32>(static_cast<quint32>(size), record);
+    record[4] = type;
+    qToLittleEndian<quint64>(static_cast<quint64>(clock.nsecsElapsed()), record + 8);
+    qToLittleEndian<quint64>(connectionId, record + 16);
+    offset += size;
+    recorded.fetchAndAddRelaxed(1);
+    return record + CaptureFormat::RecordHeaderSize;
+}
+
+TrafficCapture::TrafficCapture(const QString &directory, QObject *parent)
+    : QObject(parent), d(new TrafficCapturePrivate(this, directory)) {}
+
+TrafficCapture::~TrafficCapture() {
+    stop();
+    delete d;
+}
+
+void TrafficCapture::setSegmentSize(qint64 bytes) {
+    QMutexLocker locker(&d->mutex);
+    d->segmentSize = qMax<qint64>(bytes, 4096);
+}
+
+qint64 TrafficCapture::segmentSize() const {
+    return d->segmentSize;
+}
+
+void TrafficCapture::setRedactedHeaders(const QList<QByteArray> &names) {
+    QMutexLocker locker(&d->mutex);
+    d->redactedHeaders.clear();
+    for (const QByteArray &name : names) {
+        d->redactedHeaders.append(name.toLower());
+    }
+}
+
+QList<QByteArray> TrafficCapture::redactedHeaders() const {
+    QMutexLocker locker(&d->mutex);
+    return d->redactedHeaders;
+}
+
+bool TrafficCapture::start() {
+    QMutexLocker locker(&d->mutex);
+    if (d->active.loadAcquire()) {
+        return true;
+    }
+    if (!QDir().mkpath(d->directory)) {
+        qCWarning(wsEngine) << "Failed to create capture directory" << d->directory;
+        return false;
+    }
+
+    // segments of a previous capture would be read as continuation of this one
+    QDir directory(d->directory);
+    for (const QString &fileName : directory.entryList(QStringList() << "capture-*.qwscap", QDir::Files)) {
+        if (!directory.remove(fileName)) {
+            qCWarning(wsEngine) << "Failed to remove previous capture segment" << directory.filePath(fileName);
+            return false;
+        }
+    }
+
+    d->sequence = 0;
+    d->startMs = QDateTime::currentMSecsSinceEpoch();
+    d->clock.start();
+    if (!d->openSegment()) {
+        return false;
+    }
+    d->active.storeRelease(1);
+    qCDebug(wsEngine) << "Started traffic capture in" << d->directory;
+    return true;
+}
+
+void TrafficCapture::stop() {
+    QMutexLocker locker(&d->mutex);
+    d->active.storeRelease(0);
+    d->closeSegment();
+}
+
+bool TrafficCapture::isActive() const {
+    return d->active.loadAcquire() != 0;
+}
+
+quint64 TrafficCapture::recordedCount() const {
+    return d->recorded.loadAcquire();
+}
+
+quint64 TrafficCapture::droppedCount() const {
+    return d->dropped.loadAcquire();
+}
+
+void TrafficCapture::recordConnection(quint64 connectionId, const QString &path, const QNetworkRequest &request,
+                                      bool authenticated) {
+    if (!d->active.loadAcquire()) {
+        return;
+    }
+
+    QMutexLocker locker(&d->mutex);
+
+    QByteArray        utf8Path = path.toUtf8().left(0xFFFF);
+    QList<QByteArray> names = request.rawHeaderList().mid(0, 0xFFFF);
+    QList<QByteArray> values;
+    qint64            size = 1 + 2 + utf8Path.size() + 2;
+    for (auto &name : names) {
+        name.truncate(0xFFFF);
+        values.append(d->redactedHeaders.contains(name.toLower()) ? QByteArray() : request.rawHeader(name));
+        size += 2 + name.size() + 4 + values.last().size();
+    }
+
+    uchar *out = d->appendRecord(CaptureFormat::Connect, connectionId, size);
+    if (!out) {
+        return;
+    }
+    *out++ = authenticated ? 1 : 0;
+    qToLittleEndian<quint16>(static_cast<quint16>(utf8Path.size()), out);
+    std::memcpy(out + 2, utf8Path.constData(), utf8Path.size());
+    out += 2 + utf8Path.size();
+    qToLittleEndian<quint16>(static_cast<quint16>(names.size()), out);
+    out += 2;
+    for (int i = 0; i < names.size(); i++) {
+        qToLittleEndian<quint16>(static_cast<quint16>(names.at(i).size()), out);
+        std::memcpy(out + 2, names.at(i).constData(), names.at(i).size());
+        out += 2 + names.at(i).size();
+        qToLittleEndian<quint32>(static_cast<quint32>(values.at(i).size()), out);
+        std::memcpy(out + 4, values.at(i).constData(), values.at(i).size());
+        out += 4 + values.at(i).size();
+    }
+}
+
+void TrafficCapture::recordTextMessage(quint64 connectionId, const QString &message) {
+    if (!d->active.loadAcquire()) {
+        return;
+    }
+    int size = utf8Length(message.constData(), message.size());
+
+    QMutexLocker locker(&d->mutex);
+    // encode directly into the mapped segment
+    uchar *out = d->appendRecord(CaptureFormat::Text, connectionId, size);
+    if (out) {
+        encodeUtf8(message.constData(), message.size(), out);
+    }
+}
+
+void TrafficCapture::recordBinaryMessage(quint64 connectionId, const QByteArray &message) {
+    if (!d->active.loadAcquire()) {
+        return;
+    }
+
+    QMutexLocker locker(&d->mutex);
+    uchar *      out = d->appendRecord(CaptureFormat::Binary, connectionId, message.size());
+    if (out) {
+        std::memcpy(out, message.constData(), message.size());
+    }
+}
+
+void TrafficCapture::recordClose(quint64 connectionId) {
+    if (!d->active.loadAcquire()) {
+        return;
+    }
+
+    QMutexLocker locker(&d->mutex);
+    d->appendRecord(CaptureFormat::Close, connectionId, 0);
+}
+
+}  // namespace QWsEngine
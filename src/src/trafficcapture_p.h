@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/trafficcapture.h>
+#include <qwsengine/trafficreplay.h>
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+
+namespace QWsEngine {
+
+class Connection;
+
+/**
+ * @brief Capture segment file format.
+ *
+ * A segment starts with a header followed by records. All integers are little endian. The records of a segment which
+ * hasn't been finalized are followed by zero bytes, a record size of 0 therefore ends a segment.
+ *
+ * Segment header: magic[8], version u32, sequence u32, capture start in ms since epoch u64.
+ * Record header: size u32 (including the header), type u8, reserved[3], timestamp ns u64, connection id u64.
+ *
+ * Record payloads:
+ * - Connect: authenticated u8, path length u16, path (UTF-8), header count u16,
+ *   per header: name length u16, name, value length u32, value
+ * - Text: message (UTF-8)
+ * - Binary: message
+ * - Close: none
+ */
+namespace CaptureFormat {
+
+enum RecordType : quint8 { Connect = 1, Text = 2, Binary = 3, Close = 4 };
+
+static const char    Magic[8] = {'Q', 'W', 'S', 'C', 'A', 'P', '\0', '\0'};
+static const quint32 Version = 1;
+static const int     SegmentHeaderSize = 24;
+static const int     RecordHeaderSize = 24;
+
+}  // namespace CaptureFormat
+
+class TrafficCapturePrivate {
+ public:
+    TrafficCapturePrivate(TrafficCapture *capture, const QString &directory);
+
+    /**
+     * @brief Reserve a record in the current segment and write its header. Returns the payload pointer.
+     *
+     * Must be called with the mutex locked. Returns nullptr if the capture is inactive or the record doesn't fit into
+     * an empty segment.
+     */
+    uchar *appendRecord(CaptureFormat::RecordType type, quint64 connectionId, qint64 payloadSize);
+
+    bool openSegment();
+    void closeSegment();
+
+    QString segmentFileName(quint32 sequence) const;
+
+    const QString     directory;
+    qint64            segmentSize;
+    QList<QByteArray> redactedHeaders;
+
+    QMutex        mutex;
+    QAtomicInt    active;
+    QElapsedTimer clock;
+    qint64        startMs;
+
+    QFile   file;
+    uchar * map;
+    qint64  offset;
+    quint32 sequence;
+
+    QAtomicInteger<quint64> recorded;
+    QAtomicInteger<quint64> dropped;
+
+ private:
+    TrafficCapture *const q;
+};
+
+/**
+ * @brief Captured event referencing the payload in a mapped segment.
+ */
+struct CapturedEvent {
+    CaptureFormat::RecordType type;
+    qint64                    timestamp;
+    quint64                   connectionId;
+    const uchar *             payload;
+    int                       payloadSize;
+};
+
+class TrafficReplayPrivate : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit TrafficReplayPrivate(TrafficReplay *replay);
+    ~TrafficReplayPrivate();
+
+    bool loadSegment(const QString &fileName);
+    void replay(const CapturedEvent &event);
+    void replayConnect(const CapturedEvent &event);
+
+    /**
+     * @brief Read the captured headers of a connect event starting at the header count.
+     */
+    static void readHeaders(const CapturedEvent &event, int offset, QNetworkRequest *request);
+
+    ConnectionHandler *connectionHandler;
+    Handler *          messageHandler;
+
+    QList<QFile *>          segments;
+    QVector<CapturedEvent>  events;
+    TrafficReplay::Timing   timing;
+    int                     position;
+    bool                    running;
+    QTimer                  timer;
+    QElapsedTimer           clock;
+    qint64                  elapsed;
+    int                     messages;
+    int                     connectionCount;
+    int                     rejected;
+
+    // captured connection id -> replayed connection
+    QHash<quint64, QSharedPointer<Connection>> connections;
+
+ public Q_SLOTS:  // NOLINT
+    void replayNext();
+
+ private:
+    TrafficReplay *const q;
+};
+
+}  // namespace QWsEngine
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/connection.h>
+#include <qwsengine/connectionhandler.h>
+
+#include <QDir>
+#include <QUrl>
+#include <QtEndian>
+#include <QtWebSockets/QWebSocket>
+
+#include <cstring>
+
+#include "trafficcapture_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+// number of events replayed as fast as possible before returning to the event loop
+static const int ReplayBatchSize = 256;
+
+TrafficReplayPrivate::TrafficReplayPrivate(TrafficReplay *replay)
+    : QObject(replay),
+      connectionHandler(nullptr),
+      messageHandler(nullptr),
+      timing(TrafficReplay::AsFastAsPossible),
+      position(0),
+      running(false),
+      elapsed(0),
+      messages(0),
+      connectionCount(0),
+      rejected(0),
+      q(replay) {
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &TrafficReplayPrivate::replayNext);
+}
+
+TrafficReplayPrivate::~TrafficReplayPrivate() {
+    // release the connections before the mapped payloads
+    connections.clear();
+    events.clear();
+    qDeleteAll(segments);
+}
+
+bool TrafficReplayPrivate::loadSegment(const QString &fileName) {
+    QFile *file = new QFile(fileName);
+    if (!file->open(QIODevice::ReadOnly) || file->size() < CaptureFormat::SegmentHeaderSize) {
+        qCWarning(wsEngine) << "Failed to open capture segment" << fileName << file->errorString();
+        delete file;
+        return false;
+    }
+
+    qint64       size = file->size();
+    const uchar *map = file->map(0, size);
+    if (!map || std::memcmp(map, CaptureFormat::Magic, sizeof(CaptureFormat::Magic)) != 0 ||
+        qFromLittleEndian<quint32>(map + 8) != CaptureFormat::Version) {
+        qCWarning(wsEngine) << "Invalid capture segment" << fileName;
+        delete file;
+        return false;
+    }
+
+    qint64 offset = CaptureFormat::SegmentHeaderSize;
+    while (offset + CaptureFormat::RecordHeaderSize <= size) {
+        const uchar *record = map + offset;
+        quint32      recordSize = qFromLittleEndian<quint32>(record);
+        // a record size of 0 marks the end of a segment which wasn't finalized
+        if (recordSize < CaptureFormat::RecordHeaderSize || offset + recordSize > size) {
+            break;
+        }
+
+        CapturedEvent event;
+        event.type = static_cast<CaptureFormat::RecordType>(record[4]);
+        event.timestamp = static_cast<qint64>(qFromLittleEndian<quint64>(record + 8));
+        event.connectionId = qFromLittleEndian<quint64>(record + 16);
+        event.payload = record + CaptureFormat::RecordHeaderSize;
+        event.payloadSize = static_cast<int>(recordSize - CaptureFormat::RecordHeaderSize);
+        events.append(event);
+
+        offset += recordSize;
+    }
+
+    segments.append(file);
+    return true;
+}
+
+void TrafficReplayPrivate::readHeaders(const CapturedEvent &event, int offset, QNetworkRequest *request) {
+    const uchar *in = event.payload + offset;
+    const uchar *end = event.payload + event.payloadSize;
+    if (end - in < 2) {
+        return;
+    }
+    int count = qFromLittleEndian<quint16>(in);
+    in += 2;
+    for (int i = 0; i < count; i++) {
+        if (end - in < 2) {
+            return;
+        }
+        int nameSize = qFromLittleEndian<quint16>(in);
+        if (end - in < 2 + nameSize + 4) {
+            return;
+        }
+        QByteArray name(reinterpret_cast<const char *>(in + 2), nameSize);
+        in += 2 + nameSize;
+        quint32 valueSize = qFromLittleEndian<quint32>(in);
+        if (static_cast<quint64>(end - in - 4) < valueSize) {
+            return;
+        }
+        request->setRawHeader(name, QByteArray(reinterpret_cast<const char *>(in + 4), static_cast<int>(valueSize)));
+        in += 4 + valueSize;
+    }
+}
+
+void TrafficReplayPrivate::replayConnect(const CapturedEvent &event) {
+    if (event.payloadSize < 3) {
+        return;
+    }
+    bool    authenticated = event.payload[0] != 0;
+    int     pathSize = qMin<int>(qFromLittleEndian<quint16>(event.payload + 1), event.payloadSize - 3);
+    QString path = QString::fromUtf8(reinterpret_cast<const char *>(event.payload + 3), pathSize);
+
+    QNetworkRequest request;
+    request.setUrl(QUrl(path));
+    readHeaders(event, 3 + pathSize, &request);
+
+    QWebSocket *               socket = new QWebSocket();
+    QSharedPointer<Connection> connection;
+    if (messageHandler) {
+        connection = QSharedPointer<Connection>::create(socket, messageHandler, authenticated);
+    } else if (connectionHandler) {
+        // the connection handler takes care of the socket if routing fails
+        connection = connectionHandler->route(socket, path);
+    } else {
+        delete socket;
+    }
+
+    if (connection) {
+        if (connection->isAuthenticated() != authenticated) {
+            connection->setAuthenticated(authenticated);
+        }
+        connections.insert(event.connectionId, connection);
+        connectionCount++;
+        emit q->connectionReplayed(connection, request);
+    } else {
+        rejected++;
+    }
+}
+
+void TrafficReplayPrivate::replay(const CapturedEvent &event) {
+    switch (event.type) {
+        case CaptureFormat::Connect:
+            replayConnect(event);
+            break;
+        case CaptureFormat::Text: {
+            auto connection = connections.value(event.connectionId);
+            if (connection) {
+                connection->processTextMessage(
+                    QString::fromUtf8(reinterpret_cast<const char *>(event.payload), event.payloadSize));
+                messages++;
+            }
+            break;
+        }
+        case CaptureFormat::Binary: {
+            auto connection = connections.value(event.connectionId);
+            if (connection) {
+                // the payload stays mapped until the replay is deleted
+                connection->processBinaryMessage(
+                    QByteArray::fromRawData(reinterpret_cast<const char *>(event.payload), event.payloadSize));
+                messages++;
+            }
+            break;
+        }
+        case CaptureFormat::Close:
+            connections.remove(event.connectionId);
+            break;
+    }
+}
+
+void TrafficReplayPrivate::replayNext() {
+    int batch = 0;
+    while (position < events.size()) {
+        const CapturedEvent &event = events.at(position);
+        if (timing == TrafficReplay::OriginalTiming) {
+            qint64 due = event.timestamp - events.first().timestamp;
+            qint64 now = clock.nsecsElapsed();
+            if (due > now) {
+                timer.start(static_cast<int>((due - now) / 1000000));
+                return;
+            }
+        } else if (++batch > ReplayBatchSize) {
+            // give the event loop a chance to process queued sends and invocations
+            timer.start(0);
+            return;
+        }
+
+        replay(event);
+        position++;
+    }
+
+    elapsed = clock.nsecsElapsed();
+    running = false;
+    connections.clear();
+    qCDebug(wsEngine) << "Replayed" << messages << "messages of" << connectionCount << "connections in"
+                      << elapsed / 1000000 << "ms";
+    emit q->finished();
+}
+
+TrafficReplay::TrafficReplay(ConnectionHandler *handler, QObject *parent)
+    : QObject(parent), d(new TrafficReplayPrivate(this)) {
+    d->connectionHandler = handler;
+}
+
+TrafficReplay::~TrafficReplay() {}
+
+void TrafficReplay::setMessageHandler(Handler *handler) {
+    d->messageHandler = handler;
+}
+
+bool TrafficReplay::load(const QString &directory) {
+    if (d->running) {
+        qCWarning(wsEngine) << "Can't load a capture while replaying";
+        return false;
+    }
+
+    d->connections.clear();
+    d->events.clear();
+    qDeleteAll(d->segments);
+    d->segments.clear();
+
+    QDir dir(directory);
+    // the zero-padded sequence number keeps the segments in capture order
+    const QStringList files = dir.entryList(QStringList() << "capture-*.qwscap", QDir::Files, QDir::Name);
+    for (const QString &file : files) {
+        d->loadSegment(dir.filePath(file));
+    }
+    qCDebug(wsEngine) << "Loaded" << d->events.size() << "events from" << d->segments.size() << "capture segments";
+    return !d->segments.isEmpty();
+}
+
+void TrafficReplay::start(Timing timing) {
+    if (d->running) {
+        return;
+    }
+    d->timing = timing;
+    d->position = 0;
+    d->messages = 0;
+    d->connectionCount = 0;
+    d->rejected = 0;
+    d->elapsed = 0;
+    d->running = true;
+    d->clock.start();
+    d->timer.start(0);
+}
+
+bool TrafficReplay::isRunning() const {
+    return d->running;
+}
+
+int TrafficReplay::eventCount() const {
+    return d->events.size();
+}
+
+int TrafficReplay::replayedMessages() const {
+    return d->messages;
+}
+
+int TrafficReplay::replayedConnections() const {
+    return d->connectionCount;
+}
+
+int TrafficReplay::rejectedConnections() const {
+    return d->rejected;
+}
+
+qint64 TrafficReplay::elapsedNs() const {
+    return d->running ? d->clock.nsecsElapsed() : d->elapsed;
+}
+
+}  // namespace QWsEngine
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include <qwsengine/connection.h>
+#include <qwsengine/jsonreader.h>
+#include <qwsengine/typedhandler.h>
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <cstring>
+
+#include "bufferpool_p.h"
+#include "handler_p.h"
+#include "stallwatchdog_p.h"
+#include "tracerecorder_p.h"
+#include "wslogging_p.h"
+
+namespace QWsEngine {
+
+namespace {
+
+// strcmp() of the NUL terminated route name with the string view
+int compareName(const char *routeName, QLatin1String name) {
+    int result = strncmp(routeName, name.data(), static_cast<size_t>(name.size()));
+    if (result == 0 && routeName[name.size()] != '\0') {
+        return 1;
+    }
+    return result;
+}
+
+}  // namespace
+
+TypedHandler::TypedHandler(const Route *routes, int routeCount, QObject *parent)
+    : Handler(parent), m_routes(routes), m_routeCount(routeCount), m_msgNameField("type") {}
+
+TypedHandler::~TypedHandler() {}
+
+void TypedHandler::setMsgNameField(const QByteArray &fieldName) {
+    m_msgNameField = fieldName;
+}
+
+QByteArray TypedHandler::msgNameField() const {
+    return m_msgNameField;
+}
+
+const TypedHandler::Route *TypedHandler::findRoute(QLatin1String msgName) const {
+    int low = 0;
+    int high = m_routeCount - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int result = compareName(m_routes[mid].msgName, msgName);
+        if (result == 0) {
+            return &m_routes[mid];
+        }
+        if (result < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return nullptr;
+}
+
+void TypedHandler::routeTextMessage(QSharedPointer<Connection> connection, const QString &message) {
+    if (connection->isAuthenticated()) {
+        bool handled;
+        {
+            PooledBuffer utf8(utf8Length(message.constData(), message.size()));
+            encodeUtf8(message.constData(), message.size(), &utf8.buffer);
+            handled = routeUtf8Message(connection, utf8.buffer);
+        }
+        if (handled) {
+            return;
+        }
+    }
+    Handler::routeTextMessage(connection, message);
+}
+
+bool TypedHandler::routeUtf8Message(const QSharedPointer<Connection> &connection, const QByteArray &utf8) {
+    if (!connection->isAuthenticated()) {
+        return false;
+    }
+
+    // find the message name: only the top level keys are read, other values are skipped without decoding them
+    JsonReader    scan(utf8);
+    QLatin1String key(m_msgNameField.constData(), m_msgNameField.size());
+    QLatin1String name;
+    QLatin1String current;
+    bool          found = false;
+    if (scan.beginObject()) {
+        while (scan.nextKey(&current)) {
+            if (current == key) {
+                found = scan.readStringView(&name);
+                break;
+            }
+            if (!scan.skipValue()) {
+                break;
+            }
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    const Route *route = findRoute(name);
+    if (!route) {
+        return false;
+    }
+
+    StallWatchdogScope stallScope(connection->id(), route->msgName, metaObject()->className());
+    QWSENGINE_TRACE_BEGIN_MESSAGE();
+
+    // middleware expects the JSON object of the generic path, which is only created if middleware is installed
+    auto snapshot = HandlerPrivate::get(this)->snapshot.load();
+    if (!snapshot->routing.middleware().isEmpty()) {
+        QJsonParseError parseError;
+        QJsonDocument   doc = QJsonDocument::fromJson(utf8, &parseError);
+        if (parseError.error != QJsonParseError::NoError) {
+            connection->sendErrorResponse(400, "Invalid json");
+            return true;
+        }
+        if (!HandlerPrivate::runMiddleware(*snapshot, connection, QString::fromUtf8(route->msgName),
+                                           QVariant(doc.object()))) {
+            return true;
+        }
+    }
+
+    QWSENGINE_TRACE_MESSAGE(ParseStart, connection->id(), static_cast<quint32>(utf8.size()));
+    JsonReader reader(utf8);
+    bool       valid = route->dispatch(this, connection, &reader);
+    QWSENGINE_TRACE_MESSAGE(ParseEnd, connection->id(), valid ? 1 : 0);
+    if (!valid) {
+        qCDebug(wsEngine) << "Invalid" << route->msgName << "message at offset" << reader.offset();
+        connection->sendErrorResponse(400, QStringLiteral("Invalid %1 message").arg(QLatin1String(route->msgName)));
+    }
+    return true;
+}
+
+}  // namespace QWsEngine
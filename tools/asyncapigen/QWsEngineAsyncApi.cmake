@@ -0,0 +1,53 @@
+include(CMakeParseArguments)
+
+# qwsengine_generate_asyncapi(<target> SPEC <file> [NAME <name>] [NAMESPACE <namespace>] [HANDLER <class>])
+#
+# Generates <name>.h and <name>.cpp from an AsyncAPI 2.x JSON document with qwsengine-asyncapi-gen and adds them to
+# the target. The generated header is included with #include "<name>.h".
+#
+# Included by qwsengineConfig.cmake if QWsEngine was installed with BUILD_TOOLS=ON, the default is OFF.
+function(qwsengine_generate_asyncapi target)
+    cmake_parse_arguments(ARG "" "SPEC;NAME;NAMESPACE;HANDLER" "" ${ARGN})
+    if(NOT ARG_SPEC)
+        message(FATAL_ERROR "qwsengine_generate_asyncapi: SPEC is required")
+    endif()
+    get_filename_component(spec "${ARG_SPEC}" ABSOLUTE)
+    if(NOT ARG_NAME)
+        get_filename_component(ARG_NAME "${spec}" NAME_WE)
+    endif()
+
+    if(TARGET qwsengine-asyncapi-gen)
+        set(generator $<TARGET_FILE:qwsengine-asyncapi-gen>)
+        set(generator_depends qwsengine-asyncapi-gen)
+    else()
+        find_program(QWSENGINE_ASYNCAPI_GEN qwsengine-asyncapi-gen)
+        if(NOT QWSENGINE_ASYNCAPI_GEN)
+            message(FATAL_ERROR "qwsengine_generate_asyncapi: qwsengine-asyncapi-gen not found")
+        endif()
+        set(generator "${QWSENGINE_ASYNCAPI_GEN}")
+        set(generator_depends "${QWSENGINE_ASYNCAPI_GEN}")
+    endif()
+
+    set(args --output-dir "${CMAKE_CURRENT_BINARY_DIR}/asyncapi" --name "${ARG_NAME}")
+    if(ARG_NAMESPACE)
+        list(APPEND args --namespace "${ARG_NAMESPACE}")
+    endif()
+    if(ARG_HANDLER)
+        list(APPEND args --handler "${ARG_HANDLER}")
+    endif()
+
+    set(outputs
+        "${CMAKE_CURRENT_BINARY_DIR}/asyncapi/${ARG_NAME}.h"
+        "${CMAKE_CURRENT_BINARY_DIR}/asyncapi/${ARG_NAME}.cpp"
+    )
+    add_custom_command(
+        OUTPUT ${outputs}
+        COMMAND ${generator} ${args} "${spec}"
+        DEPENDS "${spec}" ${generator_depends}
+        COMMENT "Generating ${ARG_NAME} from ${ARG_SPEC}"
+        VERBATIM
+    )
+    set_source_files_properties(${outputs} PROPERTIES SKIP_AUTOMOC ON)
+    target_sources(${target} PRIVATE ${outputs})
+    target_include_directories(${target} PRIVATE "${CMAKE_CURRENT_BINARY_DIR}/asyncapi")
+endfunction()
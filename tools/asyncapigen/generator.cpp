@@ -0,0 +1,703 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include "generator.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMap>
+
+#include <algorithm>
+
+namespace {
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+const Qt::SplitBehavior kSkipEmptyNames = Qt::SkipEmptyParts;
+#else
+const QString::SplitBehavior kSkipEmptyNames = QString::SkipEmptyParts;
+#endif
+
+const char *const kKeywords[] = {"alignas",  "alignof",  "and",      "asm",       "auto",     "bool",     "break",
+                                 "case",     "catch",    "char",     "class",     "const",    "continue", "default",
+                                 "delete",   "do",       "double",   "else",      "enum",     "explicit", "export",
+                                 "extern",   "false",    "float",    "for",       "friend",   "goto",     "if",
+                                 "inline",   "int",      "long",     "mutable",   "namespace", "new",     "not",
+                                 "operator", "or",       "private",  "protected", "public",   "register", "return",
+                                 "short",    "signed",   "sizeof",   "static",    "struct",   "switch",   "template",
+                                 "this",     "throw",    "true",     "try",       "typedef",  "typeid",   "typename",
+                                 "union",    "unsigned", "using",    "virtual",   "void",     "volatile", "while",
+                                 "read",     "write",    "msgName"};
+
+bool isKeyword(const QString &name) {
+    for (const char *keyword : kKeywords) {
+        if (name == QLatin1String(keyword)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString pascalCase(const QString &name) {
+    QString result;
+    bool    upper = true;
+    for (QChar c : name) {
+        if (c.isLetterOrNumber() && c.unicode() < 0x80) {
+            result.append(upper ? c.toUpper() : c);
+            upper = false;
+        } else {
+            upper = true;
+        }
+    }
+    if (result.isEmpty() || result.at(0).isDigit()) {
+        result.prepend(QLatin1Char('_'));
+    }
+    return result;
+}
+
+QString identifier(const QString &name) {
+    QString result;
+    for (QChar c : name) {
+        result.append((c.isLetterOrNumber() && c.unicode() < 0x80) ? c : QLatin1Char('_'));
+    }
+    if (result.isEmpty() || result.at(0).isDigit()) {
+        result.prepend(QLatin1Char('_'));
+    }
+    if (isKeyword(result)) {
+        result.append(QLatin1Char('_'));
+    }
+    return result;
+}
+
+// UTF-8 encoded C string literal
+QString cString(const QString &value) {
+    QString    result(QLatin1Char('"'));
+    QByteArray utf8 = value.toUtf8();
+    for (char c : utf8) {
+        uchar u = static_cast<uchar>(c);
+        if (c == '"' || c == '\\') {
+            result.append(QLatin1Char('\\')).append(QLatin1Char(c));
+        } else if (u < 0x20 || u >= 0x7f) {
+            result.append(QStringLiteral("\\%1").arg(static_cast<uint>(u), 3, 8, QLatin1Char('0')));
+        } else {
+            result.append(QLatin1Char(c));
+        }
+    }
+    result.append(QLatin1Char('"'));
+    return result;
+}
+
+QString unescapePointer(QString token) {
+    return token.replace(QLatin1String("~1"), QLatin1String("/")).replace(QLatin1String("~0"), QLatin1String("~"));
+}
+
+QString indent(int level) {
+    return QString(level * 4, QLatin1Char(' '));
+}
+
+QString hexMask(quint64 mask) {
+    return QStringLiteral("Q_UINT64_C(0x%1)").arg(mask, 0, 16);
+}
+
+}  // namespace
+
+Generator::Generator() : m_msgNameField(QStringLiteral("type")) {}
+
+QJsonObject Generator::resolve(const QJsonObject &schema, QString *ref) const {
+    QJsonObject current = schema;
+    for (int hops = 0; hops < 32 && current.contains(QLatin1String("$ref")); hops++) {
+        QString pointer = current.value(QLatin1String("$ref")).toString();
+        if (!pointer.startsWith(QLatin1String("#/"))) {
+            return QJsonObject();
+        }
+        QJsonValue value = m_document;
+        for (const QString &token : pointer.mid(2).split(QLatin1Char('/'))) {
+            value = value.toObject().value(unescapePointer(token));
+        }
+        if (!value.isObject()) {
+            return QJsonObject();
+        }
+        if (ref) {
+            *ref = pointer;
+        }
+        current = value.toObject();
+    }
+    return current;
+}
+
+Generator::Kind Generator::scalarKind(const QJsonObject &schema) const {
+    QString    typeName;
+    QJsonValue type = schema.value(QLatin1String("type"));
+    if (type.isArray()) {
+        // nullable types like ["string", "null"]
+        for (const QJsonValue &entry : type.toArray()) {
+            if (entry.toString() != QLatin1String("null")) {
+                if (!typeName.isEmpty()) {
+                    return Raw;
+                }
+                typeName = entry.toString();
+            }
+        }
+    } else {
+        typeName = type.toString();
+    }
+
+    if (typeName == QLatin1String("string")) {
+        return String;
+    }
+    if (typeName == QLatin1String("integer")) {
+        return Integer;
+    }
+    if (typeName == QLatin1String("number")) {
+        return Number;
+    }
+    if (typeName == QLatin1String("boolean")) {
+        return Boolean;
+    }
+    if (typeName == QLatin1String("array")) {
+        return Array;
+    }
+    if (typeName == QLatin1String("object") || (typeName.isEmpty() && schema.contains(QLatin1String("properties")))) {
+        return Struct;
+    }
+    return Raw;
+}
+
+Generator::Type Generator::typeOf(const QJsonObject &schema, const QString &nameHint) {
+    QString     ref;
+    QJsonObject resolved = resolve(schema, &ref);
+    Type        type;
+    type.kind = scalarKind(resolved);
+
+    if (type.kind == Struct) {
+        if (resolved.value(QLatin1String("properties")).toObject().isEmpty()) {
+            // free-form object
+            type.kind = Raw;
+        } else if (ref.isEmpty()) {
+            type.structName = buildStruct(resolved, nameHint, false, QString());
+        } else if (m_refStructs.contains(ref)) {
+            type.structName = m_refStructs.value(ref);
+        } else if (m_resolving.contains(ref)) {
+            m_warnings.append(QStringLiteral("Recursive schema %1 is kept as raw JSON").arg(ref));
+            type.kind = Raw;
+        } else {
+            m_resolving.insert(ref);
+            type.structName = buildStruct(resolved, pascalCase(ref.section(QLatin1Char('/'), -1)), false, QString());
+            m_resolving.remove(ref);
+            m_refStructs.insert(ref, type.structName);
+        }
+    } else if (type.kind == Array) {
+        Type item = typeOf(resolved.value(QLatin1String("items")).toObject(), nameHint);
+        if (item.kind == Array) {
+            m_warnings.append(QStringLiteral("Nested array %1 is kept as raw JSON").arg(nameHint));
+            type.kind = Raw;
+        } else {
+            type.elementKind = item.kind;
+            type.structName = item.structName;
+        }
+    } else if (type.kind == Raw && !resolved.isEmpty()) {
+        for (const char *combinator : {"oneOf", "anyOf", "allOf", "not"}) {
+            if (resolved.contains(QLatin1String(combinator))) {
+                m_warnings.append(
+                    QStringLiteral("%1 in %2 is kept as raw JSON").arg(QLatin1String(combinator), nameHint));
+                break;
+            }
+        }
+    }
+    return type;
+}
+
+QString Generator::uniqueStructName(const QString &name) {
+    QString result = name;
+    for (int i = 2; m_structNames.contains(result) || result == m_handlerName; i++) {
+        result = name + QString::number(i);
+    }
+    m_structNames.insert(result);
+    return result;
+}
+
+QString Generator::buildStruct(const QJsonObject &schema, const QString &name, bool isMessage,
+                               const QString &wireName) {
+    StructDef def;
+    def.name = uniqueStructName(name);
+    def.isMessage = isMessage;
+    def.wireName = wireName;
+
+    QSet<QString> required;
+    for (const QJsonValue &entry : schema.value(QLatin1String("required")).toArray()) {
+        required.insert(entry.toString());
+    }
+
+    QJsonObject properties = schema.value(QLatin1String("properties")).toObject();
+    QStringList keys = properties.keys();
+    if (keys.removeOne(m_msgNameField)) {
+        keys.prepend(m_msgNameField);
+    }
+
+    QSet<QString> members;
+    int           requiredCount = 0;
+    for (const QString &key : keys) {
+        QJsonObject property = properties.value(key).toObject();
+        QJsonObject resolved = resolve(property);
+
+        Field field;
+        field.jsonName = key;
+        field.member = identifier(key);
+        while (members.contains(field.member)) {
+            field.member.append(QLatin1Char('_'));
+        }
+        members.insert(field.member);
+        members.insert(QStringLiteral("has_") + field.member);
+        field.type = typeOf(property, def.name + pascalCase(key));
+        field.required = required.contains(key);
+        if (field.required && ++requiredCount > 64) {
+            m_warnings.append(QStringLiteral("%1.%2: more than 64 required fields, treated as optional")
+                                  .arg(def.name, key));
+            field.required = false;
+        }
+        if (field.type.kind == String) {
+            QJsonArray values = resolved.value(QLatin1String("enum")).toArray();
+            if (resolved.value(QLatin1String("const")).isString()) {
+                field.constValue = resolved.value(QLatin1String("const")).toString();
+            } else if (values.size() == 1 && values.at(0).isString()) {
+                field.constValue = values.at(0).toString();
+            }
+        }
+        def.fields.append(field);
+    }
+
+    m_structs.append(def);
+    return def.name;
+}
+
+QString Generator::wireNameOf(const QString &key, const QJsonObject &message, const QJsonObject &payload) const {
+    QJsonObject field = resolve(payload.value(QLatin1String("properties")).toObject().value(m_msgNameField).toObject());
+    if (field.value(QLatin1String("const")).isString()) {
+        return field.value(QLatin1String("const")).toString();
+    }
+    QJsonArray values = field.value(QLatin1String("enum")).toArray();
+    if (values.size() == 1 && values.at(0).isString()) {
+        return values.at(0).toString();
+    }
+    if (message.value(QLatin1String("name")).isString()) {
+        return message.value(QLatin1String("name")).toString();
+    }
+    return key;
+}
+
+QSet<QString> Generator::inboundMessageKeys() const {
+    const QString prefix = QStringLiteral("#/components/messages/");
+    QSet<QString> keys;
+    QJsonObject   channels = m_document.value(QLatin1String("channels")).toObject();
+    for (auto it = channels.constBegin(); it != channels.constEnd(); ++it) {
+        QJsonObject message =
+            it.value().toObject().value(QLatin1String("publish")).toObject().value(QLatin1String("message")).toObject();
+        QJsonArray candidates;
+        if (message.contains(QLatin1String("oneOf"))) {
+            candidates = message.value(QLatin1String("oneOf")).toArray();
+        } else if (!message.isEmpty()) {
+            candidates.append(message);
+        }
+        for (const QJsonValue &candidate : candidates) {
+            QString ref = candidate.toObject().value(QLatin1String("$ref")).toString();
+            if (ref.startsWith(prefix)) {
+                keys.insert(unescapePointer(ref.mid(prefix.size())));
+            }
+        }
+    }
+    return keys;
+}
+
+bool Generator::load(const QByteArray &json, QString *errorMsg) {
+    QJsonParseError parseError;
+    QJsonDocument   doc = QJsonDocument::fromJson(json, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        *errorMsg = QStringLiteral("Invalid JSON document at offset %1: %2 (YAML documents must be converted to JSON)")
+                        .arg(parseError.offset)
+                        .arg(parseError.errorString());
+        return false;
+    }
+    m_document = doc.object();
+
+    QString version = m_document.value(QLatin1String("asyncapi")).toString();
+    if (!version.startsWith(QLatin1String("2."))) {
+        *errorMsg = QStringLiteral("Unsupported AsyncAPI version '%1', expected 2.x").arg(version);
+        return false;
+    }
+
+    QJsonObject messages =
+        m_document.value(QLatin1String("components")).toObject().value(QLatin1String("messages")).toObject();
+    if (messages.isEmpty()) {
+        *errorMsg = QStringLiteral("No messages defined in components/messages");
+        return false;
+    }
+
+    QSet<QString> inbound = inboundMessageKeys();
+    for (auto it = messages.constBegin(); it != messages.constEnd(); ++it) {
+        QJsonObject message = resolve(it.value().toObject());
+        QJsonObject payload = resolve(message.value(QLatin1String("payload")).toObject());
+        if (payload.value(QLatin1String("properties")).toObject().isEmpty()) {
+            m_warnings.append(QStringLiteral("Message %1 has no object payload, skipped").arg(it.key()));
+            continue;
+        }
+
+        Message entry;
+        entry.wireName = wireNameOf(it.key(), message, payload);
+        entry.structName = buildStruct(payload, pascalCase(it.key()), true, entry.wireName);
+        entry.inbound = inbound.isEmpty() || inbound.contains(it.key());
+        m_messages.append(entry);
+    }
+
+    std::sort(m_messages.begin(), m_messages.end(),
+              [](const Message &a, const Message &b) { return a.wireName.toUtf8() < b.wireName.toUtf8(); });
+    for (int i = 1; i < m_messages.size(); i++) {
+        if (m_messages.at(i).inbound && m_messages.at(i - 1).inbound &&
+            m_messages.at(i).wireName == m_messages.at(i - 1).wireName) {
+            *errorMsg = QStringLiteral("Duplicate message name '%1'").arg(m_messages.at(i).wireName);
+            return false;
+        }
+    }
+    return true;
+}
+
+QString Generator::cppType(Kind kind, const QString &structName) const {
+    switch (kind) {
+        case String:
+            return QStringLiteral("QString");
+        case Integer:
+            return QStringLiteral("qint64");
+        case Number:
+            return QStringLiteral("double");
+        case Boolean:
+            return QStringLiteral("bool");
+        case Struct:
+            return structName;
+        case Array:
+        case Raw:
+            break;
+    }
+    return QStringLiteral("QByteArray");
+}
+
+QString Generator::cppType(const Type &type) const {
+    if (type.kind == Array) {
+        return QStringLiteral("QVector<%1>").arg(cppType(type.elementKind, type.structName));
+    }
+    return cppType(type.kind, type.structName);
+}
+
+void Generator::writeStructDeclaration(QTextStream &out, const StructDef &def) const {
+    out << "struct " << def.name << " {\n";
+    for (const Field &field : def.fields) {
+        out << indent(1) << cppType(field.type) << ' ' << field.member;
+        if (!field.constValue.isEmpty()) {
+            out << " = QStringLiteral(" << cString(field.constValue) << ')';
+        } else if (field.type.kind == Integer || field.type.kind == Number) {
+            out << " = 0";
+        } else if (field.type.kind == Boolean) {
+            out << " = false";
+        }
+        out << ";\n";
+        if (!field.required) {
+            out << indent(1) << "bool has_" << field.member << " = false;\n";
+        }
+    }
+    out << '\n';
+    if (def.isMessage) {
+        out << indent(1) << "static QLatin1String msgName() { return QLatin1String(" << cString(def.wireName)
+            << "); }\n\n";
+    }
+    out << indent(1) << "bool read(QWsEngine::JsonReader *reader);\n";
+    out << indent(1) << "void write(QWsEngine::JsonWriter *writer) const;\n";
+    out << "};\n\n";
+}
+
+QString Generator::readCall(Kind kind, const QString &target) const {
+    switch (kind) {
+        case String:
+            return QStringLiteral("reader->readString(&%1)").arg(target);
+        case Integer:
+            return QStringLiteral("reader->readInt(&%1)").arg(target);
+        case Number:
+            return QStringLiteral("reader->readDouble(&%1)").arg(target);
+        case Boolean:
+            return QStringLiteral("reader->readBool(&%1)").arg(target);
+        case Struct:
+            return QStringLiteral("%1.read(reader)").arg(target);
+        case Array:
+        case Raw:
+            break;
+    }
+    return QStringLiteral("reader->readRawValue(&%1)").arg(target);
+}
+
+void Generator::writeFieldRead(QTextStream &out, const Field &field, int bit) const {
+    const QString in = indent(5);
+    out << indent(4) << "if (key == QLatin1String(" << cString(field.jsonName) << ")) {\n";
+    if (!field.required) {
+        out << in << "if (reader->peek() == QWsEngine::JsonReader::Null) {\n";
+        out << in << "    if (!reader->readNull()) {\n";
+        out << in << "        return false;\n";
+        out << in << "    }\n";
+        out << in << "    continue;\n";
+        out << in << "}\n";
+    }
+    if (!field.constValue.isEmpty()) {
+        // compare in place instead of allocating a copy of the constant
+        out << in << "QLatin1String value;\n";
+        out << in << "if (!reader->readStringView(&value) || value != QLatin1String(" << cString(field.constValue)
+            << ")) {\n";
+        out << in << "    return false;\n";
+        out << in << "}\n";
+    } else if (field.type.kind == Array) {
+        out << in << "if (!reader->beginArray()) {\n";
+        out << in << "    return false;\n";
+        out << in << "}\n";
+        out << in << field.member << ".clear();\n";
+        out << in << "while (reader->nextElement()) {\n";
+        out << in << "    " << field.member << ".append(" << cppType(field.type.elementKind, field.type.structName)
+            << "());\n";
+        out << in << "    if (!" << readCall(field.type.elementKind, field.member + QStringLiteral(".last()"))
+            << ") {\n";
+        out << in << "        return false;\n";
+        out << in << "    }\n";
+        out << in << "}\n";
+        out << in << "if (reader->hasError()) {\n";
+        out << in << "    return false;\n";
+        out << in << "}\n";
+    } else {
+        out << in << "if (!" << readCall(field.type.kind, field.member) << ") {\n";
+        out << in << "    return false;\n";
+        out << in << "}\n";
+    }
+    if (field.required) {
+        out << in << "found |= " << hexMask(Q_UINT64_C(1) << bit) << ";\n";
+    } else {
+        out << in << "has_" << field.member << " = true;\n";
+    }
+    out << in << "continue;\n";
+    out << indent(4) << "}\n";
+}
+
+void Generator::writeReadMethod(QTextStream &out, const StructDef &def) const {
+    // group the fields by the UTF-8 length of their key: most keys are rejected by a single integer comparison
+    QMap<int, QVector<int>> bySize;
+    quint64                 requiredMask = 0;
+    QVector<int>            bits(def.fields.size(), -1);
+    int                     bit = 0;
+    for (int i = 0; i < def.fields.size(); i++) {
+        bySize[def.fields.at(i).jsonName.toUtf8().size()].append(i);
+        if (def.fields.at(i).required) {
+            bits[i] = bit;
+            requiredMask |= Q_UINT64_C(1) << bit++;
+        }
+    }
+
+    out << "bool " << def.name << "::read(QWsEngine::JsonReader *reader) {\n";
+    if (requiredMask) {
+        out << indent(1) << "quint64 found = 0;\n";
+    }
+    out << indent(1) << "QLatin1String key;\n";
+    out << indent(1) << "if (!reader->beginObject()) {\n";
+    out << indent(1) << "    return false;\n";
+    out << indent(1) << "}\n";
+    out << indent(1) << "while (reader->nextKey(&key)) {\n";
+    out << indent(2) << "switch (key.size()) {\n";
+    for (auto it = bySize.constBegin(); it != bySize.constEnd(); ++it) {
+        out << indent(3) << "case " << it.key() << ":\n";
+        for (int index : it.value()) {
+            writeFieldRead(out, def.fields.at(index), bits.at(index));
+        }
+        out << indent(4) << "break;\n";
+    }
+    out << indent(3) << "default:\n";
+    out << indent(4) << "break;\n";
+    out << indent(2) << "}\n";
+    out << indent(2) << "if (!reader->skipValue()) {\n";
+    out << indent(2) << "    return false;\n";
+    out << indent(2) << "}\n";
+    out << indent(1) << "}\n";
+    if (requiredMask) {
+        out << indent(1) << "return !reader->hasError() && (found & " << hexMask(requiredMask) << ") == "
+            << hexMask(requiredMask) << ";\n";
+    } else {
+        out << indent(1) << "return !reader->hasError();\n";
+    }
+    out << "}\n\n";
+}
+
+void Generator::writeWriteMethod(QTextStream &out, const StructDef &def) const {
+    out << "void " << def.name << "::write(QWsEngine::JsonWriter *writer) const {\n";
+    out << indent(1) << "writer->beginObject();\n";
+    for (const Field &field : def.fields) {
+        int level = 1;
+        if (!field.required) {
+            out << indent(1) << "if (has_" << field.member << ") {\n";
+            level = 2;
+        }
+        const QString in = indent(level);
+        out << in << "writer->key(" << cString(field.jsonName) << ");\n";
+        if (field.type.kind == Struct) {
+            out << in << field.member << ".write(writer);\n";
+        } else if (field.type.kind == Raw) {
+            out << in << "if (" << field.member << ".isEmpty()) {\n";
+            out << in << "    writer->nullValue();\n";
+            out << in << "} else {\n";
+            out << in << "    writer->rawValue(" << field.member << ");\n";
+            out << in << "}\n";
+        } else if (field.type.kind == Array) {
+            out << in << "writer->beginArray();\n";
+            out << in << "for (const " << cppType(field.type.elementKind, field.type.structName)
+                << " &item : " << field.member << ") {\n";
+            switch (field.type.elementKind) {
+                case Struct:
+                    out << in << "    item.write(writer);\n";
+                    break;
+                case Raw:
+                    out << in << "    writer->rawValue(item);\n";
+                    break;
+                default:
+                    out << in << "    writer->value(item);\n";
+                    break;
+            }
+            out << in << "}\n";
+            out << in << "writer->endArray();\n";
+        } else {
+            out << in << "writer->value(" << field.member << ");\n";
+        }
+        if (!field.required) {
+            out << indent(1) << "}\n";
+        }
+    }
+    out << indent(1) << "writer->endObject();\n";
+    out << "}\n\n";
+}
+
+QByteArray Generator::header() const {
+    QString     text;
+    QTextStream out(&text);
+
+    QJsonObject info = m_document.value(QLatin1String("info")).toObject();
+    out << "// Generated by qwsengine-asyncapi-gen from " << info.value(QLatin1String("title")).toString() << ' '
+        << info.value(QLatin1String("version")).toString() << ". Do not edit.\n\n";
+    out << "#pragma once\n\n";
+    out << "#include <qwsengine/connection.h>\n";
+    out << "#include <qwsengine/jsonreader.h>\n";
+    out << "#include <qwsengine/jsonwriter.h>\n";
+    out << "#include <qwsengine/typedhandler.h>\n\n";
+    out << "#include <QByteArray>\n";
+    out << "#include <QLatin1String>\n";
+    out << "#include <QSharedPointer>\n";
+    out << "#include <QString>\n";
+    out << "#include <QVector>\n\n";
+
+    QStringList namespaces = m_namespace.split(QStringLiteral("::"), kSkipEmptyNames);
+    for (const QString &ns : namespaces) {
+        out << "namespace " << ns << " {\n";
+    }
+    out << '\n';
+
+    for (const StructDef &def : m_structs) {
+        writeStructDeclaration(out, def);
+    }
+
+    out << "class " << m_handlerName << " : public QWsEngine::TypedHandler {\n";
+    out << " public:\n";
+    out << indent(1) << "explicit " << m_handlerName << "(QObject *parent = nullptr);\n\n";
+    out << " protected:\n";
+    for (const Message &message : m_messages) {
+        if (message.inbound) {
+            out << indent(1) << "virtual void on" << message.structName
+                << "(const QSharedPointer<QWsEngine::Connection> &connection, const " << message.structName
+                << " &message);\n";
+        }
+    }
+    out << "\n private:\n";
+    for (const Message &message : m_messages) {
+        if (message.inbound) {
+            out << indent(1) << "static bool dispatch" << message.structName
+                << "(QWsEngine::TypedHandler *handler, const QSharedPointer<QWsEngine::Connection> &connection,\n"
+                << indent(1) << "                     QWsEngine::JsonReader *reader);\n";
+        }
+    }
+    out << "\n" << indent(1) << "static const QWsEngine::TypedHandler::Route s_routes[];\n";
+    out << indent(1) << "static const int                            s_routeCount;\n";
+    out << "};\n\n";
+
+    for (int i = namespaces.size() - 1; i >= 0; i--) {
+        out << "}  // namespace " << namespaces.at(i) << '\n';
+    }
+    out.flush();
+    return text.toUtf8();
+}
+
+QByteArray Generator::source() const {
+    QString     text;
+    QTextStream out(&text);
+
+    out << "// Generated by qwsengine-asyncapi-gen. Do not edit.\n\n";
+    out << "#include \"" << m_baseName << ".h\"\n\n";
+
+    QStringList namespaces = m_namespace.split(QStringLiteral("::"), kSkipEmptyNames);
+    for (const QString &ns : namespaces) {
+        out << "namespace " << ns << " {\n";
+    }
+    out << '\n';
+
+    for (const StructDef &def : m_structs) {
+        writeReadMethod(out, def);
+        writeWriteMethod(out, def);
+    }
+
+    // sorted by the UTF-8 encoded message name for the binary search of TypedHandler
+    int routeCount = 0;
+    out << "const QWsEngine::TypedHandler::Route " << m_handlerName << "::s_routes[] = {\n";
+    for (const Message &message : m_messages) {
+        if (message.inbound) {
+            out << indent(1) << '{' << cString(message.wireName) << ", &" << m_handlerName << "::dispatch"
+                << message.structName << "},\n";
+            routeCount++;
+        }
+    }
+    if (routeCount == 0) {
+        out << indent(1) << "{nullptr, nullptr},\n";
+    }
+    out << "};\n\n";
+    out << "const int " << m_handlerName << "::s_routeCount = " << routeCount << ";\n\n";
+
+    out << m_handlerName << "::" << m_handlerName << "(QObject *parent)\n";
+    out << "    : QWsEngine::TypedHandler(s_routes, s_routeCount, parent) {\n";
+    if (m_msgNameField != QLatin1String("type")) {
+        out << indent(1) << "setMsgNameField(" << cString(m_msgNameField) << ");\n";
+    }
+    out << "}\n\n";
+
+    for (const Message &message : m_messages) {
+        if (!message.inbound) {
+            continue;
+        }
+        out << "void " << m_handlerName << "::on" << message.structName
+            << "(const QSharedPointer<QWsEngine::Connection> &connection, const " << message.structName
+            << " &message) {\n";
+        out << indent(1) << "Q_UNUSED(message)\n";
+        out << indent(1) << "connection->sendErrorResponse(501, QStringLiteral(\"Not implemented\"));\n";
+        out << "}\n\n";
+
+        out << "bool " << m_handlerName << "::dispatch" << message.structName
+            << "(QWsEngine::TypedHandler *handler, const QSharedPointer<QWsEngine::Connection> &connection,\n"
+            << "    QWsEngine::JsonReader *reader) {\n";
+        out << indent(1) << message.structName << " message;\n";
+        out << indent(1) << "if (!message.read(reader)) {\n";
+        out << indent(1) << "    return false;\n";
+        out << indent(1) << "}\n";
+        out << indent(1) << "static_cast<" << m_handlerName << " *>(handler)->on" << message.structName
+            << "(connection, message);\n";
+        out << indent(1) << "return true;\n";
+        out << "}\n\n";
+    }
+
+    for (int i = namespaces.size() - 1; i >= 0; i--) {
+        out << "}  // namespace " << namespaces.at(i) << '\n';
+    }
+    out.flush();
+    return text.toUtf8();
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+/**
+ * @brief Generates message structs with specialized JSON parsers and a QWsEngine::TypedHandler subclass from an
+ * AsyncAPI 2.x document.
+ *
+ * Every message in `components/messages` becomes a struct with read() and write() methods. Messages referenced by a
+ * `publish` operation of a channel, i.e. sent by the client, additionally get a virtual handler method and an entry in
+ * the route table. If no channel defines a publish operation, all messages are routed.
+ *
+ * Payload schemas are mapped to C++ types:
+ * - string: QString, integer: qint64, number: double, boolean: bool
+ * - object with properties: nested struct
+ * - array: QVector of the item type
+ * - everything else: QByteArray with the raw JSON value
+ */
+class Generator {
+ public:
+    Generator();
+
+    void setNamespace(const QString &ns) { m_namespace = ns; }
+    void setHandlerName(const QString &name) { m_handlerName = name; }
+    void setBaseName(const QString &name) { m_baseName = name; }
+    void setMsgNameField(const QString &field) { m_msgNameField = field; }
+
+    bool load(const QByteArray &json, QString *errorMsg);
+
+    QByteArray header() const;
+    QByteArray source() const;
+
+    /**
+     * @brief Non-fatal issues found while loading, e.g. unsupported schema constructs mapped to raw JSON.
+     */
+    QStringList warnings() const { return m_warnings; }
+
+ private:
+    enum Kind { String, Integer, Number, Boolean, Struct, Array, Raw };
+
+    struct Type {
+        Type() : kind(Raw), elementKind(Raw) {}
+        Kind    kind;
+        Kind    elementKind;  // for arrays
+        QString structName;   // for structs and arrays of structs
+    };
+
+    struct Field {
+        QString jsonName;
+        QString member;
+        Type    type;
+        bool    required;
+        QString constValue;
+    };
+
+    struct StructDef {
+        QString        name;
+        QVector<Field> fields;
+        bool           isMessage;
+        QString        wireName;
+    };
+
+    struct Message {
+        QString structName;
+        QString wireName;
+        bool    inbound;
+    };
+
+    QJsonObject resolve(const QJsonObject &schema, QString *ref = nullptr) const;
+    Type        typeOf(const QJsonObject &schema, const QString &nameHint);
+    Kind        scalarKind(const QJsonObject &schema) const;
+    QString     buildStruct(const QJsonObject &schema, const QString &name, bool isMessage, const QString &wireName);
+    QString     uniqueStructName(const QString &name);
+    QString     wireNameOf(const QString &key, const QJsonObject &message, const QJsonObject &payload) const;
+    QSet<QString> inboundMessageKeys() const;
+
+    QString cppType(const Type &type) const;
+    QString cppType(Kind kind, const QString &structName) const;
+    void    writeStructDeclaration(QTextStream &out, const StructDef &def) const;
+    void    writeReadMethod(QTextStream &out, const StructDef &def) const;
+    void    writeWriteMethod(QTextStream &out, const StructDef &def) const;
+    void    writeFieldRead(QTextStream &out, const Field &field, int bit) const;
+    QString readCall(Kind kind, const QString &target) const;
+
+    QString m_namespace;
+    QString m_handlerName;
+    QString m_baseName;
+    QString m_msgNameField;
+
+    QJsonObject m_document;
+    // structs in dependency order: nested structs are defined before their users
+    QVector<StructDef>     m_structs;
+    QSet<QString>          m_structNames;
+    QHash<QString, QString> m_refStructs;
+    QSet<QString>          m_resolving;
+    QVector<Message>       m_messages;
+    QStringList            m_warnings;
+};
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+// Generates message structs with specialized parsers and a QWsEngine::TypedHandler subclass from an AsyncAPI 2.x
+// document in JSON format. See QWsEngineAsyncApi.cmake for the build integration.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include "generator.h"
+
+namespace {
+
+bool writeFile(const QString &fileName, const QByteArray &content, QTextStream &err) {
+    // keep the timestamp of unchanged files to avoid rebuilding all users
+    QFile existing(fileName);
+    if (existing.open(QIODevice::ReadOnly) && existing.readAll() == content) {
+        return true;
+    }
+    existing.close();
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size() || !file.commit()) {
+        err << "Cannot write " << fileName << ": " << file.errorString() << '\n';
+        return false;
+    }
+    return true;
+}
+
+QString defaultHandlerName(const QString &baseName) {
+    QString result;
+    bool    upper = true;
+    for (QChar c : baseName) {
+        if (c.isLetterOrNumber() && c.unicode() < 0x80) {
+            result.append(upper ? c.toUpper() : c);
+            upper = false;
+        } else {
+            upper = true;
+        }
+    }
+    return result + QStringLiteral("Handler");
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qwsengine-asyncapi-gen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generate typed QWsEngine message handlers from an AsyncAPI 2.x JSON document");
+    parser.addHelpOption();
+    QCommandLineOption outputDirOption({"o", "output-dir"}, "Output directory, default: current directory", "dir",
+                                       ".");
+    QCommandLineOption nameOption("name", "Base name of the generated files, default: name of the spec file", "name");
+    QCommandLineOption namespaceOption("namespace", "Namespace of the generated code, e.g. api::v1", "namespace");
+    QCommandLineOption handlerOption("handler", "Class name of the generated handler, default: <Name>Handler",
+                                     "class");
+    QCommandLineOption msgNameFieldOption("msg-name-field", "Message field containing the message name, default: type",
+                                          "field", "type");
+    parser.addOption(outputDirOption);
+    parser.addOption(nameOption);
+    parser.addOption(namespaceOption);
+    parser.addOption(handlerOption);
+    parser.addOption(msgNameFieldOption);
+    parser.addPositionalArgument("spec", "AsyncAPI document");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1) {
+        parser.showHelp(1);
+    }
+
+    QTextStream err(stderr);
+
+    QFile spec(args.at(0));
+    if (!spec.open(QIODevice::ReadOnly)) {
+        err << "Cannot open " << spec.fileName() << ": " << spec.errorString() << '\n';
+        return 1;
+    }
+
+    QString baseName = parser.value(nameOption);
+    if (baseName.isEmpty()) {
+        baseName = QFileInfo(spec.fileName()).completeBaseName();
+    }
+    QString handlerName = parser.value(handlerOption);
+    if (handlerName.isEmpty()) {
+        handlerName = defaultHandlerName(baseName);
+    }
+
+    Generator generator;
+    generator.setBaseName(baseName);
+    generator.setHandlerName(handlerName);
+    generator.setNamespace(parser.value(namespaceOption));
+    generator.setMsgNameField(parser.value(msgNameFieldOption));
+
+    QString errorMsg;
+    if (!generator.load(spec.readAll(), &errorMsg)) {
+        err << spec.fileName() << ": " << errorMsg << '\n';
+        return 1;
+    }
+    for (const QString &warning : generator.warnings()) {
+        err << spec.fileName() << ": warning: " << warning << '\n';
+    }
+
+    QDir outputDir(parser.value(outputDirOption));
+    if (!outputDir.mkpath(".")) {
+        err << "Cannot create output directory " << outputDir.path() << '\n';
+        return 1;
+    }
+    if (!writeFile(outputDir.filePath(baseName + ".h"), generator.header(), err) ||
+        !writeFile(outputDir.filePath(baseName + ".cpp"), generator.source(), err)) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+// Compares the generic QObjectHandler message path (QJsonDocument -> QVariant -> slot) with a handler generated by
+// qwsengine-asyncapi-gen from benchmark.json, which parses the messages straight into structs.
+//
+// Both handlers extract the same fields. The benchmark reports the time and the number of heap allocations per
+// message for parsing and dispatching, and for encoding an outbound event.
+
+#include <qwsengine/connection.h>
+#include <qwsengine/jsonwriter.h>
+#include <qwsengine/qobjecthandler.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QTextStream>
+#include <QWebSocket>
+
+#include <atomic>
+
+#include "benchmark.h"
+
+#ifdef __GLIBC__
+#include <cstddef>
+
+// count all heap allocations of the process by wrapping the glibc allocator
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void  __libc_free(void *ptr);
+}
+
+namespace {
+std::atomic<quint64> g_allocations(0);
+}
+
+extern "C" void *malloc(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) {
+    __libc_free(ptr);
+}
+#endif
+
+namespace {
+
+// consumed values, keeps the compiler from dropping the extraction
+qint64 g_sink = 0;
+
+quint64 allocationCount() {
+#ifdef __GLIBC__
+    return g_allocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+const char *const kSetVolume =
+    "{\"type\":\"set_volume\",\"req_id\":42,"
+    "\"msg_data\":{\"entity_id\":\"media_player.living_room\",\"volume\":35,\"muted\":false}}";
+
+const char *const kGetEntities =
+    "{\"type\":\"get_entities\",\"req_id\":43,\"msg_data\":{\"filter\":{\"area\":\"living_room\","
+    "\"device_class\":\"speaker\",\"entity_types\":[\"media_player\",\"light\",\"switch\"]},\"limit\":50}}";
+
+class GeneratedHandler : public bench::BenchmarkHandler {
+ protected:
+    void onSetVolume(const QSharedPointer<QWsEngine::Connection> &connection,
+                     const bench::SetVolume &                     message) override {
+        Q_UNUSED(connection)
+        g_sink += message.msg_data.volume + (message.msg_data.muted ? 1 : 0) + message.msg_data.entity_id.size();
+    }
+
+    void onGetEntities(const QSharedPointer<QWsEngine::Connection> &connection,
+                       const bench::GetEntities &                   message) override {
+        Q_UNUSED(connection)
+        g_sink += message.msg_data.filter.area.size() + message.msg_data.filter.device_class.size() +
+                  message.msg_data.filter.entity_types.size() + message.msg_data.limit;
+    }
+};
+
+void registerGeneric(QWsEngine::QObjectHandler *handler) {
+    handler->registerMessage("set_volume", [](QWsEngine::Connection *connection, const QVariant &message) {
+        Q_UNUSED(connection)
+        QVariantMap msgData = message.toMap().value("msg_data").toMap();
+        g_sink += msgData.value("volume").toInt() + (msgData.value("muted").toBool() ? 1 : 0) +
+                  msgData.value("entity_id").toString().size();
+    });
+    handler->registerMessage("get_entities", [](QWsEngine::Connection *connection, const QVariant &message) {
+        Q_UNUSED(connection)
+        QVariantMap msgData = message.toMap().value("msg_data").toMap();
+        QVariantMap filter = msgData.value("filter").toMap();
+        g_sink += filter.value("area").toString().size() + filter.value("device_class").toString().size() +
+                  filter.value("entity_types").toList().size() + msgData.value("limit").toInt();
+    });
+}
+
+struct Result {
+    double nsPerMessage;
+    double allocationsPerMessage;
+};
+
+template <typename Function>
+Result measure(int iterations, Function function) {
+    for (int i = 0; i < qMin(iterations, 1000); i++) {
+        function();
+    }
+
+    quint64       allocations = allocationCount();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; i++) {
+        function();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    allocations = allocationCount() - allocations;
+
+    Result result;
+    result.nsPerMessage = static_cast<double>(elapsed) / iterations;
+    result.allocationsPerMessage = static_cast<double>(allocations) / iterations;
+    return result;
+}
+
+void print(QTextStream &out, const char *name, const Result &generic, const Result &generated) {
+    out << qSetFieldWidth(14) << left << name << qSetFieldWidth(12) << right << qRound(generic.nsPerMessage)
+        << qRound(generated.nsPerMessage) << qSetFieldWidth(14)
+        << QString::number(generic.allocationsPerMessage, 'f', 1)
+        << QString::number(generated.allocationsPerMessage, 'f', 1) << qSetFieldWidth(0) << '\n';
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qwsengine-codegenbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compare generated typed handlers with the generic QObjectHandler");
+    parser.addHelpOption();
+    parser.addPositionalArgument("iterations", "Messages per measurement, default: 200000", "[iterations]");
+    parser.process(app);
+
+    int iterations = parser.positionalArguments().value(0).toInt();
+    if (iterations <= 0) {
+        iterations = 200000;
+    }
+
+    // the per message debug output would dominate the measurement
+    QLoggingCategory::setFilterRules(QStringLiteral("wsengine.debug=false"));
+
+    QWsEngine::QObjectHandler generic;
+    registerGeneric(&generic);
+    GeneratedHandler generated;
+
+    // an unconnected socket: the handlers under test don't send anything
+    QSharedPointer<QWsEngine::Connection> connection(new QWsEngine::Connection(new QWebSocket(), true));
+
+    QTextStream out(stdout);
+    out << qSetFieldWidth(14) << left << "message" << qSetFieldWidth(12) << right << "generic ns"
+        << "typed ns" << qSetFieldWidth(14) << "generic alloc" << "typed alloc" << qSetFieldWidth(0) << '\n';
+
+    for (const char *json : {kSetVolume, kGetEntities}) {
+        const QString message = QString::fromUtf8(json);
+        Result genericResult = measure(iterations, [&] { generic.routeTextMessage(connection, message); });
+        Result generatedResult = measure(iterations, [&] { generated.routeTextMessage(connection, message); });
+        print(out, QJsonDocument::fromJson(json).object().value("type").toString().toUtf8().constData(),
+              genericResult, generatedResult);
+    }
+
+    // outbound event: QVariantMap -> QJsonDocument compared with the generated writer
+    QWsEngine::JsonWriter writer;
+    Result genericResult = measure(iterations, [&] {
+        QVariantMap msgData;
+        msgData.insert("entity_id", QStringLiteral("media_player.living_room"));
+        msgData.insert("volume", 35);
+        msgData.insert("muted", false);
+        QVariantMap event;
+        event.insert("type", QStringLiteral("volume_changed"));
+        event.insert("msg_data", msgData);
+        g_sink += QJsonDocument::fromVariant(event).toJson(QJsonDocument::Compact).size();
+    });
+    Result generatedResult = measure(iterations, [&] {
+        bench::VolumeChanged event;
+        event.msg_data.entity_id = QStringLiteral("media_player.living_room");
+        event.msg_data.volume = 35;
+        event.msg_data.muted = false;
+        writer.clear();
+        event.write(&writer);
+        g_sink += writer.data().size();
+    });
+    print(out, "volume_changed", genericResult, generatedResult);
+
+    // print the sink so the extracted values are used
+    QTextStream(stderr) << "checksum: " << g_sink << '\n';
+    return 0;
+}
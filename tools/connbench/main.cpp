@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+// Measures the memory footprint of idle client connections.
+//
+// The benchmark creates idle QWebSocket instances and routes them through a ConnectionHandler, keeping the resulting
+// connections in a registry like QWsEngine::Server does. The heap usage of the bare sockets is measured separately,
+// so the engine overhead per connection can be reported on its own.
+
+#include <qwsengine/connection.h>
+#include <qwsengine/connectionhandler.h>
+#include <qwsengine/handler.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QTextStream>
+#include <QVector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Returns the used heap memory in bytes, or the resident set size if heap statistics are not available.
+ */
+qint64 usedMemory() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return static_cast<qint64>(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    return static_cast<qint64>(static_cast<unsigned int>(info.uordblks)) +
+           static_cast<qint64>(static_cast<unsigned int>(info.hblkhd));
+#else
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields.at(1).toLongLong() * 4096 : 0;
+#endif
+}
+
+struct Result {
+    int    count;
+    double socketBytes;
+    double engineBytes;
+};
+
+Result measure(int count) {
+    QWsEngine::Handler           handler;
+    QWsEngine::ConnectionHandler connectionHandler(&handler);
+
+    QVector<QWebSocket *> sockets;
+    sockets.reserve(count);
+
+    qint64 start = usedMemory();
+    for (int i = 0; i < count; i++) {
+        sockets.append(new QWebSocket());
+    }
+    qint64 socketsAllocated = usedMemory();
+
+    QHash<QWebSocket *, QSharedPointer<QWsEngine::Connection>> connections;
+    connections.reserve(count);
+    for (QWebSocket *socket : sockets) {
+        auto conn = connectionHandler.route(socket, "/");
+        if (conn) {
+            // same signal connection as QWsEngine::Server uses to release disconnected clients
+            QObject::connect(socket, &QWebSocket::disconnected, &connectionHandler, [] {});
+            connections.insert(socket, conn);
+        }
+    }
+    qint64 connectionsAllocated = usedMemory();
+
+    Result result;
+    result.count = count;
+    result.socketBytes = static_cast<double>(socketsAllocated - start) / count;
+    result.engineBytes = static_cast<double>(connectionsAllocated - socketsAllocated) / count;
+
+    // the connections delete their sockets
+    connections.clear();
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qwsengine-connbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measure the memory footprint of idle QWsEngine connections");
+    parser.addHelpOption();
+    parser.addPositionalArgument("counts", "Connection counts to measure, default: 10000 100000", "[counts...]");
+    parser.process(app);
+
+    QList<int> counts;
+    for (const QString &arg : parser.positionalArguments()) {
+        int count = arg.toInt();
+        if (count > 0) {
+            counts.append(count);
+        }
+    }
+    if (counts.isEmpty()) {
+        counts << 10000 << 100000;
+    }
+
+    QTextStream out(stdout);
+    out << "connections  socket bytes/conn  engine bytes/conn  total bytes/conn\n";
+    for (int count : counts) {
+        Result result = measure(count);
+        out << qSetFieldWidth(11) << result.count << qSetFieldWidth(0) << "  " << qSetFieldWidth(17)
+            << qRound(result.socketBytes) << qSetFieldWidth(0) << "  " << qSetFieldWidth(17)
+            << qRound(result.engineBytes) << qSetFieldWidth(0) << "  " << qSetFieldWidth(16)
+            << qRound(result.socketBytes + result.engineBytes) << qSetFieldWidth(0) << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include "embeddedserver.h"
+
+#include <qwsengine/authmiddleware.h>
+#include <qwsengine/connection.h>
+#include <qwsengine/headerauthconnectionhandler.h>
+#include <qwsengine/msgauthconnectionhandler.h>
+#include <qwsengine/msgauthmiddleware.h>
+#include <qwsengine/qobjecthandler.h>
+#include <qwsengine/tokenauthenticator.h>
+
+#include <QJsonObject>
+
+namespace {
+
+class StaticTokenAuthenticator : public QWsEngine::TokenAuthenticator {
+ public:
+    StaticTokenAuthenticator(const QString &token, QObject *parent) : TokenAuthenticator(parent), m_token(token) {}
+
+    bool authenticate(const QString &path, const QString &token) override {
+        Q_UNUSED(path)
+        return token == m_token;
+    }
+
+ private:
+    QString m_token;
+};
+
+}  // namespace
+
+EmbeddedServer::EmbeddedServer(const QString &token, const QStringList &messageTypes, int listeners)
+    : m_token(token),
+      m_messageTypes(messageTypes),
+      m_listeners(listeners),
+      m_server(new QWsEngine::Server("qwsengine-loadgen", QWebSocketServer::NonSecureMode, this)) {}
+
+int EmbeddedServer::start(int port) {
+    auto authenticator = new StaticTokenAuthenticator(m_token, this);
+
+    auto handler = new QWsEngine::QObjectHandler(this);
+    for (const QString &type : m_messageTypes) {
+        handler->registerMessage(type, this, [](QWsEngine::Connection *connection, const QVariant &message) {
+            int id = message.toJsonObject().value("id").toInt();
+            connection->sendTextMessage(
+                QString("{\"type\": \"result\", \"req_id\": %1, \"success\": true}").arg(id));
+        });
+    }
+
+    auto msgAuthMiddleware = new QWsEngine::MsgAuthMiddleware("auth", "access_token", this);
+    msgAuthMiddleware->setTokenAuthenticator(authenticator);
+    auto msgRootHandler = new QWsEngine::Handler(this);
+    msgRootHandler->addMiddleware(msgAuthMiddleware);
+    msgRootHandler->addMiddleware(new QWsEngine::AuthMiddleware(this));
+    msgRootHandler->addSubHandler(QRegExp(".*"), handler);
+
+    auto headerAuth = new QWsEngine::HeaderAuthConnectionHandler(handler, "X-Auth-Token", this);
+    headerAuth->setTokenAuthenticator(authenticator);
+    auto msgAuth = new QWsEngine::MsgAuthConnectionHandler(msgRootHandler, this);
+
+    auto root = new QWsEngine::ConnectionHandler(this);
+    root->addSubHandler(QRegExp("^/header"), headerAuth);
+    root->addSubHandler(QRegExp("^/msg"), msgAuth);
+
+    m_server->setHandler(root);
+    bool ok = m_listeners > 1
+                  ? m_server->listenReusePort(QHostAddress::LocalHost, static_cast<quint16>(port), m_listeners)
+                  : m_server->listen(QHostAddress::LocalHost, static_cast<quint16>(port));
+    return ok ? m_server->serverPort() : 0;
+}
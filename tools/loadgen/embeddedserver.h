@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <qwsengine/server.h>
+
+#include <QObject>
+#include <QStringList>
+
+/**
+ * @brief In-process loopback server offering both authentication flows.
+ *
+ * - `/header`: token in the X-Auth-Token header, HeaderAuthConnectionHandler
+ * - `/msg`: token in an auth message, MsgAuthConnectionHandler with MsgAuthMiddleware
+ *
+ * Every message type of the load mix is answered with a result message containing the request id.
+ */
+class EmbeddedServer : public QObject {
+    Q_OBJECT
+
+ public:
+    EmbeddedServer(const QString &token, const QStringList &messageTypes, int listeners);
+
+    /**
+     * @brief Start listening on the loopback interface. Returns the port or 0 on error.
+     */
+    Q_INVOKABLE int start(int port);
+
+ private:
+    QString            m_token;
+    QStringList        m_messageTypes;
+    int                m_listeners;
+    QWsEngine::Server *m_server;
+};
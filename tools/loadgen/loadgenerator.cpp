@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#include "loadgenerator.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkRequest>
+#include <QTextStream>
+
+#include <algorithm>
+
+namespace {
+
+const int kTickMs = 5;
+
+qint64 percentile(const QVector<qint64> &sorted, double p) {
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    int index = qBound(0, static_cast<int>(p * sorted.size() + 0.5) - 1, sorted.size() - 1);
+    return sorted.at(index);
+}
+
+QString formatMs(qint64 ns) {
+    return QString::number(static_cast<double>(ns) / 1000000.0, 'f', 3);
+}
+
+}  // namespace
+
+LoadGenerator::LoadGenerator(const LoadConfig &config, QObject *parent) : QObject(parent), m_config(config) {
+    int sum = 0;
+    for (const auto &entry : m_config.mix) {
+        sum += qMax(1, entry.second);
+        m_cumulativeWeights.append(sum);
+    }
+
+    m_clients.resize(m_config.clients);
+    m_readyClients.reserve(m_config.clients);
+
+    connect(&m_connectTimer, &QTimer::timeout, this, &LoadGenerator::openConnections);
+    connect(&m_sendTimer, &QTimer::timeout, this, &LoadGenerator::sendMessages);
+}
+
+void LoadGenerator::start() {
+    m_clock.start();
+    m_firstOpenNs = m_clock.nsecsElapsed();
+    m_connectTimer.start(kTickMs);
+    openConnections();
+}
+
+void LoadGenerator::openConnections() {
+    qint64 elapsedNs = m_clock.nsecsElapsed() - m_firstOpenNs;
+    int    due = qMin(m_config.clients,
+                   static_cast<int>(static_cast<double>(m_config.connectRate) * elapsedNs / 1000000000.0) + 1);
+
+    for (; m_opened < due; m_opened++) {
+        int         index = m_opened;
+        QWebSocket *socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+        m_clients[index].socket = socket;
+        m_clients[index].openedNs = m_clock.nsecsElapsed();
+
+        connect(socket, &QWebSocket::connected, this, [this, index] { onConnected(index); });
+        connect(socket, &QWebSocket::textMessageReceived, this,
+                [this, index](const QString &message) { onTextMessage(index, message); });
+        connect(socket, &QWebSocket::disconnected, this, [this, index] { onClosed(index); });
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        connect(socket, &QWebSocket::errorOccurred, this,
+                [this, socket](QAbstractSocket::SocketError) { m_socketErrors[socket->errorString()]++; });
+#else
+        connect(socket, static_cast<void (QWebSocket::*)(QAbstractSocket::SocketError)>(&QWebSocket::error), this,
+                [this, socket](QAbstractSocket::SocketError) { m_socketErrors[socket->errorString()]++; });
+#endif
+
+        QUrl url = m_config.url;
+        switch (m_config.auth) {
+            case LoadConfig::HeaderAuth: {
+                url.setPath("/header");
+                QNetworkRequest request(url);
+                request.setRawHeader("X-Auth-Token", m_config.token.toUtf8());
+                socket->open(request);
+                break;
+            }
+            case LoadConfig::MessageAuth:
+                url.setPath("/msg");
+                socket->open(url);
+                break;
+            default:
+                socket->open(url);
+                break;
+        }
+    }
+
+    if (m_opened >= m_config.clients) {
+        m_connectTimer.stop();
+        startSending();
+    }
+}
+
+void LoadGenerator::onConnected(int index) {
+    if (m_config.auth == LoadConfig::MessageAuth) {
+        // The auth message doesn't get a response: messages are processed in order, therefore the client is ready
+        // as soon as the auth message has been sent.
+        m_clients[index].socket->sendTextMessage(
+            QString("{\"type\": \"auth\", \"access_token\": \"%1\"}").arg(m_config.token));
+    }
+    markReady(index);
+}
+
+void LoadGenerator::markReady(int index) {
+    Client &client = m_clients[index];
+    client.ready = true;
+    m_lastReadyNs = m_clock.nsecsElapsed();
+    m_setupTimes.append(m_lastReadyNs - client.openedNs);
+    m_readyClients.append(index);
+}
+
+void LoadGenerator::onTextMessage(int index, const QString &message) {
+    Q_UNUSED(index)
+    qint64 now = m_clock.nsecsElapsed();
+
+    QJsonObject json = QJsonDocument::fromJson(message.toUtf8()).object();
+    if (json.contains("error")) {
+        m_errorCodes[json.value("error").toObject().value("code").toInt()]++;
+        return;
+    }
+    if (!json.contains("req_id")) {
+        return;  // e.g. auth_required
+    }
+
+    auto it = m_pending.find(json.value("req_id").toInt());
+    if (it != m_pending.end()) {
+        m_latencies.append(now - it.value());
+        m_pending.erase(it);
+        m_received++;
+    }
+}
+
+void LoadGenerator::onClosed(int index) {
+    Client &client = m_clients[index];
+    m_closeCodes[client.socket->closeCode()]++;
+    if (client.ready) {
+        client.ready = false;
+        m_readyClients.removeOne(index);
+    } else {
+        m_failed++;
+    }
+}
+
+void LoadGenerator::startSending() {
+    if (m_sending) {
+        return;
+    }
+    m_sending = true;
+    m_sendStartNs = m_clock.nsecsElapsed();
+    m_sendTimer.start(kTickMs);
+    QTimer::singleShot(m_config.durationSec * 1000, this, &LoadGenerator::stop);
+}
+
+const QString &LoadGenerator::nextMessageType() {
+    // xorshift32, good enough for a weighted message mix
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+
+    int value = static_cast<int>(m_random % static_cast<quint32>(m_cumulativeWeights.last()));
+    int index = static_cast<int>(std::upper_bound(m_cumulativeWeights.constBegin(), m_cumulativeWeights.constEnd(),
+                                                  value) -
+                                 m_cumulativeWeights.constBegin());
+    return m_config.mix.at(index).first;
+}
+
+void LoadGenerator::sendMessages() {
+    if (m_readyClients.isEmpty()) {
+        return;
+    }
+    qint64 now = m_clock.nsecsElapsed();
+    qint64 due = static_cast<qint64>(static_cast<double>(m_config.rate) * (now - m_sendStartNs) / 1000000000.0);
+
+    for (; m_sent < due; m_sent++) {
+        m_roundRobin = (m_roundRobin + 1) % m_readyClients.size();
+        QWebSocket *socket = m_clients.at(m_readyClients.at(m_roundRobin)).socket;
+
+        int id = ++m_nextId;
+        m_pending.insert(id, m_clock.nsecsElapsed());
+        socket->sendTextMessage(QString("{\"type\": \"%1\", \"id\": %2}").arg(nextMessageType()).arg(id));
+    }
+}
+
+void LoadGenerator::stop() {
+    m_sendTimer.stop();
+    m_sendEndNs = m_clock.nsecsElapsed();
+    // collect outstanding responses
+    QTimer::singleShot(1000, this, [this] {
+        report();
+        emit finished();
+    });
+}
+
+void LoadGenerator::report() {
+    QTextStream out(stdout);
+
+    std::sort(m_latencies.begin(), m_latencies.end());
+    std::sort(m_setupTimes.begin(), m_setupTimes.end());
+
+    double setupSec = static_cast<double>(m_lastReadyNs - m_firstOpenNs) / 1000000000.0;
+    double sendSec = static_cast<double>(m_sendEndNs - m_sendStartNs) / 1000000000.0;
+
+    out << "connections:  opened " << m_opened << ", established " << m_setupTimes.size() << ", failed " << m_failed
+        << '\n';
+    out << "setup:        " << (setupSec > 0 ? qRound(m_setupTimes.size() / setupSec) : 0) << " conn/s, p50 "
+        << formatMs(percentile(m_setupTimes, 0.5)) << " ms, p99 " << formatMs(percentile(m_setupTimes, 0.99))
+        << " ms\n";
+    out << "messages:     sent " << m_sent << ", received " << m_received << ", unanswered " << m_pending.size()
+        << '\n';
+    out << "throughput:   " << (sendSec > 0 ? qRound(m_received / sendSec) : 0) << " msg/s\n";
+    out << "latency:      p50 " << formatMs(percentile(m_latencies, 0.5)) << " ms, p99 "
+        << formatMs(percentile(m_latencies, 0.99)) << " ms, p999 " << formatMs(percentile(m_latencies, 0.999))
+        << " ms, max " << formatMs(m_latencies.isEmpty() ? 0 : m_latencies.last()) << " ms\n";
+
+    for (auto it = m_errorCodes.constBegin(); it != m_errorCodes.constEnd(); ++it) {
+        out << "error code:   " << it.key() << ": " << it.value() << '\n';
+    }
+    for (auto it = m_closeCodes.constBegin(); it != m_closeCodes.constEnd(); ++it) {
+        out << "close code:   " << it.key() << ": " << it.value() << '\n';
+    }
+    for (auto it = m_socketErrors.constBegin(); it != m_socketErrors.constEnd(); ++it) {
+        out << "socket error: " << it.key() << ": " << it.value() << '\n';
+    }
+}
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPair>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+#include <QtWebSockets/QWebSocket>
+
+struct LoadConfig {
+    enum AuthMode { NoAuth, HeaderAuth, MessageAuth };
+
+    QUrl                       url;
+    AuthMode                   auth = MessageAuth;
+    QString                    token;
+    int                        clients = 1000;
+    int                        connectRate = 1000;
+    QList<QPair<QString, int>> mix;
+    int                        rate = 10000;
+    int                        durationSec = 10;
+};
+
+/**
+ * @brief Opens many WebSocket clients and drives a weighted message mix at a target rate.
+ *
+ * Messages are sent as `{"type": "<name>", "id": <n>}`, the latency is measured until a message with the matching
+ * `req_id` field is received.
+ */
+class LoadGenerator : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit LoadGenerator(const LoadConfig &config, QObject *parent = nullptr);
+
+    void start();
+
+ Q_SIGNALS:  // NOLINT
+    void finished();
+
+ private:
+    struct Client {
+        QWebSocket *socket = nullptr;
+        qint64      openedNs = 0;
+        bool        ready = false;
+    };
+
+    void openConnections();
+    void onConnected(int index);
+    void onTextMessage(int index, const QString &message);
+    void onClosed(int index);
+    void markReady(int index);
+    void startSending();
+    void sendMessages();
+    void stop();
+    void report();
+
+    const QString &nextMessageType();
+
+    LoadConfig         m_config;
+    QVector<Client>    m_clients;
+    QVector<int>       m_readyClients;
+    QVector<int>       m_cumulativeWeights;
+    QHash<int, qint64> m_pending;
+    QVector<qint64>    m_latencies;
+    QVector<qint64>    m_setupTimes;
+    QMap<int, int>     m_errorCodes;
+    QMap<QString, int> m_socketErrors;
+    QMap<int, int>     m_closeCodes;
+
+    QElapsedTimer m_clock;
+    QTimer        m_connectTimer;
+    QTimer        m_sendTimer;
+
+    int     m_opened = 0;
+    int     m_failed = 0;
+    int     m_nextId = 0;
+    int     m_roundRobin = 0;
+    qint64  m_sent = 0;
+    qint64  m_received = 0;
+    qint64  m_firstOpenNs = 0;
+    qint64  m_lastReadyNs = 0;
+    qint64  m_sendStartNs = 0;
+    qint64  m_sendEndNs = 0;
+    bool    m_sending = false;
+    quint32 m_random = 2463534242u;
+};
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+// High-concurrency load generator for QWsEngine servers.
+//
+// Without --url an embedded server is started on the loopback interface in a separate thread, offering header
+// authentication on /header and message authentication on /msg.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QThread>
+
+#include "embeddedserver.h"
+#include "loadgenerator.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qwsengine-loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for QWsEngine WebSocket servers");
+    parser.addHelpOption();
+    QCommandLineOption urlOption("url", "Server URL, e.g. ws://127.0.0.1:8080. Starts an embedded server if omitted.",
+                                 "url");
+    QCommandLineOption authOption("auth", "Authentication flow: header, message or none. Default: message", "mode",
+                                  "message");
+    QCommandLineOption tokenOption("token", "Authentication token. Default: loadgen", "token", "loadgen");
+    QCommandLineOption clientsOption("clients", "Number of clients. Default: 1000", "n", "1000");
+    QCommandLineOption connectRateOption("connect-rate", "New connections per second. Default: 1000", "n", "1000");
+    QCommandLineOption mixOption("mix", "Weighted message mix, e.g. get_state:8,set_volume:2. Default: echo:1", "mix",
+                                 "echo:1");
+    QCommandLineOption rateOption("rate", "Total messages per second. Default: 10000", "n", "10000");
+    QCommandLineOption durationOption("duration", "Send duration in seconds. Default: 10", "s", "10");
+    QCommandLineOption listenersOption("listeners", "Listener threads of the embedded server. Default: 1", "n", "1");
+    parser.addOptions({urlOption, authOption, tokenOption, clientsOption, connectRateOption, mixOption, rateOption,
+                       durationOption, listenersOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    LoadConfig config;
+    config.token = parser.value(tokenOption);
+    config.clients = qMax(1, parser.value(clientsOption).toInt());
+    config.connectRate = qMax(1, parser.value(connectRateOption).toInt());
+    config.rate = qMax(1, parser.value(rateOption).toInt());
+    config.durationSec = qMax(1, parser.value(durationOption).toInt());
+
+    QString auth = parser.value(authOption);
+    if (auth == "header") {
+        config.auth = LoadConfig::HeaderAuth;
+    } else if (auth == "message") {
+        config.auth = LoadConfig::MessageAuth;
+    } else if (auth == "none") {
+        config.auth = LoadConfig::NoAuth;
+    } else {
+        err << "Invalid authentication flow: " << auth << '\n';
+        return 1;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QStringList entries = parser.value(mixOption).split(',', Qt::SkipEmptyParts);
+#else
+    const QStringList entries = parser.value(mixOption).split(',', QString::SkipEmptyParts);
+#endif
+    QStringList messageTypes;
+    for (const QString &entry : entries) {
+        QStringList parts = entry.split(':');
+        int         weight = parts.size() > 1 ? parts.at(1).toInt() : 1;
+        config.mix.append(qMakePair(parts.at(0), qMax(1, weight)));
+        messageTypes.append(parts.at(0));
+    }
+    if (config.mix.isEmpty()) {
+        err << "Empty message mix" << '\n';
+        return 1;
+    }
+
+    QThread         serverThread;
+    EmbeddedServer *server = nullptr;
+    if (parser.isSet(urlOption)) {
+        config.url = QUrl(parser.value(urlOption));
+    } else {
+        server = new EmbeddedServer(config.token, messageTypes, parser.value(listenersOption).toInt());
+        server->moveToThread(&serverThread);
+        QObject::connect(&serverThread, &QThread::finished, server, &QObject::deleteLater);
+        serverThread.start();
+
+        int port = 0;
+        QMetaObject::invokeMethod(server, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG(int, port),
+                                  Q_ARG(int, 0));
+        if (port == 0) {
+            err << "Cannot start embedded server" << '\n';
+            serverThread.quit();
+            serverThread.wait();
+            return 1;
+        }
+        config.url = QUrl(QString("ws://127.0.0.1:%1").arg(port));
+    }
+
+    LoadGenerator generator(config);
+    QObject::connect(&generator, &LoadGenerator::finished, &app, &QCoreApplication::quit);
+    generator.start();
+
+    int ret = app.exec();
+
+    if (server) {
+        serverThread.quit();
+        serverThread.wait();
+    }
+    return ret;
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Copyright 2021 Markus Zehnder
+
+// Converts a binary trace written with QWsEngine::TraceRecorder::writeBinary() into the Chrome trace event JSON
+// format, which can be loaded in Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+
+#include <qwsengine/tracerecorder.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qwsengine-tracedump");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Convert a binary QWsEngine trace into Chrome trace event JSON");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Binary trace file");
+    parser.addPositionalArgument("output", "JSON output file, standard output if omitted");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    QTextStream err(stderr);
+
+    QFile input(args.at(0));
+    if (!input.open(QIODevice::ReadOnly)) {
+        err << "Cannot open " << input.fileName() << ": " << input.errorString() << '\n';
+        return 1;
+    }
+
+    QFile output;
+    bool  opened;
+    if (args.size() > 1) {
+        output.setFileName(args.at(1));
+        opened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    } else {
+        opened = output.open(stdout, QIODevice::WriteOnly);
+    }
+    if (!opened) {
+        err << "Cannot open output: " << output.errorString() << '\n';
+        return 1;
+    }
+
+    if (!QWsEngine::TraceRecorder::convertToChromeTrace(&input, &output)) {
+        err << "Invalid trace file: " << input.fileName() << '\n';
+        return 1;
+    }
+
+    return 0;
+}